@@ -0,0 +1,105 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/* Check oce_locate_patterns() of ../../src/byte_search.c against a
+ * simple byte-at-a-time search, for patterns with one, two and five
+ * distinct first bytes, and then time both on a large buffer. See
+ * README.md. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../../src/byte_search.h"
+
+/* Non-overlapping matches of the patterns (with masks, but no
+ * validators), first pattern winning, as in oce_locate_patterns(). */
+static size_t ref_locate(const unsigned char *buf, size_t nbuf,
+    const oce_byte_pattern *pattern, int npattern, int *start, int *which)
+{
+  size_t n = 0;
+  for (size_t i = 0; i < nbuf; i++) {
+    for (int p = 0; p < npattern; p++) {
+      const oce_byte_pattern *pp = pattern + p;
+      int k;
+      if (i + pp->nbytes > nbuf)
+        continue;
+      for (k = 0; k < pp->nbytes; k++)
+        if ((buf[i + k] & pp->mask[k]) != pp->bytes[k])
+          break;
+      if (k == pp->nbytes) {
+        start[n] = (int)i + 1;
+        which[n++] = p + 1;
+        i += pp->nbytes - 1;
+        break;
+      }
+    }
+  }
+  return n;
+}
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+  size_t n = argc > 1 ? (size_t)atol(argv[1]) : 100000000;
+  int reps = argc > 2 ? atoi(argv[2]) : 5;
+  unsigned char *buf = malloc(n);
+  int *start = malloc(n * sizeof(int)), *which = malloc(n * sizeof(int));
+  if (!buf || !start || !which)
+    return 1;
+  srand(1);
+  for (size_t i = 0; i < n; i++)
+    buf[i] = rand() & 0xff;
+  static const unsigned char key[5][3] = {{0xa5, 0x10, 0x00}, {0xa5, 0x11, 0x00},
+    {0x7f, 0x7f, 0x00}, {0x85, 0x16, 0x00}, {0x00, 0x00, 0x00}};
+  oce_byte_pattern pattern[5];
+  for (int p = 0; p < 5; p++)
+    oce_byte_pattern_init(pattern + p, key[p], p == 4 ? 3 : 2);
+  pattern[4].mask[1] = 0x00; /* 0x00, any, 0x00 */
+  int npattern[3] = {2, 3, 5}; /* 1, 2 and 4 distinct first bytes */
+  int bad = 0;
+  for (int t = 0; t < 3; t++) {
+    for (size_t len = 0; len < 3000; len += 7) {
+      for (int off = 0; off < 17; off++) {
+        oce_byte_matches m = {NULL, NULL, 0, 0};
+        if (oce_locate_patterns(buf + off, len, pattern, npattern[t], 0, &m))
+          return 1;
+        size_t nref = ref_locate(buf + off, len, pattern, npattern[t], start, which);
+        if (nref != m.n || (nref && (memcmp(start, m.start, nref * sizeof(int)) ||
+                memcmp(which, m.which, nref * sizeof(int)))))
+          bad++;
+        oce_byte_matches_free(&m);
+      }
+    }
+  }
+  printf("%d mismatches in short-buffer tests\n", bad);
+  for (int t = 0; t < 3; t++) {
+    size_t nref = 0, noce = 0;
+    double t0 = now();
+    for (int r = 0; r < reps; r++)
+      nref = ref_locate(buf, n, pattern, npattern[t], start, which);
+    double tref = now() - t0;
+    t0 = now();
+    for (int r = 0; r < reps; r++) {
+      oce_byte_matches m = {NULL, NULL, 0, 0};
+      oce_locate_patterns(buf, n, pattern, npattern[t], 0, &m);
+      noce = m.n;
+      oce_byte_matches_free(&m);
+    }
+    double toce = now() - t0;
+    printf("%d patterns: ref %6.3f GB/s, oce %6.3f GB/s (%lu and %lu matches)\n", npattern[t],
+        1e-9 * reps * (double)n / tref, 1e-9 * reps * (double)n / toce,
+        (unsigned long)nref, (unsigned long)noce);
+    if (nref != noce)
+      bad++;
+  }
+  free(buf);
+  free(start);
+  free(which);
+  return bad != 0;
+}
@@ -0,0 +1,71 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/* Check the checksum kernels of ../../src/checksum.c against simple
+ * byte-at-a-time versions, over a range of lengths and alignments,
+ * and then time them on a large buffer. See README.md. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../../src/checksum.h"
+
+static unsigned short ref_sum_bytes(const unsigned char *p, size_t n)
+{
+  unsigned short sum = 0;
+  for (size_t i = 0; i < n; i++)
+    sum += p[i];
+  return sum;
+}
+
+static unsigned short ref_sum_words_le(const unsigned char *p, size_t n)
+{
+  unsigned short sum = 0;
+  size_t i;
+  for (i = 0; i + 1 < n; i += 2)
+    sum += (unsigned short)(p[i] + 256 * p[i+1]);
+  if (i < n)
+    sum += (unsigned short)(256 * p[i]);
+  return sum;
+}
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+  size_t n = argc > 1 ? (size_t)atol(argv[1]) : 100000000;
+  int reps = argc > 2 ? atoi(argv[2]) : 10;
+  unsigned char *buf = malloc(n + 64);
+  if (!buf)
+    return 1;
+  srand(1);
+  for (size_t i = 0; i < n + 64; i++)
+    buf[i] = rand() & 0xff;
+  int bad = 0;
+  for (size_t len = 0; len < 300; len++) {
+    for (int off = 0; off < 33; off++) {
+      if (oce_sum_bytes(buf + off, len) != ref_sum_bytes(buf + off, len))
+        bad++;
+      if (oce_sum_words_le(buf + off, len) != ref_sum_words_le(buf + off, len))
+        bad++;
+    }
+  }
+  printf("%d mismatches in short-buffer tests\n", bad);
+  const char *name[] = {"ref_sum_bytes", "oce_sum_bytes", "ref_sum_words_le", "oce_sum_words_le"};
+  unsigned short (*f[])(const unsigned char*, size_t) = {ref_sum_bytes, oce_sum_bytes,
+    ref_sum_words_le, oce_sum_words_le};
+  for (int k = 0; k < 4; k++) {
+    unsigned short s = 0;
+    double t0 = now();
+    for (int r = 0; r < reps; r++)
+      s += f[k](buf + (r % 2), n);
+    double t = now() - t0;
+    printf("%-17s %8.3f GB/s (result %u)\n", name[k], 1e-9 * reps * (double)n / t, s);
+  }
+  free(buf);
+  return bad != 0;
+}
@@ -0,0 +1,173 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/* Check the solvers of ../../src/sw_inverse.c against the bisection
+ * searches that sw.c used before, and check the analytic derivatives
+ * that they use against finite differences, for random oceanographic
+ * values; then time both methods. See README.md. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "../../src/sw_unesco.h"
+#include "../../src/sw_inverse.h"
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static double uniform(double a, double b)
+{
+  return a + (b - a) * (rand() / (RAND_MAX + 1.0));
+}
+
+/* The previous method: bisection until both the interval and f are
+ * within tolerance, with NAN if there is no root, or on failure. */
+typedef double (*fun)(double x, const double *arg);
+
+static double bisect(fun f, const double *arg, double x1, double x2,
+    double xresolution, double ftol, int maxit)
+{
+  double g1 = f(x1, arg), g2 = f(x2, arg), g, x;
+  int iter = 0;
+  if (g1 * g2 > 0.0)
+    return NAN;
+  while (fabs(g = f(x = (x1 + x2) / 2.0, arg)) > ftol || fabs(x1 - x2) > xresolution) {
+    if (++iter > maxit)
+      return NAN;
+    if (g1 * g < 0) {
+      x2 = x;
+      g2 = g;
+    } else if (g2 * g < 0) {
+      x1 = x;
+      g1 = g;
+    } else {
+      return NAN;
+    }
+  }
+  return x;
+}
+
+/* arg holds S, T, p and sigma */
+static double rho(double S, double T, double p)
+{
+  double value;
+  oce_unesco_rho_scalar(1, &S, &T, &p, &value);
+  return value;
+}
+static double CSTp_f(double C, const double *arg)
+{
+  return oce_unesco_salinity(C, arg[1], arg[2], NULL) - arg[0];
+}
+static double strho_f(double S, const double *arg)
+{
+  return rho(S, arg[1], arg[2]) - 1000.0 - arg[3];
+}
+static double tsrho_f(double T, const double *arg)
+{
+  return rho(arg[0], T, arg[2]) - 1000.0 - arg[3];
+}
+
+static void compare(const char *name, int n, const double *old, const double *new,
+    const double *truth, double told, double tnew)
+{
+  double maxdiff = 0.0, maxerr = 0.0;
+  int mismatch = 0;
+  for (int i = 0; i < n; i++) {
+    if (isnan(old[i]) != isnan(new[i])) {
+      mismatch++;
+    } else if (!isnan(new[i])) {
+      maxdiff = fmax(maxdiff, fabs(old[i] - new[i]));
+      if (truth)
+        maxerr = fmax(maxerr, fabs(new[i] - truth[i]));
+    }
+  }
+  printf("%-6s |new-old| <= %.2g, NA mismatches %d", name, maxdiff, mismatch);
+  if (truth)
+    printf(", |new-true| <= %.2g", maxerr);
+  printf("; %.2f Msamples/s (bisection), %.2f Msamples/s (Newton)\n",
+      1e-6 * n / told, 1e-6 * n / tnew);
+}
+
+int main(int argc, char **argv)
+{
+  int n = argc > 1 ? atoi(argv[1]) : 1000000;
+  int nthreads = argc > 2 ? atoi(argv[2]) : 1;
+  double *S = malloc(n * sizeof(double)), *T = malloc(n * sizeof(double));
+  double *p = malloc(n * sizeof(double)), *sigma = malloc(n * sizeof(double));
+  double *old = malloc(n * sizeof(double)), *new = malloc(n * sizeof(double));
+  double *C = malloc(n * sizeof(double));
+  double t0, t1, t2;
+  srand(1);
+  for (int i = 0; i < n; i++) {
+    S[i] = uniform(0.0, 42.0);
+    T[i] = uniform(-2.0, 35.0);
+    p[i] = uniform(0.0, 6000.0);
+    sigma[i] = rho(S[i], T[i], p[i]) - 1000.0;
+  }
+
+  /* derivatives, against centred differences, whose rounding error is
+   * about 1e-8 for rho */
+  double errS = 0.0, errT = 0.0, errC = 0.0, h = 1e-5;
+  for (int i = 0; i < n; i += 100) {
+    double dS, dT, dC, c = uniform(0.1, 1.5);
+    oce_unesco_rho_derivs(S[i], T[i], p[i], &dS, &dT);
+    errS = fmax(errS, fabs(dS - (rho(S[i] + h, T[i], p[i]) - rho(S[i] - h, T[i], p[i])) / (2 * h)));
+    errT = fmax(errT, fabs(dT - (rho(S[i], T[i] + h, p[i]) - rho(S[i], T[i] - h, p[i])) / (2 * h)));
+    oce_unesco_salinity(c, T[i], p[i], &dC);
+    errC = fmax(errC, fabs(dC - (oce_unesco_salinity(c + h, T[i], p[i], NULL) -
+            oce_unesco_salinity(c - h, T[i], p[i], NULL)) / (2 * h)));
+  }
+  printf("error of derivatives: drho/dS %.2g, drho/dT %.2g, dS/dC %.2g\n", errS, errT, errC);
+
+  /* the tolerances and limits of the old sw_CSTp(), sw_strho() and sw_tsrho() */
+  t0 = now();
+  for (int i = 0; i < n; i++) {
+    double arg[4] = {S[i], T[i], p[i], sigma[i]};
+    old[i] = bisect(CSTp_f, arg, 0.0, 5.0, 1e-10, 1e-10, 100);
+  }
+  t1 = now();
+  oce_unesco_CSTp(n, S, T, p, nthreads, new);
+  t2 = now();
+  compare("CSTp", n, old, new, NULL, t1 - t0, t2 - t1);
+  for (int i = 0; i < n; i++)
+    C[i] = new[i];
+
+  t0 = now();
+  for (int i = 0; i < n; i++) {
+    double arg[4] = {S[i], T[i], p[i], sigma[i]};
+    old[i] = bisect(strho_f, arg, 0.0, 500.0, 1e-4, 1e-3, 50);
+  }
+  t1 = now();
+  oce_unesco_strho(n, T, sigma, p, 0, nthreads, new);
+  t2 = now();
+  compare("strho", n, old, new, S, t1 - t0, t2 - t1);
+
+  t0 = now();
+  for (int i = 0; i < n; i++) {
+    double arg[4] = {S[i], T[i], p[i], sigma[i]};
+    old[i] = bisect(tsrho_f, arg, -3.0, 40.0, 1e-4, 1e-4, 1000);
+  }
+  t1 = now();
+  oce_unesco_tsrho(n, S, sigma, p, nthreads, new);
+  t2 = now();
+  compare("tsrho", n, old, new, NULL, t1 - t0, t2 - t1);
+
+  /* a round trip through the conductivity ratio */
+  double maxerr = 0.0;
+  for (int i = 0; i < n; i++)
+    if (!isnan(C[i]))
+      maxerr = fmax(maxerr, fabs(oce_unesco_salinity(C[i], T[i], p[i], NULL) - S[i]));
+  printf("|S(C(S))-S| <= %.2g\n", maxerr);
+  free(S);
+  free(T);
+  free(p);
+  free(sigma);
+  free(old);
+  free(new);
+  free(C);
+  return 0;
+}
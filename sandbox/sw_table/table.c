@@ -0,0 +1,212 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/* Test of a table-driven mode for the equations of state: density and
+ * sound speed by the UNESCO formulae of ../../src/sw_unesco.c, and the
+ * gsw_rho() of ../../src/sw_inverse.c, each tabulated once over the
+ * oceanographic range and evaluated by tri-cubic interpolation, with
+ * the exact formula used outside the table. The largest error of each
+ * table is reported when it is built, and then the throughput of the
+ * table is compared with that of the formulae. See README.md. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "../../src/sw_unesco.h"
+/* for the static gsw_rho() */
+#include "../../src/sw_inverse.c"
+
+typedef double (*eos)(double S, double T, double p);
+
+/* The table holds f at x=sqrt(S), which makes the S^1.5 terms of the
+ * formulae cubic, T and p, on a regular grid spanning the domain. */
+typedef struct {
+  const char *name;
+  eos f;
+  int nx, nt, np;
+  double dx, T0, dT, dp;
+  double Smax, Tmax, pmax;
+  double *v;
+} table;
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static double uniform(double a, double b)
+{
+  return a + (b - a) * (rand() / (RAND_MAX + 1.0));
+}
+
+static double unesco_rho(double S, double T, double p)
+{
+  double value;
+  oce_unesco_rho_scalar(1, &S, &T, &p, &value);
+  return value;
+}
+
+static double unesco_svel(double S, double T, double p)
+{
+  double value;
+  oce_unesco_svel_scalar(1, &S, &T, &p, &value);
+  return value;
+}
+
+static double teos_rho(double SA, double CT, double p)
+{
+  double drho_dsa;
+  return gsw_rho(SA, CT, p, &drho_dsa);
+}
+
+/* Weights of the cubic through the points at -1, 0, 1 and 2, at u */
+static inline void cubic_weights(double u, double *w)
+{
+  w[0] = -u * (u - 1.0) * (u - 2.0) / 6.0;
+  w[1] = (u + 1.0) * (u - 1.0) * (u - 2.0) / 2.0;
+  w[2] = -(u + 1.0) * u * (u - 2.0) / 2.0;
+  w[3] = (u + 1.0) * u * (u - 1.0) / 6.0;
+}
+
+/* The cell holding a grid coordinate, such that the 4-point stencil
+ * lies within the n points of the table; near the edges, the cubic is
+ * one-sided. */
+static inline int cell(double g, int n, double *u)
+{
+  int i = (int) g;
+  if (i < 1)
+    i = 1;
+  else if (i > n - 3)
+    i = n - 3;
+  *u = g - i;
+  return i;
+}
+
+static double table_eval(const table *t, double S, double T, double p)
+{
+  /* this is false for NaN, too */
+  if (!(S >= 0.0 && S <= t->Smax && T >= t->T0 && T <= t->Tmax && p >= 0.0 && p <= t->pmax))
+    return t->f(S, T, p);
+  double u, v, w, wx[4], wt[4], wp[4];
+  int ix = cell(sqrt(S) / t->dx, t->nx, &u);
+  int it = cell((T - t->T0) / t->dT, t->nt, &v);
+  int ip = cell(p / t->dp, t->np, &w);
+  cubic_weights(u, wx);
+  cubic_weights(v, wt);
+  cubic_weights(w, wp);
+  double res = 0.0;
+  for (int k = 0; k < 4; k++) {
+    double rk = 0.0;
+    for (int j = 0; j < 4; j++) {
+      const double *q = t->v + ((ip - 1 + k) * t->nt + (it - 1 + j)) * t->nx + (ix - 1);
+      rk += wt[j] * (wx[0] * q[0] + wx[1] * q[1] + wx[2] * q[2] + wx[3] * q[3]);
+    }
+    res += wp[k] * rk;
+  }
+  return res;
+}
+
+/* Tabulate f for S in [0,Smax], T in [T0,Tmax] and p in [0,pmax], and
+ * report the largest error at the centres of the cells, where the
+ * interpolation error of a smooth function is largest. */
+static void table_build(table *t, const char *name, eos f, int nx, int nt, int np,
+    double Smax, double T0, double Tmax, double pmax)
+{
+  t->name = name;
+  t->f = f;
+  t->nx = nx;
+  t->nt = nt;
+  t->np = np;
+  t->dx = sqrt(Smax) / (nx - 1);
+  t->T0 = T0;
+  t->dT = (Tmax - T0) / (nt - 1);
+  t->dp = pmax / (np - 1);
+  t->Smax = Smax;
+  t->Tmax = Tmax;
+  t->pmax = pmax;
+  t->v = malloc(nx * nt * np * sizeof(double));
+  double t0 = now();
+  for (int k = 0; k < np; k++) {
+    for (int j = 0; j < nt; j++) {
+      for (int i = 0; i < nx; i++) {
+        double x = i * t->dx;
+        t->v[(k * nt + j) * nx + i] = f(x * x, T0 + j * t->dT, k * t->dp);
+      }
+    }
+  }
+  double t1 = now(), maxerr = 0.0;
+  for (int k = 0; k < np - 1; k++) {
+    for (int j = 0; j < nt - 1; j++) {
+      for (int i = 0; i < nx - 1; i++) {
+        double x = (i + 0.5) * t->dx, S = x * x;
+        double T = T0 + (j + 0.5) * t->dT, p = (k + 0.5) * t->dp;
+        maxerr = fmax(maxerr, fabs(table_eval(t, S, T, p) - f(S, T, p)));
+      }
+    }
+  }
+  printf("%-10s %d x %d x %d table (%.0f kB), built in %.1f ms; max error %.2g\n",
+      name, nx, nt, np, nx * nt * np * sizeof(double) / 1024.0, 1e3 * (t1 - t0), maxerr);
+}
+
+int main(int argc, char **argv)
+{
+  int n = argc > 1 ? atoi(argv[1]) : 1000000;
+  int reps = argc > 2 ? atoi(argv[2]) : 5;
+  double *S = malloc(n * sizeof(double)), *T = malloc(n * sizeof(double));
+  double *p = malloc(n * sizeof(double)), *value = malloc(n * sizeof(double));
+  table tables[3];
+  /* grids chosen for an error below 1e-4 kg/m^3 (1e-3 m/s for sound speed) */
+  table_build(&tables[0], "rho", unesco_rho, 31, 43, 41, 42.0, -2.0, 40.0, 10000.0);
+  table_build(&tables[1], "svel", unesco_svel, 31, 43, 41, 42.0, -2.0, 40.0, 10000.0);
+  table_build(&tables[2], "gsw_rho", teos_rho, 31, 43, 41, 42.0, -2.0, 40.0, 10000.0);
+  srand(1);
+  for (int i = 0; i < n; i++) {
+    S[i] = uniform(0.0, 42.0);
+    T[i] = uniform(-2.0, 40.0);
+    p[i] = uniform(0.0, 10000.0);
+  }
+  printf("%-10s %12s %12s %12s %10s\n", "function", "table Ms/s", "scalar Ms/s", "vector Ms/s", "max error");
+  for (int k = 0; k < 3; k++) {
+    table *t = tables + k;
+    double maxerr = 0.0;
+    for (int i = 0; i < n; i++)
+      maxerr = fmax(maxerr, fabs(table_eval(t, S[i], T[i], p[i]) - t->f(S[i], T[i], p[i])));
+    double t0 = now();
+    for (int r = 0; r < reps; r++)
+      for (int i = 0; i < n; i++)
+        value[i] = table_eval(t, S[i], T[i], p[i]);
+    double t1 = now();
+    for (int r = 0; r < reps; r++) {
+      if (k == 0)
+        oce_unesco_rho_scalar(n, S, T, p, value);
+      else if (k == 1)
+        oce_unesco_svel_scalar(n, S, T, p, value);
+      else
+        for (int i = 0; i < n; i++)
+          value[i] = teos_rho(S[i], T[i], p[i]);
+    }
+    double t2 = now();
+    if (k == 0)
+      for (int r = 0; r < reps; r++)
+        oce_unesco_rho(n, S, T, p, value);
+    else if (k == 1)
+      for (int r = 0; r < reps; r++)
+        oce_unesco_svel(n, S, T, p, value);
+    double t3 = now();
+    printf("%-10s %12.1f %12.1f ", t->name, 1e-6 * reps * n / (t1 - t0), 1e-6 * reps * n / (t2 - t1));
+    if (k < 2)
+      printf("%12.1f", 1e-6 * reps * n / (t3 - t2));
+    else
+      printf("%12s", "-");
+    printf(" %10.2g\n", maxerr);
+  }
+  for (int k = 0; k < 3; k++)
+    free(tables[k].v);
+  free(S);
+  free(T);
+  free(p);
+  free(value);
+  return 0;
+}
@@ -0,0 +1,176 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/* Check the vectorized UNESCO kernels of ../../src/sw_unesco.c against
+ * the scalar versions, for random oceanographic values with some NAs
+ * and for all lengths up to 20 (to exercise the remainder loops), and
+ * then time both versions on large arrays. Then do the same for the
+ * fused kernel, oce_unesco_properties(), and time it against the
+ * separate kernels, called as the R functions call them. See
+ * README.md. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "../../src/sw_unesco.h"
+
+typedef void (*kernel)(int, const double*, const double*, const double*, double*);
+
+/* theta takes a reference pressure; it is zero here, as for swTheta() */
+static const double *pref0;
+static void theta_vector(int n, const double *S, const double *T, const double *p, double *v)
+{
+  oce_unesco_theta(n, S, T, p, pref0, v);
+}
+static void theta_scalar(int n, const double *S, const double *T, const double *p, double *v)
+{
+  oce_unesco_theta_scalar(n, S, T, p, pref0, v);
+}
+
+static const char *name[] = {"rho", "svel", "lapserate", "beta", "alpha_over_beta", "spice", "theta"};
+static kernel vector[] = {oce_unesco_rho, oce_unesco_svel, oce_unesco_lapserate, oce_unesco_beta,
+  oce_unesco_alpha_over_beta, oce_unesco_spice, theta_vector};
+static kernel scalar[] = {oce_unesco_rho_scalar, oce_unesco_svel_scalar, oce_unesco_lapserate_scalar,
+  oce_unesco_beta_scalar, oce_unesco_alpha_over_beta_scalar, oce_unesco_spice_scalar, theta_scalar};
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static double uniform(double a, double b)
+{
+  return a + (b - a) * (rand() / (RAND_MAX + 1.0));
+}
+
+static int is_na(double x)
+{
+  unsigned long long bits;
+  memcpy(&bits, &x, sizeof bits);
+  return isnan(x) && (bits & 0xFFFFFFFFULL) == 1954;
+}
+
+/* Distance in units in the last place, for finite values of one sign */
+static long long ulps(double a, double b)
+{
+  long long ia, ib;
+  memcpy(&ia, &a, sizeof ia);
+  memcpy(&ib, &b, sizeof ib);
+  return ia > ib ? ia - ib : ib - ia;
+}
+
+int main(int argc, char **argv)
+{
+  int n = argc > 1 ? atoi(argv[1]) : 10000000;
+  int reps = argc > 2 ? atoi(argv[2]) : 5;
+  double *S = malloc(n * sizeof(double)), *T = malloc(n * sizeof(double));
+  double *p = malloc(n * sizeof(double)), *pref = calloc(n, sizeof(double));
+  double *v1 = malloc(n * sizeof(double)), *v2 = malloc(n * sizeof(double));
+  if (!S || !T || !p || !pref || !v1 || !v2)
+    return 1;
+  pref0 = pref;
+  unsigned long long na_bits = 0x7FF00000000007A2ULL;
+  double na;
+  memcpy(&na, &na_bits, sizeof na);
+  srand(1);
+  for (int i = 0; i < n; i++) {
+    S[i] = uniform(0.0, 42.0);
+    T[i] = uniform(-2.0, 40.0);
+    p[i] = uniform(0.0, 10000.0);
+    if (rand() % 100 == 0) {
+      double *x = (rand() % 3 == 0) ? S : (rand() % 2 ? T : p);
+      x[i] = na;
+    }
+  }
+  int bad = 0;
+  for (int k = 0; k < 7; k++) {
+    long long maxulp = 0;
+    int nabad = 0;
+    for (int len = 0; len <= 20; len++) {
+      vector[k](len, S + 1, T + 1, p + 1, v1);
+      scalar[k](len, S + 1, T + 1, p + 1, v2);
+      for (int i = 0; i < len; i++) {
+        if (is_na(v1[i]) != is_na(v2[i]))
+          nabad++;
+        else if (!is_na(v1[i]) && ulps(v1[i], v2[i]) > maxulp)
+          maxulp = ulps(v1[i], v2[i]);
+      }
+    }
+    vector[k](n, S, T, p, v1);
+    scalar[k](n, S, T, p, v2);
+    for (int i = 0; i < n; i++) {
+      if (is_na(v1[i]) != is_na(v2[i]))
+        nabad++;
+      else if (!is_na(v1[i]) && ulps(v1[i], v2[i]) > maxulp)
+        maxulp = ulps(v1[i], v2[i]);
+    }
+    printf("%-16s max difference %lld ulp, %d NA mismatches\n", name[k], maxulp, nabad);
+    if (nabad || maxulp > 4)
+      bad++;
+  }
+  printf("%-16s %12s %12s %8s\n", "kernel", "scalar Ms/s", "vector Ms/s", "speedup");
+  for (int k = 0; k < 7; k++) {
+    double t[2];
+    for (int j = 0; j < 2; j++) {
+      kernel f = j ? vector[k] : scalar[k];
+      double t0 = now();
+      for (int r = 0; r < reps; r++)
+        f(n, S, T, p, j ? v1 : v2);
+      t[j] = now() - t0;
+    }
+    printf("%-16s %12.1f %12.1f %8.2f\n", name[k], 1e-6 * reps * n / t[0], 1e-6 * reps * n / t[1], t[0] / t[1]);
+  }
+
+  /* all seven properties at once, against the separate kernels, called
+   * as swRho(), swSigmaTheta(), swAlpha(), swBeta(), swSoundSpeed(),
+   * swTheta() and swSpice() call them (each of the four that need
+   * theta computing it anew) */
+  int all = OCE_UNESCO_RHO | OCE_UNESCO_SIGMA_THETA | OCE_UNESCO_ALPHA | OCE_UNESCO_BETA |
+    OCE_UNESCO_SVEL | OCE_UNESCO_THETA | OCE_UNESCO_SPICE;
+  double *w1 = malloc(7 * n * sizeof(double)), *w2 = malloc(7 * n * sizeof(double));
+  double *theta = malloc(n * sizeof(double)), *tmp = malloc(n * sizeof(double));
+  if (!w1 || !w2 || !theta || !tmp)
+    return 1;
+  long long maxulp = 0;
+  int nabad = 0;
+  oce_unesco_properties(n, S, T, p, all, n, w1);
+  oce_unesco_properties_scalar(n, S, T, p, all, n, w2);
+  for (int i = 0; i < 7 * n; i++) {
+    if (is_na(w1[i]) != is_na(w2[i]))
+      nabad++;
+    else if (!is_na(w1[i]) && ulps(w1[i], w2[i]) > maxulp)
+      maxulp = ulps(w1[i], w2[i]);
+  }
+  printf("%-16s max difference %lld ulp, %d NA mismatches\n", "properties", maxulp, nabad);
+  if (nabad || maxulp > 4)
+    bad++;
+  double t0 = now();
+  for (int r = 0; r < reps; r++) {
+    oce_unesco_rho(n, S, T, p, w2);
+    for (int k = 0; k < 4; k++) {
+      oce_unesco_theta(n, S, T, p, pref, theta);
+      for (int i = 0; i < n; i++)
+        theta[i] /= 1.00024;
+    }
+    for (int i = 0; i < n; i++)
+      tmp[i] = theta[i] * 1.00024;
+    oce_unesco_rho(n, S, tmp, pref, w2 + n);
+    oce_unesco_alpha_over_beta(n, S, theta, p, w2 + 2 * n);
+    oce_unesco_beta(n, S, theta, p, tmp);
+    oce_unesco_beta(n, S, theta, p, w2 + 3 * n);
+    oce_unesco_svel(n, S, T, p, w2 + 4 * n);
+    oce_unesco_spice(n, S, T, p, w2 + 6 * n);
+  }
+  double t1 = now();
+  for (int r = 0; r < reps; r++)
+    oce_unesco_properties(n, S, T, p, all, n, w1);
+  double t2 = now();
+  printf("all 7 properties: %.1f Ms/s separately, %.1f Ms/s fused, speedup %.2f\n",
+      1e-6 * reps * n / (t1 - t0), 1e-6 * reps * n / (t2 - t1), (t1 - t0) / (t2 - t1));
+  free(S); free(T); free(p); free(pref); free(v1); free(v2);
+  free(w1); free(w2); free(theta); free(tmp);
+  return bad != 0;
+}
@@ -17,6 +17,24 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// do_adv_vector
+List do_adv_vector(RawVector buf, NumericVector from, NumericVector to, LogicalVector timeWindow, NumericVector by, LogicalVector byTime, NumericVector samplingRate, LogicalVector analog);
+RcppExport SEXP _oce_do_adv_vector(SEXP bufSEXP, SEXP fromSEXP, SEXP toSEXP, SEXP timeWindowSEXP, SEXP bySEXP, SEXP byTimeSEXP, SEXP samplingRateSEXP, SEXP analogSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RawVector >::type buf(bufSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type from(fromSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type to(toSEXP);
+    Rcpp::traits::input_parameter< LogicalVector >::type timeWindow(timeWindowSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type by(bySEXP);
+    Rcpp::traits::input_parameter< LogicalVector >::type byTime(byTimeSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type samplingRate(samplingRateSEXP);
+    Rcpp::traits::input_parameter< LogicalVector >::type analog(analogSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_adv_vector(buf, from, to, timeWindow, by, byTime, samplingRate, analog));
+    return rcpp_result_gen;
+END_RCPP
+}
 // do_adv_vector_time
 NumericVector do_adv_vector_time(NumericVector vvdStart, NumericVector vsdStart, NumericVector vsdTime, NumericVector vvdhStart, NumericVector vvdhTime, NumericVector n, NumericVector f);
 RcppExport SEXP _oce_do_adv_vector_time(SEXP vvdStartSEXP, SEXP vsdStartSEXP, SEXP vsdTimeSEXP, SEXP vvdhStartSEXP, SEXP vvdhTimeSEXP, SEXP nSEXP, SEXP fSEXP) {
@@ -58,6 +76,52 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// do_amsr_composite_open
+SEXP do_amsr_composite_open(IntegerVector n);
+RcppExport SEXP _oce_do_amsr_composite_open(SEXP nSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< IntegerVector >::type n(nSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_amsr_composite_open(n));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_amsr_composite_add
+IntegerVector do_amsr_composite_add(SEXP handle, RawVector a);
+RcppExport SEXP _oce_do_amsr_composite_add(SEXP handleSEXP, SEXP aSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< RawVector >::type a(aSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_amsr_composite_add(handle, a));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_amsr_composite_finish
+RawVector do_amsr_composite_finish(SEXP handle);
+RcppExport SEXP _oce_do_amsr_composite_finish(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_amsr_composite_finish(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_biosonics_file
+List do_biosonics_file(RawVector buf, IntegerVector channel);
+RcppExport SEXP _oce_do_biosonics_file(SEXP bufSEXP, SEXP channelSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RawVector >::type buf(bufSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type channel(channelSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_biosonics_file(buf, channel));
+    return rcpp_result_gen;
+END_RCPP
+}
 // do_approx3d
 NumericVector do_approx3d(NumericVector x, NumericVector y, NumericVector z, NumericVector f, NumericVector xout, NumericVector yout, NumericVector zout);
 RcppExport SEXP _oce_do_approx3d(SEXP xSEXP, SEXP ySEXP, SEXP zSEXP, SEXP fSEXP, SEXP xoutSEXP, SEXP youtSEXP, SEXP zoutSEXP) {
@@ -90,6 +154,67 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// do_read_cnv
+List do_read_cnv(CharacterVector filename, NumericVector missingValue, LogicalVector useBadFlag);
+RcppExport SEXP _oce_do_read_cnv(SEXP filenameSEXP, SEXP missingValueSEXP, SEXP useBadFlagSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type missingValue(missingValueSEXP);
+    Rcpp::traits::input_parameter< LogicalVector >::type useBadFlag(useBadFlagSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_read_cnv(filename, missingValue, useBadFlag));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_read_odf
+List do_read_odf(CharacterVector filename);
+RcppExport SEXP _oce_do_read_odf(SEXP filenameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type filename(filenameSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_read_odf(filename));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_odf_header_list
+List do_odf_header_list(CharacterVector header);
+RcppExport SEXP _oce_do_odf_header_list(SEXP headerSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type header(headerSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_odf_header_list(header));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_read_woce_exchange
+List do_read_woce_exchange(CharacterVector filename, CharacterVector character, CharacterVector groupBy);
+RcppExport SEXP _oce_do_read_woce_exchange(SEXP filenameSEXP, SEXP characterSEXP, SEXP groupBySEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type character(characterSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type groupBy(groupBySEXP);
+    rcpp_result_gen = Rcpp::wrap(do_read_woce_exchange(filename, character, groupBy));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_read_ctd_files
+List do_read_ctd_files(CharacterVector filename, CharacterVector format, IntegerVector nthreads);
+RcppExport SEXP _oce_do_read_ctd_files(SEXP filenameSEXP, SEXP formatSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< CharacterVector >::type format(formatSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_read_ctd_files(filename, format, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
 // do_curl1
 List do_curl1(NumericMatrix u, NumericMatrix v, NumericVector x, NumericVector y, NumericVector geographical);
 RcppExport SEXP _oce_do_curl1(SEXP uSEXP, SEXP vSEXP, SEXP xSEXP, SEXP ySEXP, SEXP geographicalSEXP) {
@@ -276,9 +401,25 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// do_landsat_band
+List do_landsat_band(NumericMatrix m, IntegerVector bits, IntegerVector decimate, IntegerVector ilim, IntegerVector jlim, IntegerVector nthreads);
+RcppExport SEXP _oce_do_landsat_band(SEXP mSEXP, SEXP bitsSEXP, SEXP decimateSEXP, SEXP ilimSEXP, SEXP jlimSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericMatrix >::type m(mSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type bits(bitsSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type decimate(decimateSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type ilim(ilimSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type jlim(jlimSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_landsat_band(m, bits, decimate, ilim, jlim, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
 // do_ldc_ad2cp_in_file
-List do_ldc_ad2cp_in_file(CharacterVector filename, IntegerVector from, IntegerVector to, IntegerVector by);
-RcppExport SEXP _oce_do_ldc_ad2cp_in_file(SEXP filenameSEXP, SEXP fromSEXP, SEXP toSEXP, SEXP bySEXP) {
+List do_ldc_ad2cp_in_file(CharacterVector filename, IntegerVector from, IntegerVector to, IntegerVector by, IntegerVector nthreads, NumericVector parallelMinBytes);
+RcppExport SEXP _oce_do_ldc_ad2cp_in_file(SEXP filenameSEXP, SEXP fromSEXP, SEXP toSEXP, SEXP bySEXP, SEXP nthreadsSEXP, SEXP parallelMinBytesSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -286,7 +427,57 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< IntegerVector >::type from(fromSEXP);
     Rcpp::traits::input_parameter< IntegerVector >::type to(toSEXP);
     Rcpp::traits::input_parameter< IntegerVector >::type by(bySEXP);
-    rcpp_result_gen = Rcpp::wrap(do_ldc_ad2cp_in_file(filename, from, to, by));
+    Rcpp::traits::input_parameter< IntegerVector >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type parallelMinBytes(parallelMinBytesSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_ldc_ad2cp_in_file(filename, from, to, by, nthreads, parallelMinBytes));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_ldc_ad2cp_follow_open
+SEXP do_ldc_ad2cp_follow_open(CharacterVector filename);
+RcppExport SEXP _oce_do_ldc_ad2cp_follow_open(SEXP filenameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< CharacterVector >::type filename(filenameSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_ldc_ad2cp_follow_open(filename));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_ldc_ad2cp_follow
+List do_ldc_ad2cp_follow(SEXP handle);
+RcppExport SEXP _oce_do_ldc_ad2cp_follow(SEXP handleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_ldc_ad2cp_follow(handle));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_ad2cp_records
+List do_ad2cp_records(RawVector buf, NumericVector index, NumericVector length, IntegerVector id, IntegerVector type);
+RcppExport SEXP _oce_do_ad2cp_records(SEXP bufSEXP, SEXP indexSEXP, SEXP lengthSEXP, SEXP idSEXP, SEXP typeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RawVector >::type buf(bufSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type index(indexSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type length(lengthSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type id(idSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type type(typeSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_ad2cp_records(buf, index, length, id, type));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_input_file_size
+double do_input_file_size(StringVector filename);
+RcppExport SEXP _oce_do_input_file_size(SEXP filenameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< StringVector >::type filename(filenameSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_input_file_size(filename));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -306,6 +497,61 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// do_ldc_rdi_index
+List do_ldc_rdi_index(StringVector filename, IntegerVector debug);
+RcppExport SEXP _oce_do_ldc_rdi_index(SEXP filenameSEXP, SEXP debugSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< StringVector >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type debug(debugSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_ldc_rdi_index(filename, debug));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_ldc_rdi_from_index
+List do_ldc_rdi_from_index(StringVector filename, NumericVector start, IntegerVector length, IntegerVector time, IntegerVector sec100, IntegerVector from, IntegerVector to, IntegerVector by, IntegerVector mode, IntegerVector debug);
+RcppExport SEXP _oce_do_ldc_rdi_from_index(SEXP filenameSEXP, SEXP startSEXP, SEXP lengthSEXP, SEXP timeSEXP, SEXP sec100SEXP, SEXP fromSEXP, SEXP toSEXP, SEXP bySEXP, SEXP modeSEXP, SEXP debugSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< StringVector >::type filename(filenameSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type start(startSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type length(lengthSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type time(timeSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type sec100(sec100SEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type from(fromSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type to(toSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type by(bySEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type mode(modeSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type debug(debugSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_ldc_rdi_from_index(filename, start, length, time, sec100, from, to, by, mode, debug));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_ldc_rdi_follow_open
+SEXP do_ldc_rdi_follow_open(StringVector filename);
+RcppExport SEXP _oce_do_ldc_rdi_follow_open(SEXP filenameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< StringVector >::type filename(filenameSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_ldc_rdi_follow_open(filename));
+    return rcpp_result_gen;
+END_RCPP
+}
+// do_ldc_rdi_follow
+List do_ldc_rdi_follow(SEXP handle, IntegerVector debug);
+RcppExport SEXP _oce_do_ldc_rdi_follow(SEXP handleSEXP, SEXP debugSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type handle(handleSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type debug(debugSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_ldc_rdi_follow(handle, debug));
+    return rcpp_result_gen;
+END_RCPP
+}
 // do_matrix_smooth
 NumericMatrix do_matrix_smooth(NumericMatrix mat);
 RcppExport SEXP _oce_do_matrix_smooth(SEXP matSEXP) {
@@ -357,6 +603,22 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// do_rdi_profiles
+List do_rdi_profiles(RawVector buf, IntegerVector ensembleStart, IntegerVector numberOfCells, IntegerVector numberOfBeams, IntegerVector want, NumericVector velocityScale);
+RcppExport SEXP _oce_do_rdi_profiles(SEXP bufSEXP, SEXP ensembleStartSEXP, SEXP numberOfCellsSEXP, SEXP numberOfBeamsSEXP, SEXP wantSEXP, SEXP velocityScaleSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< RawVector >::type buf(bufSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type ensembleStart(ensembleStartSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type numberOfCells(numberOfCellsSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type numberOfBeams(numberOfBeamsSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type want(wantSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type velocityScale(velocityScaleSEXP);
+    rcpp_result_gen = Rcpp::wrap(do_rdi_profiles(buf, ensembleStart, numberOfCells, numberOfBeams, want, velocityScale));
+    return rcpp_result_gen;
+END_RCPP
+}
 // do_runlm
 List do_runlm(NumericVector x, NumericVector y, NumericVector xout, NumericVector window, NumericVector L);
 RcppExport SEXP _oce_do_runlm(SEXP xSEXP, SEXP ySEXP, SEXP xoutSEXP, SEXP windowSEXP, SEXP LSEXP) {
@@ -0,0 +1,443 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+#include <Rcpp.h>
+#include <time.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+using namespace Rcpp;
+
+// Cross-reference work:
+// 1. update ../src/registerDynamicSymbol.c with an item for this
+// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
+
+//#define DEBUG
+
+// in ldc_rdi_in_file.cpp
+double oce_timegm(struct tm *t);
+
+// Record layouts, as distinguished by do_ad2cp_records(). The
+// burst, average and interleaved-burst records share the 'version 3'
+// layout [1 sec 6.1.2], while bottom-track records have one value per
+// beam, instead of a profile [1 sec 6.1.3].
+#define AD2CP_LAYOUT_PROFILE 1
+#define AD2CP_LAYOUT_BOTTOM_TRACK 2
+
+static inline unsigned int u16(const unsigned char *p)
+{
+  return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static inline int s16(const unsigned char *p)
+{
+  return (short int)(unsigned short int)u16(p);
+}
+
+static inline unsigned int u32(const unsigned char *p)
+{
+  return u16(p) | (u16(p + 2) << 16);
+}
+
+static inline double f32(const unsigned char *p)
+{
+  unsigned int u = u32(p);
+  float f;
+  memcpy(&f, &u, 4);
+  return (double)f;
+}
+
+static int ad2cp_layout(int type)
+{
+  switch (type) {
+    case 0x15: // burst
+    case 0x16: // average
+    case 0x18: // interleavedBurst
+      return AD2CP_LAYOUT_PROFILE;
+    case 0x17: // bottomTrack
+      return AD2CP_LAYOUT_BOTTOM_TRACK;
+    default:
+      return 0;
+  }
+}
+
+// Set the dimension attribute of an array, and store it in a list.
+template <typename T>
+static void ad2cp_store(List &res, const char *name, T x, int n, int ncell, int nbeam)
+{
+  if (ncell > 0)
+    x.attr("dim") = Dimension(n, ncell, nbeam);
+  else
+    x.attr("dim") = Dimension(n, nbeam);
+  res[name] = x;
+}
+
+// Decode the records of one type. The records are given by 0-based
+// 'which' entries in the index, so this is a single pass through the
+// part of 'buf' that holds these records.
+static List ad2cp_decode_type(const unsigned char *pbuf,
+    NumericVector index, NumericVector length, const std::vector<long int> &which, int layout)
+{
+  int n = which.size();
+  IntegerVector version(n), configuration(n), ensemble(n), status(n);
+  IntegerVector numberOfCells(n), numberOfBeams(n), coordinateSystem(n);
+  IntegerVector nominalCorrelation(n), transmitEnergy(n), powerLevel(n);
+  NumericVector time(n), soundSpeed(n), temperature(n), pressure(n);
+  NumericVector heading(n), pitch(n), roll(n), cellSize(n), blankingDistance(n);
+  NumericVector accelerometerx(n), accelerometery(n), accelerometerz(n);
+  NumericVector velocityFactor(n), temperatureMagnetometer(n), temperatureRTC(n);
+  // First pass, over the fixed headers only, to learn the array sizes
+  // and which optional data blocks are present [1 table 6.1.2].
+  int maxcell = 0, maxbeam = 0;
+  unsigned int anyConfiguration = 0;
+  for (int k = 0; k < n; k++) {
+    long int i = which[k];
+    const unsigned char *d = pbuf + (size_t)index[i];
+    version[k] = d[0];
+    configuration[k] = u16(d + 2);
+    anyConfiguration |= configuration[k];
+    struct tm etime;
+    memset(&etime, 0, sizeof(etime));
+    etime.tm_year = d[8];
+    etime.tm_mon = d[9];
+    etime.tm_mday = d[10];
+    etime.tm_hour = d[11];
+    etime.tm_min = d[12];
+    etime.tm_sec = d[13];
+    if (etime.tm_mon > 11 || etime.tm_mday < 1 || etime.tm_mday > 31
+        || etime.tm_hour > 23 || etime.tm_min > 59 || etime.tm_sec > 61)
+      time[k] = NA_REAL; // as ISOdatetime() would give
+    else
+      time[k] = oce_timegm(&etime) + 1e-4 * u16(d + 14);
+    soundSpeed[k] = 0.1 * u16(d + 16);
+    temperature[k] = 0.01 * u16(d + 18);
+    pressure[k] = 0.001 * u16(d + 20);
+    heading[k] = 0.01 * s16(d + 24);
+    pitch[k] = 0.01 * s16(d + 26);
+    roll[k] = 0.01 * s16(d + 28);
+    // BCC: bits 9-0 ncell; bits 11-10 coordinate system; bits 15-12 nbeams
+    unsigned int bcc = u16(d + 30);
+    numberOfCells[k] = bcc & 0x03ff;
+    coordinateSystem[k] = (bcc >> 10) & 0x03;
+    numberOfBeams[k] = (bcc >> 12) & 0x0f;
+    if (layout == AD2CP_LAYOUT_PROFILE && numberOfCells[k] > maxcell)
+      maxcell = numberOfCells[k];
+    if (numberOfBeams[k] > maxbeam)
+      maxbeam = numberOfBeams[k];
+    cellSize[k] = 0.001 * u16(d + 32);
+    nominalCorrelation[k] = d[36];
+    accelerometerx[k] = s16(d + 46) / 16384.0;
+    accelerometery[k] = s16(d + 48) / 16384.0;
+    accelerometerz[k] = s16(d + 50) / 16384.0;
+    transmitEnergy[k] = u16(d + 56);
+    velocityFactor[k] = pow(10.0, (double)(signed char)d[58]);
+    powerLevel[k] = (signed char)d[59];
+    temperatureMagnetometer[k] = 0.001 * s16(d + 60);
+    temperatureRTC[k] = 0.01 * s16(d + 62);
+    status[k] = (int)u32(d + 68);
+    // Status bit 1 gives the blanking-distance unit: 1 for cm, 0 for mm [2 p51]
+    blankingDistance[k] = ((status[k] & 0x02) ? 0.01 : 0.001) * u16(d + 34);
+    ensemble[k] = (int)u32(d + 72);
+  }
+  List res = List::create(
+      Named("version")=version,
+      Named("configuration")=configuration,
+      Named("ensemble")=ensemble,
+      Named("time")=time,
+      Named("status")=status,
+      Named("numberOfCells")=numberOfCells,
+      Named("numberOfBeams")=numberOfBeams,
+      Named("coordinateSystem")=coordinateSystem,
+      Named("cellSize")=cellSize,
+      Named("blankingDistance")=blankingDistance,
+      Named("soundSpeed")=soundSpeed,
+      Named("temperature")=temperature,
+      Named("pressure")=pressure,
+      Named("heading")=heading,
+      Named("pitch")=pitch,
+      Named("roll")=roll);
+  res["accelerometerx"] = accelerometerx;
+  res["accelerometery"] = accelerometery;
+  res["accelerometerz"] = accelerometerz;
+  res["nominalCorrelation"] = nominalCorrelation;
+  res["transmitEnergy"] = transmitEnergy;
+  res["velocityFactor"] = velocityFactor;
+  res["powerLevel"] = powerLevel;
+  res["temperatureMagnetometer"] = temperatureMagnetometer;
+  res["temperatureRTC"] = temperatureRTC;
+  if (maxbeam < 1)
+    return(res);
+
+  // Second pass, for the data blocks. Configuration bits [1 table
+  // 6.1.2] are: 5 velocity, 6 amplitude, 7 correlation, 8 altimeter
+  // (distance, for bottom track), 9 altimeter raw (figure of merit,
+  // for bottom track), 10 AST, 11 echosounder and 12 AHRS. A block
+  // that is present in any record is allocated for all records, with
+  // NA (or 0x00, for raw data) in records that lack it, or that have
+  // fewer cells or beams than the largest in the set.
+  if (layout == AD2CP_LAYOUT_PROFILE) {
+    long int items = (long int)n * maxcell * maxbeam;
+    int wantv = (anyConfiguration >> 5) & 1, wanta = (anyConfiguration >> 6) & 1,
+        wantq = (anyConfiguration >> 7) & 1, wantalt = (anyConfiguration >> 8) & 1,
+        wantraw = (anyConfiguration >> 9) & 1, wantast = (anyConfiguration >> 10) & 1,
+        wantecho = (anyConfiguration >> 11) & 1, wantahrs = (anyConfiguration >> 12) & 1;
+    NumericVector v(wantv ? items : 0, NA_REAL);
+    RawVector a(wanta ? items : 0), q(wantq ? items : 0);
+    NumericVector altimeterDistance(wantalt ? n : 0, NA_REAL);
+    NumericVector ASTDistance(wantast ? n : 0, NA_REAL), ASTPressure(wantast ? n : 0, NA_REAL);
+    IntegerVector altimeterRawNumberOfSamples(wantraw ? n : 0, NA_INTEGER);
+    IntegerVector altimeterRawSampleDistance(wantraw ? n : 0, NA_INTEGER);
+    IntegerVector altimeterRawSamples(wantraw ? n : 0, NA_INTEGER);
+    NumericVector echosounder(wantecho ? (long int)n * maxcell : 0, NA_REAL);
+    NumericVector AHRS(wantahrs ? 9 * n : 0, NA_REAL);
+    // Data are in beam-major order, i.e. all cells for the first beam,
+    // then all cells for the second beam, etc. Item (cell, beam) of
+    // record k goes in R array element [k, cell, beam].
+    long int stride_cell = n;
+    long int stride_beam = (long int)n * maxcell;
+    for (int k = 0; k < n; k++) {
+      long int i = which[k];
+      const unsigned char *d = pbuf + (size_t)index[i];
+      const unsigned char *dend = d + (size_t)length[i];
+      const unsigned char *src = d + d[1]; // offsetOfData
+      unsigned int conf = configuration[k];
+      int ncell = numberOfCells[k], nbeam = numberOfBeams[k];
+      long int nitem = (long int)ncell * nbeam;
+      double factor = velocityFactor[k];
+      if ((conf >> 5) & 1) {
+        if (src + 2 * nitem > dend)
+          continue;
+        for (int beam = 0; beam < nbeam; beam++) {
+          double *dest = &v[k + stride_beam * beam];
+          for (int cell = 0; cell < ncell; cell++) {
+            dest[stride_cell * cell] = factor * s16(src);
+            src += 2;
+          }
+        }
+      }
+      for (int block = 6; block <= 7; block++) {
+        if (!((conf >> block) & 1))
+          continue;
+        if (src + nitem > dend)
+          break;
+        unsigned char *dest0 = block == 6 ? &a[k] : &q[k];
+        for (int beam = 0; beam < nbeam; beam++) {
+          unsigned char *dest = dest0 + stride_beam * beam;
+          for (int cell = 0; cell < ncell; cell++)
+            dest[stride_cell * cell] = *src++;
+        }
+      }
+      if ((conf >> 8) & 1) {
+        // distance (4 bytes), quality (2 bytes), status (2 bytes)
+        if (src + 8 > dend)
+          continue;
+        altimeterDistance[k] = f32(src);
+        src += 8;
+      }
+      if ((conf >> 10) & 1) {
+        // distance (4), quality (2), offset (2), pressure (4), spare (8)
+        if (src + 20 > dend)
+          continue;
+        ASTDistance[k] = f32(src);
+        ASTPressure[k] = f32(src + 8);
+        src += 20;
+      }
+      if ((conf >> 9) & 1) {
+        // number of samples (int32), sample distance (uint16) and
+        // samples (int16, 'signed frac' in [1]), as decoded by the
+        // former R code
+        if (src + 8 > dend)
+          continue;
+        altimeterRawNumberOfSamples[k] = (int)u32(src);
+        altimeterRawSampleDistance[k] = u16(src + 4);
+        altimeterRawSamples[k] = s16(src + 6);
+        src += 8;
+      }
+      if ((conf >> 11) & 1) {
+        if (src + 2 * ncell > dend)
+          continue;
+        for (int cell = 0; cell < ncell; cell++) {
+          echosounder[k + stride_cell * cell] = s16(src);
+          src += 2;
+        }
+      }
+      if ((conf >> 12) & 1) {
+        if (src + 36 > dend)
+          continue;
+        for (int j = 0; j < 9; j++)
+          AHRS[k + n * j] = f32(src + 4 * j);
+      }
+      if (k % 1000 == 0)
+        Rcpp::checkUserInterrupt();
+    }
+    if (wantv)
+      ad2cp_store(res, "v", v, n, maxcell, maxbeam);
+    if (wanta)
+      ad2cp_store(res, "a", a, n, maxcell, maxbeam);
+    if (wantq)
+      ad2cp_store(res, "q", q, n, maxcell, maxbeam);
+    if (wantalt)
+      res["altimeterDistance"] = altimeterDistance;
+    if (wantast) {
+      res["ASTDistance"] = ASTDistance;
+      res["ASTPressure"] = ASTPressure;
+    }
+    if (wantraw) {
+      res["altimeterRawNumberOfSamples"] = altimeterRawNumberOfSamples;
+      res["altimeterRawSampleDistance"] = altimeterRawSampleDistance;
+      res["altimeterRawSamples"] = altimeterRawSamples;
+    }
+    if (wantecho)
+      ad2cp_store(res, "echosounder", echosounder, n, 0, maxcell);
+    if (wantahrs)
+      ad2cp_store(res, "AHRS", AHRS, n, 0, 9);
+  } else {
+    // Bottom track: velocity (int32, scaled by velocityFactor), distance
+    // (int32, in mm) and figure of merit (uint16), each with one value
+    // per beam.
+    long int items = (long int)n * maxbeam;
+    int wantv = (anyConfiguration >> 5) & 1, wantdist = (anyConfiguration >> 8) & 1,
+        wantfom = (anyConfiguration >> 9) & 1;
+    NumericVector v(wantv ? items : 0, NA_REAL);
+    NumericVector altimeterDistance(wantdist ? items : 0, NA_REAL);
+    NumericVector altimeterFigureOfMerit(wantfom ? items : 0, NA_REAL);
+    for (int k = 0; k < n; k++) {
+      long int i = which[k];
+      const unsigned char *d = pbuf + (size_t)index[i];
+      const unsigned char *dend = d + (size_t)length[i];
+      const unsigned char *src = d + d[1]; // offsetOfData
+      unsigned int conf = configuration[k];
+      int nbeam = numberOfBeams[k];
+      double factor = velocityFactor[k];
+      if ((conf >> 5) & 1) {
+        if (src + 4 * nbeam > dend)
+          continue;
+        for (int beam = 0; beam < nbeam; beam++, src += 4)
+          v[k + n * beam] = factor * (int)u32(src);
+      }
+      if ((conf >> 8) & 1) {
+        if (src + 4 * nbeam > dend)
+          continue;
+        for (int beam = 0; beam < nbeam; beam++, src += 4)
+          altimeterDistance[k + n * beam] = 0.001 * (int)u32(src);
+      }
+      if ((conf >> 9) & 1) {
+        if (src + 2 * nbeam > dend)
+          continue;
+        for (int beam = 0; beam < nbeam; beam++, src += 2)
+          altimeterFigureOfMerit[k + n * beam] = u16(src);
+      }
+    }
+    if (wantv)
+      ad2cp_store(res, "v", v, n, 0, maxbeam);
+    if (wantdist)
+      ad2cp_store(res, "altimeterDistance", altimeterDistance, n, 0, maxbeam);
+    if (wantfom)
+      ad2cp_store(res, "altimeterFigureOfMerit", altimeterFigureOfMerit, n, 0, maxbeam);
+  }
+  return(res);
+}
+
+
+/*
+
+Decode Nortek AD2CP data records
+
+@description
+
+Decode the fixed header fields, and the velocity, amplitude and
+correlation blocks (plus the altimeter, AST, raw altimeter,
+echosounder and AHRS blocks, if present) of the AD2CP data records of the requested types,
+in a single pass through the buffer. This replaces R code that used
+readBin() on gathered bytes for each field, and then looped over
+records to fill in the profile arrays.
+
+@details
+
+Each record is decoded with its own number of cells and beams, its own
+configuration bits, and its own velocity scale exponent. Arrays are
+sized for the largest number of cells and beams in the set of records
+of a given type, and any block that would extend beyond the end of its
+record is skipped, with NA (or 0x00) left in its place.
+
+@param buf raw vector holding the file contents.
+
+@param index numeric vector of data-record offsets within 'buf', in the
+C (index-from-0) notation, as returned by do_ldc_ad2cp_in_file().
+
+@param length numeric vector of data-record lengths, as returned by
+do_ldc_ad2cp_in_file().
+
+@param id integer vector of record identifiers, as returned by
+do_ldc_ad2cp_in_file().
+
+@param type integer vector of record identifiers to be decoded. At
+present, these may be 0x15 (burst), 0x16 (average), 0x17 (bottom
+track) and 0x18 (interleaved burst).
+
+@value a list with one element per entry in 'type'. Each is either
+NULL (if there are no records of that type) or a list holding vectors
+of header values (one per record), and arrays for data blocks. The
+profile arrays 'v', 'a' and 'q' have dimension
+c(nrecords, numberOfCells, numberOfBeams), and 'v' is in m/s. For
+bottom-track records, 'v', 'altimeterDistance' and
+'altimeterFigureOfMerit' have dimension c(nrecords, numberOfBeams).
+For profile records with raw altimeter data, 'altimeterRawNumberOfSamples',
+'altimeterRawSampleDistance' and 'altimeterRawSamples' hold one value
+per record. The 'time' element is in seconds since the epoch, and
+'coordinateSystem' is 0 for enu, 1 for xyz, 2 for beam and 3 for
+unknown.
+
+@references
+
+1. Nortek AS. “Signature Integration 55|250|500|1000kHz.” Nortek AS, 2017.
+
+2. Nortek AS. “Signature Integration 55|250|500|1000kHz.” Nortek AS, 2018.
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_ad2cp_records(RawVector buf, NumericVector index, NumericVector length,
+    IntegerVector id, IntegerVector type)
+{
+  double nbuf = buf.size();
+  long int nrec = index.size();
+  if (length.size() != nrec || id.size() != nrec)
+    Rcpp::stop("'index', 'length' and 'id' must be of equal length, but they are of length %ld, %ld and %ld",
+        nrec, (long int)length.size(), (long int)id.size());
+  int ntype = type.size();
+  for (int t = 0; t < ntype; t++)
+    if (!ad2cp_layout(type[t]))
+      Rcpp::stop("cannot decode records of type 0x%x; try 0x15, 0x16, 0x17 or 0x18", type[t]);
+  const unsigned char *pbuf = &buf[0];
+  // Check record extents, and sort them by type, in one pass. Errors
+  // are raised with Rcpp::stop(), which throws, so 'which' is released.
+  std::vector<std::vector<long int> > which(ntype);
+  for (long int i = 0; i < nrec; i++) {
+    for (int t = 0; t < ntype; t++) {
+      if (id[i] != type[t])
+        continue;
+      // The fixed header has 76 bytes [1 table 6.1.2]. The negated
+      // test also catches NA values.
+      if (!(index[i] >= 0 && length[i] >= 76 && index[i] + length[i] <= nbuf))
+        Rcpp::stop("record %ld (at index %.0f, with length %.0f) is not within the %.0f-byte buffer, or is too short",
+            i + 1, index[i], length[i], nbuf);
+      which[t].push_back(i);
+      break;
+    }
+  }
+  List res(ntype);
+  for (int t = 0; t < ntype; t++) {
+#ifdef DEBUG
+    Rprintf("do_ad2cp_records(): type 0x%x has %d records\n", type[t], (int)which[t].size());
+#endif
+    if (which[t].size() > 0)
+      res[t] = ad2cp_decode_type(pbuf, index, length, which[t], ad2cp_layout(type[t]));
+    else
+      res[t] = R_NilValue;
+  }
+  return(res);
+}
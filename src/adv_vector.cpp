@@ -0,0 +1,453 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+#include <Rcpp.h>
+#include <vector>
+#include <cmath>
+#include <ctime>
+#include <cstring>
+#include "byte_search.h"
+using namespace Rcpp;
+
+// Cross-reference work:
+// 1. update ../src/registerDynamicSymbol.c with an item for this
+// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
+
+//#define DEBUG
+
+// in ldc_rdi_in_file.cpp
+double oce_timegm(struct tm *t);
+// in adv_vector_time.cpp
+void adv_vector_time(const double *vvdStart, long int nvvd,
+    const double *vsdStart, const double *vsdTime, long int nvsd,
+    const double *vvdhStart, const double *vvdhTime, long int nvvdh,
+    int nn, double f, double *res);
+
+static inline unsigned int vector_u16(const unsigned char *p)
+{
+  return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static inline int vector_s16(const unsigned char *p)
+{
+  return (short int)vector_u16(p);
+}
+
+static inline int vector_bcd(unsigned char b)
+{
+  return 10 * (b >> 4) + (b & 0x0f);
+}
+
+// Time in the Nortek "clock" structure that starts at p[4], in the
+// order minute, second, day, hour, year, month, each a BCD byte
+// [1 p35-36]. The value is in seconds since 1970-01-01, for the
+// wall-clock time as though it were UTC (see do_adv_vector()), or NA
+// for an invalid date, as ISOdatetime() would give.
+static double vector_time(const unsigned char *p)
+{
+  static const int days_in_month[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  int year = 2000 + vector_bcd(p[8]);
+  int month = vector_bcd(p[9]);
+  int day = vector_bcd(p[6]);
+  int hour = vector_bcd(p[7]);
+  int min = vector_bcd(p[4]);
+  int sec = vector_bcd(p[5]);
+  if (month < 1 || month > 12 || day < 1 || day > days_in_month[month-1]
+      || hour > 23 || min > 59 || sec > 61)
+    return NA_REAL;
+  if (month == 2 && day == 29 && !((year % 4 == 0 && year % 100 != 0) || year % 400 == 0))
+    return NA_REAL;
+  struct tm etime;
+  memset(&etime, 0, sizeof(etime));
+  etime.tm_year = year - 1900;
+  etime.tm_mon = month - 1;
+  etime.tm_mday = day;
+  etime.tm_hour = hour;
+  etime.tm_min = min;
+  etime.tm_sec = sec;
+  return oce_timegm(&etime);
+}
+
+// The index, counting from 0, of the vsd chosen for time t by the
+// bisection method formerly in read.adv.nortek(), with 'add' added
+// and the result clipped to the range of vsd.
+static long int vector_bisect(const std::vector<double>& vsdTime, double t, int add)
+{
+  long int len = vsdTime.size();
+  long int lower = 1, upper = len, middle = 1;
+  int passes = (int)floor(10 + log((double)len) / log(2.0));
+  for (int pass = 1; pass <= passes; pass++) {
+    middle = (upper + lower) / 2;
+    if (t < vsdTime[middle-1])
+      upper = middle;
+    else
+      lower = middle;
+    if (upper - lower < 2)
+      break;
+  }
+  middle += add;
+  if (middle < 1)
+    middle = 1;
+  if (middle > len)
+    middle = len;
+  return middle - 1;
+}
+
+/*
+
+Decode a Nortek Vector file
+
+@description
+
+Locate the Vector Velocity Data (vvd), Vector System Data (vsd) and
+Vector Velocity Data Header (vvdh) records, and the IMU records, of a
+Nortek Vector file in one pass through the buffer, and decode them,
+for read.adv.nortek(). This replaces R code that located each record
+type in a separate pass, gathered the fields with readBin() on index
+vectors, and then called do_adv_vector_time().
+
+@details
+
+The subsetting follows the R code that it replaces. If 'timeWindow'
+is FALSE, 'from' and 'to' are vvd indices, counting from 1. If it is
+TRUE, they are times, and vsd records are found by bisection, and
+vvd records between those two vsd are used. In either case, vsd
+records are then trimmed to those that bracket the retained vvd
+records. Finally, every 'by'-th vvd is retained; if 'byTime' is
+TRUE, 'by' is in seconds, and is converted to a number of samples
+with the mean vvd interval.
+
+Times are in seconds since 1970-01-01, as though the instrument clock
+were in UTC; see the R function naiveTimeToPOSIXct(). For burst
+sampling (i.e. if any vvdh record has a nonzero record count), each
+vvd time is that of the preceding vvdh, plus the number of samples
+since that vvdh divided by the sampling rate, plus a delay for
+warmup. For continuous sampling, the times are found as in
+do_adv_vector_time().
+
+@param buf raw vector holding the file contents.
+
+@param from,to numeric values indicating the range of data to
+decode (see details). A 'to' value of NA means the end of the data.
+
+@param timeWindow logical value indicating whether 'from' and 'to'
+are times.
+
+@param by numeric value indicating the sampling step.
+
+@param byTime logical value indicating whether 'by' is in seconds.
+
+@param samplingRate numeric value, the sampling rate in Hz.
+
+@param analog logical vector of length 2, indicating whether the
+analog1 and analog2 channels are to be decoded.
+
+@value a list containing 'v' (numeric matrix, in m/s), 'a' and 'q'
+(raw matrices), 'pressure' (dbar), 'analog1' and 'analog2' (integer
+vectors, or NULL), and 'time', each with one row or element per
+retained vvd; 'timeSlow', 'voltageSlow', 'headingSlow',
+'pitchSlow', 'rollSlow' and 'temperatureSlow' for the retained vsd;
+'timeBurst' and 'recordsBurst' for all vvdh; the scalars
+'velocityScale', 'orientation' (the vsd status byte that holds the
+orientation bit), 'measurementStart', 'measurementEnd',
+'measurementDeltat' and 'burst' (logical); and 'imuStart', the
+starting points of IMU records, counting from 1.
+
+@references
+
+1. Nortek AS. "System Integrator Guide (Paradopp Family of Products)",
+June 2008. (Doc No: PSI00-0101-0608)
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_adv_vector(RawVector buf, NumericVector from, NumericVector to, LogicalVector timeWindow,
+    NumericVector by, LogicalVector byTime, NumericVector samplingRate, LogicalVector analog)
+{
+  if (analog.size() != 2)
+    Rcpp::stop("'analog' must be of length 2, but it is of length %d", (int)analog.size());
+  double f = samplingRate[0];
+  if (!(f > 0))
+    Rcpp::stop("samplingRate must be positive, but it is %f", f);
+  const unsigned char *pbuf = &buf[0];
+  size_t nbuf = buf.size();
+
+  // 1. Locate records. The first three have checksums, but IMU
+  // records are recognized by their length and type bytes alone (see
+  // locate_vector_imu_sequences() in bitwise.c).
+  static const unsigned char ids[3] = {0x10, 0x11, 0x12}; // vvd, vsd, vvdh
+  static const int lengths[3] = {24, 28, 42};
+  static const unsigned char imu[4][2] = {{0x24, 0xc3}, {0x2b, 0xcc}, {0x19, 0xd2}, {0x19, 0xd3}};
+  oce_byte_pattern pattern[7];
+  for (int p = 0; p < 3; p++) {
+    unsigned char bytes[2] = {0xa5, ids[p]};
+    oce_byte_pattern_init(pattern + p, bytes, 2);
+    pattern[p].length = lengths[p];
+    pattern[p].checksum = OCE_CHECKSUM_WORDS;
+    pattern[p].checksum_start = 0xb58c;
+    pattern[p].skip_record = 1;
+  }
+  for (int p = 0; p < 4; p++) {
+    unsigned char bytes[6] = {0xa5, 0x71, imu[p][0], 0x00, 0x00, imu[p][1]};
+    oce_byte_pattern_init(pattern + 3 + p, bytes, 6);
+    pattern[3 + p].mask[4] = 0x00;
+  }
+  oce_byte_matches m = {NULL, NULL, 0, 0};
+  int status = oce_locate_patterns(pbuf, nbuf, pattern, 7, 0, &m);
+  if (status) {
+    oce_byte_matches_free(&m);
+    Rcpp::stop("cannot locate records: %s", status == -1 ? "cannot allocate memory" : "malformed pattern");
+  }
+  // Errors are reported with Rcpp::stop(), and interrupts are checked
+  // with Rcpp::checkUserInterrupt(), because these throw, so that the
+  // following vectors are released; ::Rf_error() would leak them.
+  std::vector<double> vvdAll, vsdAll, vvdh; // starting points, counting from 1
+  std::vector<int> imuStart;
+  for (size_t i = 0; i < m.n; i++) {
+    switch (m.which[i]) {
+      case 1: vvdAll.push_back(m.start[i]); break;
+      case 2: vsdAll.push_back(m.start[i]); break;
+      case 3: vvdh.push_back(m.start[i]); break;
+      default: imuStart.push_back(m.start[i]);
+    }
+  }
+  oce_byte_matches_free(&m);
+  long int nvvdAll = vvdAll.size(), nvsdAll = vsdAll.size(), nvvdh = vvdh.size();
+#ifdef DEBUG
+  Rprintf("nvvd=%ld nvsd=%ld nvvdh=%ld nimu=%ld\n", nvvdAll, nvsdAll, nvvdh, (long)imuStart.size());
+#endif
+  if (nvvdAll < 2)
+    Rcpp::stop("need at least 2 Vector Velocity Data records, but found %ld", nvvdAll);
+  if (nvsdAll < 2)
+    Rcpp::stop("need at least 2 Vector System Data records, but found %ld", nvsdAll);
+
+  // 2. Burst headers. Note that the record count is the number of
+  // samples in the burst, so a nonzero count indicates burst mode.
+  NumericVector timeBurst(nvvdh);
+  IntegerVector recordsBurst(nvvdh);
+  long int sumRecords = 0;
+  for (long int i = 0; i < nvvdh; i++) {
+    const unsigned char *p = pbuf + (long int)vvdh[i] - 1;
+    timeBurst[i] = vector_time(p);
+    recordsBurst[i] = vector_u16(p + 10);
+    sumRecords += recordsBurst[i];
+  }
+
+  // 3. Velocity scale, from bit 1 of the status byte of the first vsd
+  // [1 p36 and p44], and times of all vsd, for bisection.
+  unsigned char status0 = pbuf[(long int)vsdAll[0] - 1 + 23];
+  double velocityScale = (status0 & 0x02) ? 0.1e-3 : 1e-3;
+  std::vector<double> vsdTimeAll(nvsdAll);
+  for (long int i = 0; i < nvsdAll; i++)
+    vsdTimeAll[i] = vector_time(pbuf + (long int)vsdAll[i] - 1);
+
+  // 4. Window the vvd (with global indices kept in 'vvdIndex') and
+  // the vsd. Both 'first' and 'last' count from 0, and are inclusive.
+  long int vvdFirst, vvdLast, vsdFirst = 0, vsdLast = nvsdAll - 1;
+  if (timeWindow[0]) {
+    long int fromIndex = vector_bisect(vsdTimeAll, from[0], -1);
+    long int toIndex = vector_bisect(vsdTimeAll, to[0], 1);
+    if (toIndex <= fromIndex)
+      Rcpp::stop("no data in specified range from=%f to=%f", from[0], to[0]);
+    double lo = vsdAll[fromIndex], hi = vsdAll[toIndex];
+    vvdFirst = 0;
+    while (vvdFirst < nvvdAll && vvdAll[vvdFirst] < lo)
+      vvdFirst++;
+    vvdLast = vvdFirst - 1;
+    while (vvdLast + 1 < nvvdAll && vvdAll[vvdLast + 1] <= hi)
+      vvdLast++;
+    if (vvdLast < vvdFirst)
+      Rcpp::stop("no data in specified range from=%f to=%f", from[0], to[0]);
+  } else {
+    long int fromIndex = (long int)from[0];
+    long int toIndex = ISNAN(to[0]) ? nvvdAll : (long int)to[0];
+    if (toIndex > nvvdAll)
+      toIndex = nvvdAll;
+    if (toIndex < 1 + fromIndex)
+      Rcpp::stop("need more separation between from and to");
+    vvdFirst = fromIndex - 1;
+    vvdLast = toIndex - 1;
+    // ensure that vvd are bracketed by vsd
+    vsdFirst = -1;
+    for (long int j = 0; j < nvsdAll; j++) {
+      if (vvdAll[vvdFirst] >= vsdAll[j]) {
+        vsdFirst = j;
+        break;
+      }
+    }
+    if (vsdFirst < 0)
+      Rcpp::stop("cannot interpret times for velocities, because no Vector System Data precede first velocity datum");
+    for (long int j = 0; j < nvsdAll; j++) {
+      if (vsdAll[j] >= vvdAll[vvdLast]) {
+        vsdLast = j;
+        break;
+      }
+    }
+  }
+  // Find spanning subset of vsd. This mimics R code that was
+  //   subsetStart <- head(which(vvdStart[1] < vsdStart), 1)
+  //   if (subsetStart > 1) subsetStart <- subsetStart - 1
+  //   subsetEnd <- tail(which(vsdStart < vvdStart[length(vvdStart)]), 1)
+  //   if (subsetEnd < length(vsdStart)) subsetEnd <- subsetEnd + 1
+  //   vsdStart <- vsdStart[seq(subsetStart, subsetEnd-1, 1)]
+  // with 1-based indices within the windowed vsd.
+  {
+    long int n = vsdLast - vsdFirst + 1, start = -1, end = -1;
+    for (long int j = 0; j < n; j++) {
+      if (vvdAll[vvdFirst] < vsdAll[vsdFirst + j]) {
+        start = j + 1;
+        break;
+      }
+    }
+    for (long int j = n - 1; j >= 0; j--) {
+      if (vsdAll[vsdFirst + j] < vvdAll[vvdLast]) {
+        end = j + 1;
+        break;
+      }
+    }
+    if (start > 1)
+      start--;
+    if (end > 0 && end < n)
+      end++;
+    if (start < 0 || end < 0 || end - start < 2)
+      Rcpp::stop("need at least 2 velocity-system-data chunks to determine the timing; try increasing the difference between 'from' and 'to'");
+    vsdLast = vsdFirst + end - 2;
+    vsdFirst = vsdFirst + start - 1;
+  }
+  long int nvsd = vsdLast - vsdFirst + 1;
+  long int nvvdWindow = vvdLast - vvdFirst + 1;
+#ifdef DEBUG
+  Rprintf("vvd window [%ld, %ld], vsd window [%ld, %ld]\n", vvdFirst, vvdLast, vsdFirst, vsdLast);
+#endif
+
+  // 5. Decode vsd.
+  NumericVector timeSlow(nvsd), voltageSlow(nvsd), headingSlow(nvsd), pitchSlow(nvsd),
+                rollSlow(nvsd), temperatureSlow(nvsd);
+  double sumDiff = 0.0;
+  long int nDiff = 0;
+  for (long int i = 0; i < nvsd; i++) {
+    const unsigned char *p = pbuf + (long int)vsdAll[vsdFirst + i] - 1;
+    timeSlow[i] = vsdTimeAll[vsdFirst + i];
+    voltageSlow[i] = 0.1 * vector_u16(p + 10);
+    headingSlow[i] = 0.1 * vector_s16(p + 14);
+    pitchSlow[i] = 0.1 * vector_s16(p + 16);
+    rollSlow[i] = 0.1 * vector_s16(p + 18);
+    temperatureSlow[i] = 0.01 * vector_s16(p + 20);
+    if (i > 0 && !ISNAN(timeSlow[i]) && !ISNAN(timeSlow[i-1])) {
+      sumDiff += timeSlow[i] - timeSlow[i-1];
+      nDiff++;
+    }
+  }
+  double measurementDeltat = (nDiff > 0 ? sumDiff / nDiff : NA_REAL) * nvsd / nvvdWindow;
+  // byte 23 is status, with bit 0 (in Nortek's numbering, i.e. bit 7
+  // in ours) being orientation [1 p36]
+  unsigned char orientation = pbuf[(long int)vsdAll[vsdFirst + nvsd / 2 - 1] - 1 + 23];
+
+  // 6. Select every 'by'-th vvd, mimicking seq(1, len, by=by) in R,
+  // followed by indexing (which truncates fractional indices).
+  double step = by[0];
+  if (byTime[0])
+    step = step / measurementDeltat;
+  if (!(step > 0))
+    Rcpp::stop("cannot step through data with by=%f", step);
+  long int nlook = (long int)floor((nvvdWindow - 1) / step + 1e-10) + 1;
+  std::vector<double> vvd(nlook);
+  std::vector<long int> vvdIndex(nlook);
+  for (long int k = 0; k < nlook; k++) {
+    long int i = vvdFirst + (long int)(1 + k * step) - 1;
+    if (i > vvdLast)
+      i = vvdLast;
+    vvdIndex[k] = i;
+    vvd[k] = vvdAll[i];
+  }
+
+  // 7. Decode vvd [1 p35].
+  NumericMatrix v(nlook, 3);
+  RawMatrix a(nlook, 3), q(nlook, 3);
+  NumericVector pressure(nlook);
+  IntegerVector analog1(analog[0] ? nlook : 0), analog2(analog[1] ? nlook : 0);
+  for (long int k = 0; k < nlook; k++) {
+    const unsigned char *p = pbuf + (long int)vvd[k] - 1;
+    if (analog[0])
+      analog1[k] = vector_u16(p + 8);
+    if (analog[1])
+      analog2[k] = (int)p[2] | ((int)p[5] << 8);
+    pressure[k] = (65536.0 * p[4] + vector_u16(p + 6)) / 1000.0;
+    for (int beam = 0; beam < 3; beam++) {
+      v(k, beam) = velocityScale * vector_s16(p + 10 + 2 * beam);
+      a(k, beam) = p[16 + beam];
+      q(k, beam) = p[19 + beam];
+    }
+    if (k % 100000 == 0)
+      Rcpp::checkUserInterrupt();
+  }
+
+  // 8. Times.
+  NumericVector time(nlook);
+  bool burst = sumRecords > 0;
+  if (burst) {
+    double dt = 1.0 / f;
+    double delayForWarmup = 2 + 1 / (f * 2); // FIXME: this is from a forum posting, not an official doc.
+    long int ivvdh = -1, burstStartIndex = 0;
+    for (long int k = 0; k < nlook; k++) {
+      while (ivvdh + 1 < nvvdh && vvdh[ivvdh + 1] < vvd[k]) {
+        ivvdh++;
+        burstStartIndex = -1;
+      }
+      if (ivvdh < 0) {
+        time[k] = NA_REAL;
+        continue;
+      }
+      if (burstStartIndex < 0) {
+        // index of first vvd after this vvdh
+        long int lo = 0, hi = nvvdAll;
+        while (lo < hi) {
+          long int mid = (lo + hi) / 2;
+          if (vvdAll[mid] < vvdh[ivvdh])
+            lo = mid + 1;
+          else
+            hi = mid;
+        }
+        burstStartIndex = lo;
+      }
+      time[k] = timeBurst[ivvdh] + dt * (vvdIndex[k] - burstStartIndex) + delayForWarmup;
+    }
+  } else {
+    // Times are found for all vvd in the window, and then subsampled,
+    // so that retained samples are 'by' sampling intervals apart.
+    std::vector<double> vsd(vsdAll.begin() + vsdFirst, vsdAll.begin() + vsdLast + 1);
+    std::vector<double> timeAll(nvvdWindow);
+    adv_vector_time(&vvdAll[vvdFirst], nvvdWindow, &vsd[0], &timeSlow[0], nvsd,
+        nvvdh > 0 ? &vvdh[0] : NULL, &timeBurst[0], nvvdh, 0, f, &timeAll[0]);
+    for (long int k = 0; k < nlook; k++)
+      time[k] = timeAll[vvdIndex[k] - vvdFirst];
+  }
+
+  List res;
+  res["v"] = v;
+  res["a"] = a;
+  res["q"] = q;
+  res["pressure"] = pressure;
+  res["analog1"] = analog[0] ? (SEXP)analog1 : R_NilValue;
+  res["analog2"] = analog[1] ? (SEXP)analog2 : R_NilValue;
+  res["time"] = time;
+  res["timeSlow"] = timeSlow;
+  res["voltageSlow"] = voltageSlow;
+  res["headingSlow"] = headingSlow;
+  res["pitchSlow"] = pitchSlow;
+  res["rollSlow"] = rollSlow;
+  res["temperatureSlow"] = temperatureSlow;
+  res["timeBurst"] = timeBurst;
+  res["recordsBurst"] = recordsBurst;
+  res["velocityScale"] = velocityScale;
+  res["orientation"] = (int)orientation;
+  res["measurementStart"] = vsdTimeAll[0];
+  res["measurementEnd"] = vsdTimeAll[nvsdAll - 1];
+  res["measurementDeltat"] = measurementDeltat;
+  res["burst"] = burst;
+  res["imuStart"] = IntegerVector(imuStart.begin(), imuStart.end());
+  return(res);
+}
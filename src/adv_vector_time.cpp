@@ -3,40 +3,18 @@
 #include <Rcpp.h>
 using namespace Rcpp;
 
-// Cross-reference work:
-// 1. update ../src/registerDynamicSymbol.c with an item for this
-// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
-//
-// [[Rcpp::export]]
-NumericVector do_adv_vector_time(NumericVector vvdStart, NumericVector vsdStart, NumericVector vsdTime, NumericVector vvdhStart, NumericVector vvdhTime, NumericVector n, NumericVector f)
+// The work is done by adv_vector_time(), which is also called by
+// do_adv_vector(), in adv_vector.cpp. It fills res[0] to
+// res[nvvd-1]; see do_adv_vector_time() for the meanings of the
+// other arguments.
+void adv_vector_time(const double *vvdStart, long int nvvd,
+    const double *vsdStart, const double *vsdTime, long int nvsd,
+    const double *vvdhStart, const double *vvdhTime, long int nvvdh,
+    int nn, double f, double *res)
 {
-  // This is called by read.adv.nortek(), in adv.nortek.R, with arguments as follows
-  //   vvdStart = indices of 'vector velocity data' (0xA5 ox10)
-  //   vvdhStart = indices of headers for 'vector velocity data header' (0xA5 ox10)
-  //   vvdhTime = POSIX times of vvdh
-  //   vsdStart = indices of headers for 'vector system data' (0xA5 ox11)
-  //   vsdTime = POSIX times of vsd
-  //   n = samples expected (set to 0 for continous mode)
-  //   f = sampling rate in Hz
-  // and the result is a vector of times for the vvd items, which has length
-  // matching that of vvdStart.  The method works by left-bracketing
-  // velocity data with vsd headers, and stepping forward thereafter
-  // in times dt=1/f.
-  long int nvvd = vvdStart.size();
-  long int nvsd = vsdStart.size();
-  long int nvvdh = vvdhStart.size();
-  NumericVector res(nvvd);
   long int ivvd, ivvdh = 0;
-  double t = vvdhTime[0];
-  int nn = (int)floor(0.5 + n[0]);
-  if (nn < 0)
-    ::Rf_error("cannot have negative n (number of points), but got %d (after rounding from %f)", nn, n[0]);
-  if (f[0] < 0)
-    ::Rf_error("cannot have negative f (sampling frequency), but got %f", f[0]);
-#ifdef DEBUG
-  for (int iii=0; iii<nvvdh;iii++) Rprintf("nvvdhTime[%d] = %f\n", iii, vvdhTime[iii]);
-#endif
-  double dt =  1.0 / f[0];
+  double t = nvvdh > 0 ? vvdhTime[0] : NA_REAL;
+  double dt =  1.0 / f;
   if (nn == 0) {
     // Continuous sampling
     //
@@ -47,9 +25,11 @@ NumericVector do_adv_vector_time(NumericVector vvdStart, NumericVector vsdStart,
     Rprintf("vvdStart[0]=%f\n", vvdStart[0]);
     Rprintf("vsdStart[0]=%f\n", vsdStart[0]);
 #endif
+    if (nvvd < 1)
+      return;
     while(vvdStart[0] > vsdStart[ivsd]) {
       if (++ivsd >= nvsd)
-        ::Rf_error("cannot interpret times for velocities, because no Vector System Data precede first velocity datum");
+        Rcpp::stop("cannot interpret times for velocities, because no Vector System Data precede first velocity datum");
 #ifdef DEBUG
       Rprintf("ivsd=%d\n", ivsd);
 #endif
@@ -76,6 +56,11 @@ NumericVector do_adv_vector_time(NumericVector vvdStart, NumericVector vsdStart,
 #ifdef DEBUG
     Rprintf("burst sampling\n");
 #endif
+    if (nvvdh < 1) {
+      for (ivvd = 0; ivvd < nvvd; ivvd++)
+        res[ivvd] = NA_REAL;
+      return;
+    }
     // Pin time to start, if vvd precede vvdh (perhaps not possible).
     for (ivvd = 0; ivvd < nvvd; ivvd++) {
       if (vvdStart[ivvd] < vvdhStart[ivvdh]) {
@@ -85,7 +70,7 @@ NumericVector do_adv_vector_time(NumericVector vvdStart, NumericVector vsdStart,
       }
     }
 #ifdef DEBUG
-    Rprintf("ivvd= %d (C notation)  dt= %.10f   f %f\n", ivvd, dt, f[0]);
+    Rprintf("ivvd= %d (C notation)  dt= %.10f   f %f\n", ivvd, dt, f);
 #endif
     if (ivvd < nvvd) {
       for (; ivvd < nvvd; ivvd++) {
@@ -105,5 +90,41 @@ NumericVector do_adv_vector_time(NumericVector vvdStart, NumericVector vsdStart,
       }
     }
   }
+}
+
+// Cross-reference work:
+// 1. update ../src/registerDynamicSymbol.c with an item for this
+// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
+//
+// [[Rcpp::export]]
+NumericVector do_adv_vector_time(NumericVector vvdStart, NumericVector vsdStart, NumericVector vsdTime, NumericVector vvdhStart, NumericVector vvdhTime, NumericVector n, NumericVector f)
+{
+  // This was formerly called by read.adv.nortek(), in adv.nortek.R,
+  // which now uses do_adv_vector() instead. The arguments are as follows
+  //   vvdStart = indices of 'vector velocity data' (0xA5 ox10)
+  //   vvdhStart = indices of headers for 'vector velocity data header' (0xA5 ox10)
+  //   vvdhTime = POSIX times of vvdh
+  //   vsdStart = indices of headers for 'vector system data' (0xA5 ox11)
+  //   vsdTime = POSIX times of vsd
+  //   n = samples expected (set to 0 for continous mode)
+  //   f = sampling rate in Hz
+  // and the result is a vector of times for the vvd items, which has length
+  // matching that of vvdStart.  The method works by left-bracketing
+  // velocity data with vsd headers, and stepping forward thereafter
+  // in times dt=1/f.
+  long int nvvd = vvdStart.size();
+  long int nvsd = vsdStart.size();
+  long int nvvdh = vvdhStart.size();
+  NumericVector res(nvvd);
+  int nn = (int)floor(0.5 + n[0]);
+  if (nn < 0)
+    ::Rf_error("cannot have negative n (number of points), but got %d (after rounding from %f)", nn, n[0]);
+  if (f[0] < 0)
+    ::Rf_error("cannot have negative f (sampling frequency), but got %f", f[0]);
+#ifdef DEBUG
+  for (int iii=0; iii<nvvdh;iii++) Rprintf("nvvdhTime[%d] = %f\n", iii, vvdhTime[iii]);
+#endif
+  adv_vector_time(&vvdStart[0], nvvd, &vsdStart[0], &vsdTime[0], nvsd,
+      &vvdhStart[0], &vvdhTime[0], nvvdh, nn, f[0], &res[0]);
   return(res);
 }
@@ -1,6 +1,8 @@
 /* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
 
 #include <Rcpp.h>
+#include <string.h>
+#include <vector>
 using namespace Rcpp;
 
 // Cross-reference work:
@@ -40,6 +42,26 @@ using namespace Rcpp;
 
  */
 
+// The precedence rules above reduce to the following: land in either
+// band gives land; two good values give their average, rounded up;
+// otherwise the smaller of the two is used, since this is either the
+// one good value or the less severe of the two codes. That can be
+// written with byte-wide min, max and average operations, which
+// compilers turn into SIMD instructions (e.g. pminub, pmaxub and pavgb
+// on x86-64), so the loop body is kept free of branches.
+static void amsr_average(const unsigned char *a, const unsigned char *b,
+    unsigned char *res, int n)
+{
+  for (int i = 0; i < n; i++) {
+    unsigned char A = a[i], B = b[i];
+    unsigned char lo = A < B ? A : B;
+    unsigned char hi = A < B ? B : A;
+    unsigned char avg = (unsigned char)((A | B) - ((A ^ B) >> 1)); // (A+B+1)/2
+    unsigned char r = hi < 0xfb ? avg : lo;
+    res[i] = hi == 0xff ? 0xff : r;
+  }
+}
+
 // [[Rcpp::export]]
 RawVector do_amsr_average(RawVector a, RawVector b)
 {
@@ -47,42 +69,8 @@ RawVector do_amsr_average(RawVector a, RawVector b)
   if (na != nb)
      ::Rf_error("lengths must agree but length(a) is %d and length(b) is %d", na, nb);
   RawVector res(na);
-  unsigned char A, B;
-  for (int i = 0; i < na; i++) {
-    A = a[i];
-    B = b[i];
-    if (A < 0xfb && B < 0xfb) { // A and B are both OK (the most common case, so put first here)
-      res[i] = (unsigned char)(0.5+0.5*(A+B)); // note rounding
-
-    } else if (A == 0xff) { // A is land; ignore B and return code for land
-      res[i] = 0xff;
-    } else if (B == 0xff) { // B is land; ignore A and return code for land
-      res[i] = 0xff;
-
-    } else if (A == 0xfe) { // 254
-      res[i] = B; // no A observation, so use B, whatever it is
-    } else if (B == 0xfe) {
-      res[i] = A; // no B observation, so use A, whatever it is
-
-    } else if (A == 0xfd) { // 253
-      res[i] = B; // bad A observation, so use B, whatever it is
-    } else if (B == 0xfd) {
-      res[i] = A; // bad B observation, so use A, whatever it is
-
-    } else if (A == 0xfc) { // 252
-      res[i] = B; // A had sea ice; try B (although it is likely also ice)
-    } else if (B == 0xfc) {
-      res[i] = A; // A had sea ice; try A (although it is likely also ice)
-
-    } else if (A == 0xfb) { // 251
-      res[i] = B; // A was too rainy; try B, on the hope that rain is short-lived
-    } else if (B == 0xfb) {
-      res[i] = A; // B was too rainy; try A, on the hope that rain is short-lived
-
-    } else {
-      res[i] = 0xff; // Cannot get here
-    }
-  }
+  if (na)
+    amsr_average(&a[0], &b[0], &res[0], na);
   return(res);
 }
 
@@ -134,3 +122,105 @@ RawVector do_amsr_composite(RawVector a, IntegerVector dim)
   return res;
 }
 
+
+
+// Accumulator for composites that are built up one grid at a time,
+// without forming the n1 x n2 x ndays array used by
+// do_amsr_composite(). For each pixel, it holds the sum and number of
+// good values (i.e. those below 0xfb), along with the most recent
+// value, which supplies the code for pixels without any good values.
+// The result is the same as that of do_amsr_composite().
+//
+// Unlike amsr_average(), which folds the codes of two bands with min
+// and max, a pixel with no good values takes the code of the last grid.
+// This is on purpose: it keeps the behaviour of do_amsr_composite(),
+// which is documented for composite(), since e.g. a sea-ice code in
+// the latest grid is more telling than a rain code in an earlier one.
+typedef struct {
+  int n;
+  int ngrid;
+  std::vector<unsigned int> sum;
+  std::vector<unsigned int> count;
+  std::vector<unsigned char> last;
+} amsr_composite_state;
+
+// Add one grid. As with amsr_average(), there are no branches in the
+// loop, so that it can be vectorized.
+static void amsr_composite_add(amsr_composite_state *state, const unsigned char *a)
+{
+  int n = state->n;
+  unsigned int *sum = &state->sum[0];
+  unsigned int *count = &state->count[0];
+  for (int i = 0; i < n; i++) {
+    unsigned int good = a[i] < 0xfb;
+    sum[i] += good ? a[i] : 0;
+    count[i] += good;
+  }
+  memcpy(&state->last[0], a, n);
+  state->ngrid++;
+}
+
+/*
+
+Create a handle for accumulating an amsr composite
+
+@description
+
+This, with do_amsr_composite_add() and do_amsr_composite_finish(), is
+used by the composite() method for amsr objects, to average across
+grids one at a time.
+
+@param n integer, the number of pixels in each grid.
+
+@value an external pointer to be handed to do_amsr_composite_add()
+and do_amsr_composite_finish().
+
+*/
+
+// [[Rcpp::export]]
+SEXP do_amsr_composite_open(IntegerVector n)
+{
+  if (n.size() != 1 || n[0] == NA_INTEGER || n[0] < 1)
+    ::Rf_error("n must be a single positive integer");
+  amsr_composite_state *state = new amsr_composite_state;
+  state->n = n[0];
+  state->ngrid = 0;
+  state->sum.assign(state->n, 0);
+  state->count.assign(state->n, 0);
+  state->last.assign(state->n, 0xff);
+  XPtr<amsr_composite_state> handle(state, true);
+  return(handle);
+}
+
+// Add a grid (a raw vector or matrix, e.g. x@data$SSTDay) to a
+// composite, returning the number of grids added so far.
+
+// [[Rcpp::export]]
+IntegerVector do_amsr_composite_add(SEXP handle, RawVector a)
+{
+  XPtr<amsr_composite_state> state(handle);
+  if (a.size() != state->n)
+    ::Rf_error("grid has %d pixels, but the composite has %d", (int)a.size(), state->n);
+  amsr_composite_add(state.get(), &a[0]);
+  return(IntegerVector::create(state->ngrid));
+}
+
+// Finish a composite: the rounded mean of the good values at each
+// pixel, or the code in the most recent grid, if there were none (see
+// amsr_composite_state for why the codes are not folded).
+
+// [[Rcpp::export]]
+RawVector do_amsr_composite_finish(SEXP handle)
+{
+  XPtr<amsr_composite_state> state(handle);
+  if (state->ngrid < 1)
+    ::Rf_error("no grids have been added to this composite");
+  int n = state->n;
+  RawVector res(n);
+  for (int i = 0; i < n; i++) {
+    unsigned int c = state->count[i];
+    // (2*sum+count)/(2*count) is floor(0.5+sum/count), as in do_amsr_composite()
+    res[i] = c ? (unsigned char)((2 * state->sum[i] + c) / (2 * c)) : state->last[i];
+  }
+  return res;
+}
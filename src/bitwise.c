@@ -6,9 +6,12 @@
  */
 
 
+#include <string.h>
 #include <R.h>
 #include <Rdefines.h>
 #include <Rinternals.h>
+#include "checksum.h"
+#include "byte_search.h"
 
 //#define DEBUG
 
@@ -70,6 +73,24 @@ SEXP unwrap_sequence_numbers(SEXP seq, SEXP bytes)
   return(res);
 }
 
+/* Copy the starting points of matches into an integer vector, which
+ * is of length 0 if there are none. Errors from oce_locate_patterns()
+ * are reported with the name of the caller. */
+static SEXP matches_to_integer(oce_byte_matches *m, int status, const char *caller)
+{
+  if (status) {
+    oce_byte_matches_free(m);
+    error("%s(): %s", caller, status == -1 ? "cannot allocate memory" : "malformed pattern");
+  }
+  SEXP res;
+  PROTECT(res = NEW_INTEGER(m->n));
+  if (m->n > 0)
+    memcpy(INTEGER_POINTER(res), m->start, m->n * sizeof(int));
+  oce_byte_matches_free(m);
+  UNPROTECT(1);
+  return res;
+}
+
 SEXP ldc_sontek_adv_22(SEXP buf, SEXP max)
 {
   /* ldc = locate data chunk; _sontek_adv = for a SonTek ADV (with temperature and/or pressure installed; see p95 of sontek-adv-op-man-2001.pdf)
@@ -120,80 +141,30 @@ c3 <- readBin(buf[p+15], "integer", signed=TRUE, size=1, n=np)
 temperature <- 0.01 * readBin(buf[sort(c(p, p+1))+16], "integer", signed=TRUE, size=2, endian="little",n=np)
 pressure <- readBin(buf[sort(c(p, p+1))+18], "integer", signed=TRUE, size=2, endian="little",n=np)
 */
-  unsigned char *pbuf;
   PROTECT(buf = AS_RAW(buf));
   PROTECT(max = AS_INTEGER(max));
-  /* FIXME: check lengths of match and key */
-  pbuf = RAW_POINTER(buf);
   int max_lres = *INTEGER_POINTER(max);
-  int lres;
-  int lbuf = LENGTH(buf);
-  SEXP res;
-#ifdef DEBUG
-  Rprintf("lbuf=%d, max=%d\n",lbuf,max_lres);
-#endif
-  /* Count matches, so we can allocate the right length */
-  unsigned char byte1 = 0x85;
-  unsigned char byte2 = 0x16; /* this equal 22 base 10, i.e. the number of bytes in record */
-  unsigned int matches = 0;
-  unsigned short int check_sum_start = ((unsigned short)0xa5<<8)  | ((unsigned short)0x96); /* manual p96 says 0xA596; assume little-endian */
-  unsigned short int check_sum, desired_check_sum;
   if (max_lres < 0)
     max_lres = 0;
-  for (int i = 0; i < lbuf - byte2; i++) { /* note that we don't look to the very end */
-    check_sum = check_sum_start;
-    if (pbuf[i] == byte1 && pbuf[i+1] == byte2) { /* match first 2 bytes, now check the checksum */
-#ifdef DEBUG
-      Rprintf("tentative match %d at i = %d ... ", matches, i);
-#endif
-      for (int c = 0; c < 20; c++)
-        check_sum += (unsigned short int)pbuf[i + c];
-      desired_check_sum = ((unsigned short)pbuf[i+20]) | ((unsigned short)pbuf[i+21] << 8);
-      if (check_sum == desired_check_sum) {
-        matches++;
-#ifdef DEBUG
-        Rprintf("good match (check_sum=%d)\n", check_sum);
-#endif
-        if (max_lres != 0 && matches >= max_lres)
-          break;
-      } else {
-#ifdef DEBUG
-        Rprintf("bad checksum\n");
-#endif
-      }
-    }
-  }
-  /* allocate space, then run through whole buffer again, noting the matches */
-  lres = matches;
-  if (lres > 0) {
-    PROTECT(res = NEW_INTEGER(lres));
-    int *pres = INTEGER_POINTER(res);
-#ifdef DEBUG
-    Rprintf("getting space for %d matches\n", lres);
-#endif
-    unsigned int ires = 0;
-    for (int i = 0; i < lbuf - byte2; i++) { /* note that we don't look to the very end */
-      check_sum = check_sum_start;
-      if (pbuf[i] == byte1 && pbuf[i+1] == byte2) { /* match first 2 bytes, now check the checksum */
-        for (int c = 0; c < 20; c++)
-          check_sum += (unsigned short int)pbuf[i + c];
-        desired_check_sum = ((unsigned short)pbuf[i+20]) | ((unsigned short)pbuf[i+21] << 8);
-        if (check_sum == desired_check_sum) {
-          pres[ires++] = i + 1; /* the +1 is to get R pointers */
-        }
-        if (ires > lres)        /* FIXME: or +1? */
-          break;
-      }
-    }
-    UNPROTECT(3);
-    return(res);
-  } else {
-    PROTECT(res = NEW_INTEGER(1));
-    int *pres = INTEGER_POINTER(res);
-    pres[0] = 0;
-    UNPROTECT(3);
-    return(res);
+  /* 0x16 is 22 base 10, i.e. the number of bytes in record */
+  static const unsigned char key[2] = {0x85, 0x16};
+  oce_byte_pattern pattern;
+  oce_byte_pattern_init(&pattern, key, 2);
+  pattern.length = 22;
+  pattern.checksum = OCE_CHECKSUM_BYTES;
+  pattern.checksum_start = ((unsigned short)0xa5<<8)  | ((unsigned short)0x96); /* manual p96 says 0xA596; assume little-endian */
+  pattern.skip_record = 1;
+  oce_byte_matches m = {NULL, NULL, 0, 0};
+  int status = oce_locate_patterns(RAW_POINTER(buf), LENGTH(buf), &pattern, 1, max_lres, &m);
+  SEXP res;
+  PROTECT(res = matches_to_integer(&m, status, "ldc_sontek_adv_22"));
+  if (LENGTH(res) == 0) {
+    /* Callers expect a single 0 if there are no matches. */
+    res = NEW_INTEGER(1);
+    INTEGER_POINTER(res)[0] = 0;
   }
+  UNPROTECT(3);
+  return(res);
 }
 
 
@@ -210,8 +181,8 @@ SEXP nortek_checksum(SEXP buf, SEXP key)
      vvd.start <- matchBytes(buf, 0xa5, 0x10)
      ok <- NULL;dyn.load("~/src/R-kelley/oce/src/bitwise.so");for(i in 1:200) {ok <- c(ok, .Call("nortek_checksum",buf[vvd.start[i]+0:23], c(0xb5, 0x8c)))}
      */
-  int i, n;
-  short check_value;
+  int n;
+  unsigned short check_value;
   int *resp;
   unsigned char *bufp, *keyp;
   SEXP res;
@@ -227,23 +198,18 @@ SEXP nortek_checksum(SEXP buf, SEXP key)
   Rprintf("key[1]=0x%02x\n", keyp[1]);
 #endif
   n = LENGTH(buf);
-  check_value = (((short)keyp[0]) << 8) | (short)keyp[1]; 
+  check_value = (((unsigned short)keyp[0]) << 8) | (unsigned short)keyp[1];
 #ifdef DEBUG
   Rprintf("check_value= %d\n", check_value);
   Rprintf("n=%d\n", n);
 #endif
-  short *sbufp = (short*) bufp;
-  for (i = 0; i < (n - 2)/2; i++) {
+  /* Sum the whole 2-byte words before the last two bytes, which hold the checksum. */
+  check_value += oce_sum_words_le(bufp, 2 * ((n - 2) / 2));
 #ifdef DEBUG
-    Rprintf("i=%d buf=0x%02x\n", i, sbufp[i]);
+  Rprintf("after, check_value=%d\n", check_value);
 #endif
-    check_value += sbufp[i];
-#ifdef DEBUG
-    Rprintf("after, check_value=%d\n", check_value);
-#endif
-  }
-  short checksum;
-  checksum = (((short)bufp[n-1]) << 8) | (short)bufp[n-2];
+  unsigned short checksum;
+  checksum = (((unsigned short)bufp[n-1]) << 8) | (unsigned short)bufp[n-2];
 #ifdef DEBUG
   Rprintf("CHECK AGAINST 0x%02x 0x%02x\n", bufp[n-2], bufp[n-1]);
   Rprintf("CHECK AGAINST %d\n", checksum);
@@ -257,82 +223,23 @@ SEXP nortek_checksum(SEXP buf, SEXP key)
 
 SEXP match2bytes(SEXP buf, SEXP m1, SEXP m2, SEXP demand_sequential)
 {
-  int i, j, n, n_match, ds;
-  double *resp;
-  unsigned char *bufp, *m1p, *m2p;
-  SEXP res;
+  /* Find non-overlapping occurrences of the 2-byte sequence m1,m2. If
+   * demand_sequential is nonzero, a match must also have a 2-byte
+   * little-endian sequence number (following the matched bytes) that
+   * exceeds that of the previous match by 1, modulo 2^16. */
   PROTECT(buf = AS_RAW(buf));
   PROTECT(m1 = AS_RAW(m1));
   PROTECT(m2 = AS_RAW(m2));
   PROTECT(demand_sequential = AS_INTEGER(demand_sequential));
-  bufp = RAW_POINTER(buf);
-  m1p = RAW_POINTER(m1);
-  m2p = RAW_POINTER(m2);
-  ds = *INTEGER(demand_sequential);
-  n = LENGTH(buf);
-  unsigned short seq_last=0, seq_this;
-  // Rprintf("demand_sequential=%d\n",ds);
-  int nnn=10;
-
-  /* FIXME: the two passes repeat too much code, and should be done as a subroutine */
-
-  //
-  // Pass 1: allocate vector
-  //
-  n_match = 0;                  /* don't demand anything at start */
-  for (i = 0; i < n - 1; i++) {
-    if (bufp[i] == *m1p && bufp[i + 1] == *m2p) {
-      if (ds) {
-        seq_this = (((unsigned short)bufp[i + 3]) << 8) | (unsigned short)bufp[i + 2];
-        // if (nnn > 0) Rprintf("i=%d seq_this=%d seq_last=%d ... ",i,seq_this,seq_last);
-        if (!n_match || (seq_this == (seq_last + 1)) || (seq_this == 1 && seq_last == 65535)) { /* is second needed, given short type? */
-          n_match++;
-          ++i;   // skip
-          seq_last = seq_this;
-          // if (nnn > 0) Rprintf("KEEP\n");
-        } else {
-          // if (nnn > 0) Rprintf("DISCARD\n");
-        }
-        //nnn--;
-      } else {
-        n_match++;
-        ++i;   // skip
-      }
-    }
-  }
-  //
-  // Pass 2: fill in the vector 
-  //
-  PROTECT(res = NEW_NUMERIC(n_match));
-  resp = NUMERIC_POINTER(res);
-  j = 0;
-  seq_last = 0;
-  nnn = 1000;
-  //Rprintf("PASS 2\n");
-  n_match = 0;                  /* don't demand anything at start */
-  for (i = 0; i < n - 1; i++) {
-    //    Rprintf("[%d]:", i);
-    if (bufp[i] == *m1p && bufp[i + 1] == *m2p) {
-      if (ds) {
-        seq_this = (((unsigned short)bufp[i + 3]) << 8) | (unsigned short)bufp[i + 2];
-        //if (nnn > 0) Rprintf("i=%d seq_this=%d seq_last=%d ... ",i,seq_this,seq_last);
-        if (!n_match || (seq_this == (seq_last + 1)) || (seq_this == 1 && seq_last == 65535)) { /* is second needed, given short type? */
-          n_match++;
-          resp[j++] = i + 1; /* the 1 is to offset from C to R */
-          ++i;   /* skip */
-          seq_last = seq_this;
-          //if (nnn > 0) Rprintf("KEEP\n");
-        } else {
-          //if (nnn > 0) Rprintf("DISCARD\n");
-        }
-        nnn--;
-      } else {
-        resp[j++] = i + 1; /* the 1 is to offset from C to R */
-        ++i;   /* skip */
-      }
-    }
-  }
-  UNPROTECT(5);
+  unsigned char key[2] = {*RAW_POINTER(m1), *RAW_POINTER(m2)};
+  oce_byte_pattern pattern;
+  oce_byte_pattern_init(&pattern, key, 2);
+  if (*INTEGER(demand_sequential))
+    pattern.sequence_offset = 2;
+  oce_byte_matches m = {NULL, NULL, 0, 0};
+  int status = oce_locate_patterns(RAW_POINTER(buf), LENGTH(buf), &pattern, 1, 0, &m);
+  SEXP res = matches_to_integer(&m, status, "match2bytes");
+  UNPROTECT(4);
   return(res);
 }
 
@@ -376,53 +283,31 @@ SEXP locate_vector_imu_sequences(SEXP buf)
 
 
      */
-  PROTECT(buf = AS_RAW(buf));
-  unsigned char *bufp;
-  bufp = RAW_POINTER(buf);
-  int bufn = LENGTH(buf);
-  SEXP res;
-  PROTECT(res = NEW_INTEGER(bufn)); // definitely more than enough space
-  int *resp = INTEGER_POINTER(res);
-  int resn = 0;
-  //int check=10; // check this many instance of 0xa5,0x71
-  // We check 5 bytes, on the assumption that false positives will be
-  // effectively zero then (1e-12, if independent random numbers
-  // in range 0 to 255).
+  // The patterns check 5 bytes, on the assumption that false positives
+  // will be effectively zero then (1e-12, if independent random numbers
+  // in range 0 to 255): 0xa5 0x71, then the record length in words,
+  // and then (skipping byte 4) the IMU type at offset 5.
   // FIXME: test the checksum, but SIG2 does not state how.
-  for (int i = 0; i < bufn-1; i++) {
-    if (bufp[i] == 0xa5 && bufp[i+1] == 0x71) {
-      //if (check-- > 0) Rprintf("IMU test: buf[%d]=0x%02x, buf[%d+2]=0x%02x, buf[%d+5]=0x%02x\n", i, bufp[i], i, bufp[i+2], i, bufp[i+5]);
-      // Check at offset=5, which must be 1 of 3 choices.
-      if (bufp[i+5] == 0xc3) {
-        // FIXME: should verify this length check, which I got by inspecting dolfyn code
-        // and a file provided privately in March 2016.
-        if (bufp[i+2] == 0x24 && bufp[i+3] == 0x00) {
-          resp[resn++] = i + 1; // add 1 for R notation
-          i++; //FIXME: skip to end, when we really trust identification
-        }
-      } else if (bufp[i+5] == 0xcc) {
-        // length indication should be 0x2b=43=86/2 (SIG2, top of page 31)
-        if (bufp[i+2] == 0x2b && bufp[i+3] == 0x00) {
-          resp[resn++] = i + 1; // add 1 for R notation
-          i++; //FIXME: skip to end, when we really trust identification
-        }
-      } else if (bufp[i+5] == 0xd2) { // decimal 210
-        // length indication should be 0x19=25=50/2 (SIG2, middle of page 31)
-        if (bufp[i+2] == 0x19 && bufp[i+3] == 0x00) {
-          resp[resn++] = i + 1; // add 1 for R notation
-          i++; //FIXME: skip to end, when we really trust identification
-        }
-      } else if (bufp[i+5] ==0xd3) { // decimal 211
-        // length indication should be 0x19=25=50/2 (SIG2, page 32)
-        if (bufp[i+2] == 0x19 && bufp[i+3] == 0x00) {
-          resp[resn++] = i + 1; // add 1 for R notation
-          i++; //FIXME: skip to end, when we really trust identification
-        }
-      }
-    }
+  static const unsigned char imu[4][6] = {
+    // FIXME: should verify this length, which I got by inspecting dolfyn code
+    // and a file provided privately in March 2016.
+    {0xa5, 0x71, 0x24, 0x00, 0x00, 0xc3},
+    // length indication should be 0x2b=43=86/2 (SIG2, top of page 31)
+    {0xa5, 0x71, 0x2b, 0x00, 0x00, 0xcc},
+    // length indication should be 0x19=25=50/2 (SIG2, middle of page 31)
+    {0xa5, 0x71, 0x19, 0x00, 0x00, 0xd2},
+    // length indication should be 0x19=25=50/2 (SIG2, page 32)
+    {0xa5, 0x71, 0x19, 0x00, 0x00, 0xd3}};
+  PROTECT(buf = AS_RAW(buf));
+  oce_byte_pattern pattern[4];
+  for (int p = 0; p < 4; p++) {
+    oce_byte_pattern_init(pattern + p, imu[p], 6);
+    pattern[p].mask[4] = 0x00;
   }
-  SET_LENGTH(res, resn);
-  UNPROTECT(2);
+  oce_byte_matches m = {NULL, NULL, 0, 0};
+  int status = oce_locate_patterns(RAW_POINTER(buf), LENGTH(buf), pattern, 4, 0, &m);
+  SEXP res = matches_to_integer(&m, status, "locate_vector_imu_sequences");
+  UNPROTECT(1);
   return(res);
 }
 
@@ -453,106 +338,150 @@ SEXP locate_byte_sequences(SEXP buf, SEXP match, SEXP len, SEXP key, SEXP max)
      print(s)
      print(vvd.start)
      */
-  unsigned char *pbuf, *pmatch, *pkey;
   PROTECT(buf = AS_RAW(buf));
   PROTECT(match = AS_RAW(match));
   PROTECT(len = AS_INTEGER(len));
   PROTECT(key = AS_RAW(key));
   PROTECT(max = AS_INTEGER(max));
-  /* FIXME: check lengths of match and key */
-  pbuf = RAW_POINTER(buf);
-  pmatch = RAW_POINTER(match);
-  pkey = RAW_POINTER(key);
-  int lsequence = *INTEGER_POINTER(len);
-  int max_lres = *INTEGER_POINTER(max);
-#ifdef DEBUG
-  Rprintf("lsequence=%d\n",lsequence);
-#endif
   int lmatch = LENGTH(match);
-  int lbuf = LENGTH(buf);
-  int lkey = LENGTH(key);
-  if (lkey != 2) error("key length must be 2");
-  int ires = 0, lres = (int)(lbuf / lsequence + 3); /* get some extra space; fill some with NA */
-  SEXP res;
-#ifdef DEBUG
-  Rprintf("lsequence=%d, lres=%d\n",lsequence,lres);
-#endif
-  /* Rprintf("max_lres=%d\n", max_lres); */
-  if (max_lres > 0)
-    lres = max_lres;
-  PROTECT(res = NEW_INTEGER(lres));
-  int *pres = INTEGER_POINTER(res);
-  /* Count matches, so we can allocate the right length */
-  short lsequence2 = lsequence / 2;
-  for (int i = 0; i < lbuf - lsequence; i++) {
-    short check_value = (((short)pkey[0]) << 8) | (short)pkey[1];
-    int found = 0;
-    for (int m = 0; m < lmatch; m++) {
-      if (pbuf[i+m] == pmatch[m]) 
-        found++;
-      else
-        break;
-    }
-    if (found == lmatch) {
-      /* FIXME: should bit-twiddle this to work on all endian types */
-      short *check = (short*)(pbuf+i);
-      /*Rprintf(" %d", check_value);*/
-      for (int cc = 0; cc < lsequence2 - 1; cc++) { /* last 2-byte chunk is the test value */
-        check_value += *check++;
-        /*Rprintf(" %d", check_value);*/
-      }
-      short check_sum = (((short)pbuf[i+lsequence-1]) << 8) | (short)pbuf[i+lsequence-2];
-#ifdef DEBUG
-      Rprintf("i=%d lbuf=%d ires=%d  lres=%d  check_value=%d vs check_sum %d match=%d\n", i, lbuf, ires, lres, check_value, check_sum, check_value==check_sum);
-#endif
-      if (check_value == check_sum) {
-        pres[ires++] = i + 1;
-        i += lsequence - lmatch; /* no need to check within sequence */
-      }
-      if (ires >= lres)
-        break;
-    }
-    i += lmatch - 1;           /* skip over matched bytes */
-    if (i > (lbuf - lsequence)) 
-      break; /* FIXME: can this ever happen? */
-  }
-  SET_LENGTH(res, ires);
-  UNPROTECT(6);
+  if (lmatch < 1 || lmatch > OCE_PATTERN_BYTES_MAX)
+    error("match length must be between 1 and %d", OCE_PATTERN_BYTES_MAX);
+  if (LENGTH(key) != 2) error("key length must be 2");
+  unsigned char *pkey = RAW_POINTER(key);
+  int max_lres = *INTEGER_POINTER(max);
+  oce_byte_pattern pattern;
+  oce_byte_pattern_init(&pattern, RAW_POINTER(match), lmatch);
+  pattern.length = *INTEGER_POINTER(len);
+  /* last 2-byte chunk is the test value */
+  pattern.checksum = OCE_CHECKSUM_WORDS;
+  pattern.checksum_start = (((unsigned short)pkey[0]) << 8) | (unsigned short)pkey[1];
+  pattern.skip_record = 1; /* no need to check within sequence */
+  oce_byte_matches m = {NULL, NULL, 0, 0};
+  int status = oce_locate_patterns(RAW_POINTER(buf), LENGTH(buf), &pattern, 1, max_lres > 0 ? max_lres : 0, &m);
+  SEXP res = matches_to_integer(&m, status, "locate_byte_sequences");
+  UNPROTECT(5);
   return(res);
 }
 
 SEXP match3bytes(SEXP buf, SEXP m1, SEXP m2, SEXP m3)
 {
-  int i, j, n, n_match;
-  double *resp;
-  unsigned char *bufp, *m1p, *m2p, *m3p;
-  SEXP res;
+  /* Find non-overlapping occurrences of the 3-byte sequence m1,m2,m3. */
   PROTECT(buf = AS_RAW(buf));
   PROTECT(m1 = AS_RAW(m1));
   PROTECT(m2 = AS_RAW(m2));
   PROTECT(m3 = AS_RAW(m3));
-  bufp = RAW_POINTER(buf);
-  m1p = RAW_POINTER(m1);
-  m2p = RAW_POINTER(m2);
-  m3p = RAW_POINTER(m3);
-  n = LENGTH(buf);
-  n_match = 0;
-  for (i = 0; i < n - 2; i++) {
-    if (bufp[i] == *m1p && bufp[i + 1] == *m2p && bufp[i + 2] == *m3p) {
-      n_match++;
-      ++i;   /* skip */
-      ++i;   /* skip */
+  unsigned char key[3] = {*RAW_POINTER(m1), *RAW_POINTER(m2), *RAW_POINTER(m3)};
+  oce_byte_pattern pattern;
+  oce_byte_pattern_init(&pattern, key, 3);
+  oce_byte_matches m = {NULL, NULL, 0, 0};
+  int status = oce_locate_patterns(RAW_POINTER(buf), LENGTH(buf), &pattern, 1, 0, &m);
+  SEXP res = matches_to_integer(&m, status, "match3bytes");
+  UNPROTECT(4);
+  return(res);
+}
+
+/* Element 'name' of list 'list', or R_NilValue if there is none. */
+static SEXP list_element(SEXP list, const char *name)
+{
+  SEXP names = getAttrib(list, R_NamesSymbol);
+  if (names == R_NilValue)
+    return R_NilValue;
+  for (int i = 0; i < LENGTH(list); i++)
+    if (!strcmp(CHAR(STRING_ELT(names, i)), name))
+      return VECTOR_ELT(list, i);
+  return R_NilValue;
+}
+
+static int list_integer(SEXP list, const char *name, int def)
+{
+  SEXP e = list_element(list, name);
+  if (e == R_NilValue || LENGTH(e) < 1)
+    return def;
+  int v = asInteger(e);
+  return v == NA_INTEGER ? def : v;
+}
+
+SEXP locate_byte_patterns(SEXP buf, SEXP patterns, SEXP max)
+{
+  /*
+   * Find records matching any of several patterns, in a single pass
+   * through buf. This is a wrapper for oce_locate_patterns(); see
+   * byte_search.h for the meanings of the items in each pattern.
+   *
+   * buf = buffer to be scanned
+   * patterns = list of patterns, each a list that may contain
+   *   bytes (raw, required), mask (raw, same length as bytes),
+   *   length (integer), lengthOffset, lengthSize, lengthScale
+   *   (integers), checksum (integer: 0 for none, 1 for a sum of
+   *   bytes, 2 for a sum of little-endian words), checksumStart
+   *   (integer), sequenceOffset (integer) and skipRecord (logical).
+   *   Missing items take the defaults of oce_byte_pattern_init().
+   * max = 0 to use whole buffer, positive integer to limit to that many matches
+   *
+   * The value is a list containing 'start', the starting points of
+   * the records (counting from 1), and 'which', the numbers of the
+   * patterns that matched (counting from 1).
+   */
+  PROTECT(buf = AS_RAW(buf));
+  PROTECT(max = AS_INTEGER(max));
+  if (!isNewList(patterns))
+    error("'patterns' must be a list");
+  int npattern = LENGTH(patterns);
+  if (npattern < 1 || npattern > OCE_PATTERNS_MAX)
+    error("number of patterns must be between 1 and %d, but it is %d", OCE_PATTERNS_MAX, npattern);
+  oce_byte_pattern pattern[OCE_PATTERNS_MAX];
+  for (int p = 0; p < npattern; p++) {
+    SEXP pp = VECTOR_ELT(patterns, p);
+    if (!isNewList(pp))
+      error("pattern %d is not a list", p + 1);
+    SEXP bytes = list_element(pp, "bytes");
+    if (TYPEOF(bytes) != RAWSXP || LENGTH(bytes) < 1 || LENGTH(bytes) > OCE_PATTERN_BYTES_MAX)
+      error("pattern %d must have 'bytes', a raw vector of length 1 to %d", p + 1, OCE_PATTERN_BYTES_MAX);
+    int nbytes = LENGTH(bytes);
+    oce_byte_pattern_init(pattern + p, RAW(bytes), nbytes);
+    SEXP mask = list_element(pp, "mask");
+    if (mask != R_NilValue) {
+      if (TYPEOF(mask) != RAWSXP || LENGTH(mask) != nbytes)
+        error("pattern %d has 'mask' that is not a raw vector of length %d", p + 1, nbytes);
+      for (int k = 0; k < nbytes; k++) {
+        pattern[p].mask[k] = RAW(mask)[k];
+        pattern[p].bytes[k] &= RAW(mask)[k];
+      }
     }
+    pattern[p].length = list_integer(pp, "length", 0);
+    pattern[p].length_offset = list_integer(pp, "lengthOffset", 0);
+    pattern[p].length_size = list_integer(pp, "lengthSize", 0);
+    pattern[p].length_scale = list_integer(pp, "lengthScale", 1);
+    pattern[p].checksum = list_integer(pp, "checksum", OCE_CHECKSUM_NONE);
+    pattern[p].checksum_start = (unsigned short)list_integer(pp, "checksumStart", 0);
+    pattern[p].sequence_offset = list_integer(pp, "sequenceOffset", -1);
+    pattern[p].skip_record = list_integer(pp, "skipRecord", 0);
+    if (pattern[p].checksum < OCE_CHECKSUM_NONE || pattern[p].checksum > OCE_CHECKSUM_WORDS)
+      error("pattern %d has unknown checksum type %d", p + 1, pattern[p].checksum);
   }
-  PROTECT(res = NEW_NUMERIC(n_match));
-  resp = NUMERIC_POINTER(res);
-  j = 0;
-  for (i = 0; i < n - 2; i++) {
-    if (j <= n_match && bufp[i] == *m1p && bufp[i + 1] == *m2p && bufp[i + 2] == *m3p) {
-      resp[j++] = i + 1; /* the 1 is to offset from C to R */
-    }
+  int max_lres = *INTEGER_POINTER(max);
+  oce_byte_matches m = {NULL, NULL, 0, 0};
+  int status = oce_locate_patterns(RAW_POINTER(buf), LENGTH(buf), pattern, npattern, max_lres > 0 ? max_lres : 0, &m);
+  if (status) {
+    oce_byte_matches_free(&m);
+    error("locate_byte_patterns(): %s", status == -1 ? "cannot allocate memory" : "malformed pattern");
   }
-  UNPROTECT(5);
+  SEXP res, res_names, start, which;
+  PROTECT(start = NEW_INTEGER(m.n));
+  PROTECT(which = NEW_INTEGER(m.n));
+  if (m.n > 0) {
+    memcpy(INTEGER_POINTER(start), m.start, m.n * sizeof(int));
+    memcpy(INTEGER_POINTER(which), m.which, m.n * sizeof(int));
+  }
+  oce_byte_matches_free(&m);
+  PROTECT(res = allocVector(VECSXP, 2));
+  PROTECT(res_names = allocVector(STRSXP, 2));
+  SET_VECTOR_ELT(res, 0, start);
+  SET_STRING_ELT(res_names, 0, mkChar("start"));
+  SET_VECTOR_ELT(res, 1, which);
+  SET_STRING_ELT(res_names, 1, mkChar("which"));
+  setAttrib(res, R_NamesSymbol, res_names);
+  UNPROTECT(6);
   return(res);
 }
 
@@ -0,0 +1,200 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/* See byte_search.h for the purpose of these functions. Note that
+ * this file does not use R, so that it can be compiled into the
+ * benchmarking program in ../sandbox/byte_search. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "byte_search.h"
+#include "checksum.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+void oce_byte_pattern_init(oce_byte_pattern *p, const unsigned char *bytes, int nbytes)
+{
+  memset(p, 0, sizeof(*p));
+  if (nbytes > OCE_PATTERN_BYTES_MAX)
+    nbytes = OCE_PATTERN_BYTES_MAX;
+  p->nbytes = nbytes;
+  for (int k = 0; k < nbytes; k++) {
+    p->bytes[k] = bytes[k];
+    p->mask[k] = 0xff;
+  }
+  p->length_scale = 1;
+  p->checksum = OCE_CHECKSUM_NONE;
+  p->sequence_offset = -1;
+}
+
+void oce_byte_matches_free(oce_byte_matches *m)
+{
+  free(m->start);
+  free(m->which);
+  m->start = m->which = NULL;
+  m->n = m->alloc = 0;
+}
+
+static int push_match(oce_byte_matches *m, size_t start, int which)
+{
+  if (m->n == m->alloc) {
+    size_t alloc = m->alloc ? 2 * m->alloc : 1024;
+    int *s = (int*)realloc(m->start, alloc * sizeof(int));
+    if (!s)
+      return -1;
+    m->start = s;
+    int *w = (int*)realloc(m->which, alloc * sizeof(int));
+    if (!w)
+      return -1;
+    m->which = w;
+    m->alloc = alloc;
+  }
+  m->start[m->n] = (int)(start + 1); /* R notation */
+  m->which[m->n] = which + 1;
+  m->n++;
+  return 0;
+}
+
+/* Length of the record for pattern p at buf[i], or -1 if the length
+ * cannot be determined, or if the record extends past the buffer. A
+ * pattern with no record length gives its own length. */
+static long record_length(const unsigned char *buf, size_t nbuf, size_t i, const oce_byte_pattern *p)
+{
+  long len = p->length;
+  if (p->length_size > 0) {
+    size_t o = i + p->length_offset;
+    if (o + p->length_size > nbuf)
+      return -1;
+    len = buf[o];
+    if (p->length_size == 2)
+      len |= (long)buf[o + 1] << 8;
+    len *= p->length_scale;
+    if (len < p->nbytes)
+      return -1;
+  }
+  if (len < p->nbytes)
+    len = p->nbytes;
+  if (i + (size_t)len > nbuf)
+    return -1;
+  return len;
+}
+
+/* Does pattern p match at buf[i]? If so, the record length is stored
+ * in *len. The sequence number is checked by the caller, since it
+ * depends on earlier matches. */
+static int pattern_matches(const unsigned char *buf, size_t nbuf, size_t i, const oce_byte_pattern *p, long *len)
+{
+  if (i + p->nbytes > nbuf)
+    return 0;
+  for (int k = 1; k < p->nbytes; k++)
+    if ((buf[i + k] & p->mask[k]) != p->bytes[k])
+      return 0;
+  *len = record_length(buf, nbuf, i, p);
+  if (*len < 0)
+    return 0;
+  if (p->checksum != OCE_CHECKSUM_NONE) {
+    if (*len < 2)
+      return 0;
+    size_t n = (size_t)*len - 2;
+    unsigned short want = (unsigned short)buf[i + n] | ((unsigned short)buf[i + n + 1] << 8);
+    unsigned short sum = p->checksum_start;
+    if (p->checksum == OCE_CHECKSUM_BYTES)
+      sum += oce_sum_bytes(buf + i, n);
+    else
+      sum += oce_sum_words_le(buf + i, 2 * (n / 2));
+    if (sum != want)
+      return 0;
+  }
+  if (p->sequence_offset >= 0 && i + p->sequence_offset + 2 > nbuf)
+    return 0;
+  return 1;
+}
+
+/* Position of the first byte at or after buf[from] that is the first
+ * byte of some pattern, or nbuf if there is none. 'first' holds the
+ * distinct first bytes, and 'is_first' flags them. */
+static size_t next_candidate(const unsigned char *buf, size_t nbuf, size_t from,
+    const unsigned char *first, int nfirst, const unsigned char *is_first)
+{
+  if (from >= nbuf)
+    return nbuf;
+  if (nfirst == 1) {
+    const unsigned char *q = (const unsigned char*)memchr(buf + from, first[0], nbuf - from);
+    return q ? (size_t)(q - buf) : nbuf;
+  }
+  size_t i = from;
+#if defined(__SSE2__)
+  if (nfirst <= 4) {
+    __m128i f[4];
+    for (int k = 0; k < nfirst; k++)
+      f[k] = _mm_set1_epi8((char)first[k]);
+    for (; i + 16 <= nbuf; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+      __m128i hit = _mm_cmpeq_epi8(v, f[0]);
+      for (int k = 1; k < nfirst; k++)
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, f[k]));
+      int bits = _mm_movemask_epi8(hit);
+      if (bits)
+        return i + (size_t)__builtin_ctz((unsigned int)bits);
+    }
+  }
+#endif
+  for (; i < nbuf; i++)
+    if (is_first[buf[i]])
+      return i;
+  return nbuf;
+}
+
+int oce_locate_patterns(const unsigned char *buf, size_t nbuf,
+    const oce_byte_pattern *pattern, int npattern, size_t max,
+    oce_byte_matches *m)
+{
+  unsigned char first[OCE_PATTERNS_MAX];
+  unsigned char is_first[256];
+  unsigned short seq_last[OCE_PATTERNS_MAX];
+  int seq_started[OCE_PATTERNS_MAX];
+  int nfirst = 0;
+  if (npattern < 1 || npattern > OCE_PATTERNS_MAX)
+    return -2;
+  memset(is_first, 0, sizeof(is_first));
+  for (int p = 0; p < npattern; p++) {
+    const oce_byte_pattern *pp = pattern + p;
+    if (pp->nbytes < 1 || pp->nbytes > OCE_PATTERN_BYTES_MAX || pp->mask[0] != 0xff)
+      return -2;
+    if (pp->length_size < 0 || pp->length_size > 2 || pp->length_scale < 1)
+      return -2;
+    if (!is_first[pp->bytes[0]]) {
+      is_first[pp->bytes[0]] = 1;
+      first[nfirst++] = pp->bytes[0];
+    }
+    seq_started[p] = 0;
+    seq_last[p] = 0;
+  }
+  size_t i = next_candidate(buf, nbuf, 0, first, nfirst, is_first);
+  while (i < nbuf) {
+    size_t advance = 1;
+    for (int p = 0; p < npattern; p++) {
+      const oce_byte_pattern *pp = pattern + p;
+      long len;
+      if (buf[i] != pp->bytes[0] || !pattern_matches(buf, nbuf, i, pp, &len))
+        continue;
+      if (pp->sequence_offset >= 0) {
+        size_t o = i + pp->sequence_offset;
+        unsigned short seq = (unsigned short)buf[o] | ((unsigned short)buf[o + 1] << 8);
+        if (seq_started[p] && seq != (unsigned short)(seq_last[p] + 1))
+          continue;
+        seq_started[p] = 1;
+        seq_last[p] = seq;
+      }
+      if (push_match(m, i, p))
+        return -1;
+      if (max > 0 && m->n >= max)
+        return 0;
+      advance = pp->skip_record ? (size_t)len : (size_t)pp->nbytes;
+      break;
+    }
+    i = next_candidate(buf, nbuf, i + advance, first, nfirst, is_first);
+  }
+  return 0;
+}
@@ -0,0 +1,99 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/*
+ * Search for the starting points of records in a byte buffer, as used
+ * by the instrument readers in bitwise.c (e.g. match2bytes(),
+ * locate_byte_sequences() and locate_vector_imu_sequences()).
+ *
+ * Several patterns are sought in one pass. Each pattern is a short
+ * sequence of bytes (with an optional mask, so that some bytes may
+ * take any value), and a candidate match may be further checked with
+ * validators for record length, checksum and sequence number.
+ * Candidates are found by looking for the first byte of any pattern,
+ * with memchr() if all patterns share a first byte, or with SSE2
+ * comparisons of 16 bytes at a time if the compiler targets SSE2.
+ *
+ * Like checksum.c, this does not use R, so that it can be compiled
+ * into the benchmarking program in ../sandbox/byte_search.
+ */
+
+#ifndef OCE_BYTE_SEARCH_H
+#define OCE_BYTE_SEARCH_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Maximum number of bytes in a pattern, and of patterns in a search. */
+#define OCE_PATTERN_BYTES_MAX 16
+#define OCE_PATTERNS_MAX 32
+
+/* Checksum validators. In each case, the checksum is the little-endian
+ * 2-byte value in the last 2 bytes of the record, and it is compared
+ * with checksum_start plus the sum (modulo 2^16) of the preceding
+ * bytes (OCE_CHECKSUM_BYTES, as for SonTek) or of the preceding
+ * little-endian 2-byte words (OCE_CHECKSUM_WORDS, as for Nortek). */
+#define OCE_CHECKSUM_NONE 0
+#define OCE_CHECKSUM_BYTES 1
+#define OCE_CHECKSUM_WORDS 2
+
+typedef struct {
+  /* Bytes to match. A byte matches if (b & mask[k]) == bytes[k], so
+   * a 0x00 mask accepts any value. The first byte may not be
+   * masked. */
+  int nbytes;
+  unsigned char bytes[OCE_PATTERN_BYTES_MAX];
+  unsigned char mask[OCE_PATTERN_BYTES_MAX];
+  /* Record length. If length_size is 0, the length is 'length' (which
+   * may be 0, if there is no record beyond the pattern). Otherwise,
+   * it is length_scale times the unsigned little-endian value of
+   * length_size (1 or 2) bytes at length_offset. A record that
+   * extends beyond the buffer is not matched. */
+  int length;
+  int length_offset;
+  int length_size;
+  int length_scale;
+  /* One of the OCE_CHECKSUM_* values, and the starting value. */
+  int checksum;
+  unsigned short checksum_start;
+  /* If not negative, the offset of a little-endian 2-byte sequence
+   * number, which must exceed that of the previous match of this
+   * pattern by 1 (modulo 2^16). */
+  int sequence_offset;
+  /* If nonzero, the search resumes after the end of a matched record;
+   * otherwise, it resumes after the matched pattern bytes. */
+  int skip_record;
+} oce_byte_pattern;
+
+/* Matches, in order of position. 'start' holds offsets from the start
+ * of the buffer, counting from 1 (as in R), and 'which' holds the
+ * pattern numbers, also counting from 1. The arrays are allocated
+ * with malloc(), and must be released with oce_byte_matches_free(). */
+typedef struct {
+  int *start;
+  int *which;
+  size_t n;
+  size_t alloc;
+} oce_byte_matches;
+
+/* Fill in a pattern with the given bytes and no mask or validators. */
+void oce_byte_pattern_init(oce_byte_pattern *p, const unsigned char *bytes, int nbytes);
+
+/* Find up to 'max' matches (or all of them, if max is 0) of the
+ * patterns in buf[0] through buf[nbuf-1]. If more than one pattern
+ * matches at a given position, the first in the list is used. The
+ * return value is 0 on success, -1 if memory cannot be allocated, and
+ * -2 if a pattern is malformed. */
+int oce_locate_patterns(const unsigned char *buf, size_t nbuf,
+    const oce_byte_pattern *pattern, int npattern, size_t max,
+    oce_byte_matches *m);
+
+void oce_byte_matches_free(oce_byte_matches *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/* See checksum.h for the purpose of these functions. Note that this
+ * file does not use R, so that it can be compiled into the
+ * benchmarking program in ../sandbox/checksum. */
+
+#include "checksum.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+unsigned short oce_sum_bytes(const unsigned char *p, size_t n)
+{
+  size_t i = 0;
+  unsigned long long sum = 0;
+  /* The SAD (sum of absolute differences) instructions, with a zero
+   * operand, add groups of 8 bytes into 64-bit lanes, so there is no
+   * risk of overflow. */
+#if defined(__AVX2__)
+  if (n >= 32) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+    }
+    unsigned long long lane[4];
+    _mm256_storeu_si256((__m256i*)lane, acc);
+    sum += lane[0] + lane[1] + lane[2] + lane[3];
+  }
+#elif defined(__SSE2__)
+  if (n >= 16) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+    }
+    unsigned long long lane[2];
+    _mm_storeu_si128((__m128i*)lane, acc);
+    sum += lane[0] + lane[1];
+  }
+#endif
+  for (; i < n; i++)
+    sum += p[i];
+  return (unsigned short)sum;
+}
+
+unsigned short oce_sum_words_le(const unsigned char *p, size_t n)
+{
+  size_t i = 0;
+  unsigned short sum = 0;
+  /* Adding 16-bit lanes with wraparound gives each lane's sum modulo
+   * 2^16, and the sum of those, modulo 2^16, is the desired value. The
+   * loads put the bytes into the lanes in little-endian order, which
+   * is the only order on the machines that have these instructions. */
+#if defined(__AVX2__)
+  if (n >= 32) {
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32)
+      acc = _mm256_add_epi16(acc, _mm256_loadu_si256((const __m256i*)(p + i)));
+    unsigned short lane[16];
+    _mm256_storeu_si256((__m256i*)lane, acc);
+    for (int k = 0; k < 16; k++)
+      sum += lane[k];
+  }
+#elif defined(__SSE2__)
+  if (n >= 16) {
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16)
+      acc = _mm_add_epi16(acc, _mm_loadu_si128((const __m128i*)(p + i)));
+    unsigned short lane[8];
+    _mm_storeu_si128((__m128i*)lane, acc);
+    for (int k = 0; k < 8; k++)
+      sum += lane[k];
+  }
+#endif
+  for (; i + 1 < n; i += 2)
+    sum += (unsigned short)(p[i] | (p[i+1] << 8));
+  if (i < n)
+    sum += (unsigned short)(p[i] << 8);
+  return sum;
+}
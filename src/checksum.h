@@ -0,0 +1,38 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/*
+ * Checksum kernels used by the instrument readers, e.g.
+ * ldc_rdi_in_file.cpp, ldc_ad2cp_in_file.cpp, sontek_adp.cpp and
+ * bitwise.c. Each returns a sum modulo 2^16, to which the caller adds
+ * the instrument-specific starting value before comparing with the
+ * checksum stored in the file.
+ *
+ * The sums are vectorized with AVX2 or SSE2 if the compiler targets
+ * those instruction sets (i.e. if __AVX2__ or __SSE2__ is defined),
+ * and otherwise done a byte at a time. The results are the same in
+ * all cases.
+ */
+
+#ifndef OCE_CHECKSUM_H
+#define OCE_CHECKSUM_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sum of the n bytes starting at p, as used by RDI and SonTek. */
+unsigned short oce_sum_bytes(const unsigned char *p, size_t n);
+
+/* Sum of the little-endian 2-byte words in the n bytes starting at p,
+ * as used by Nortek. If n is odd, the last byte is added as the high
+ * byte of a final word, following the Nortek code in "Integrators
+ * Guide AD2CP_A.pdf". */
+unsigned short oce_sum_words_le(const unsigned char *p, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
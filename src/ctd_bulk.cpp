@@ -0,0 +1,114 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+#include <new>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "ctd_readers.h"
+using namespace Rcpp;
+
+// Cross-reference work:
+// 1. update ../src/registerDynamicSymbol.c with an item for this
+// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
+
+#define CTD_FORMAT_NONE 0
+#define CTD_FORMAT_CNV 1
+#define CTD_FORMAT_ODF 2
+#define CTD_FORMAT_WOCE 3
+
+/*
+
+Read a set of CTD files
+
+@description
+
+Parse many CTD files at once, with 'nthreads' threads, for
+read.section(). Each file is parsed as do_read_cnv(), do_read_odf() or
+do_read_woce_exchange() would parse it, with the arguments that
+read.ctd.sbe(), read.odf() and read.ctd.woce() use by default.
+
+@details
+
+The files are parsed into C++ structures (see ctd_readers.h) in the
+threads, which call no R functions. The structures are then turned
+into lists, in the main thread, in the order of 'filename', and each
+is freed as soon as its list has been made.
+
+@param filename character vector of file names.
+
+@param format character vector, of the same length, holding "cnv",
+"odf" or "woce" to indicate the format of the corresponding file. A
+file of any other format is skipped.
+
+@param nthreads integer giving the number of threads to use.
+
+@value a list, with an item for each file, holding what the reader
+for its format returns, or NULL if the file was skipped or could not
+be read.
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_read_ctd_files(CharacterVector filename, CharacterVector format, IntegerVector nthreads)
+{
+  int n = filename.size();
+  if (format.size() != n)
+    ::Rf_error("lengths of filename (%d) and format (%d) must match\n", n, (int)format.size());
+  std::vector<std::string> fn(n);
+  std::vector<int> type(n, CTD_FORMAT_NONE);
+  for (int i = 0; i < n; i++) {
+    fn[i] = Rcpp::as<std::string>(filename[i]);
+    std::string f = Rcpp::as<std::string>(format[i]);
+    if (f == "cnv")
+      type[i] = CTD_FORMAT_CNV;
+    else if (f == "odf")
+      type[i] = CTD_FORMAT_ODF;
+    else if (f == "woce")
+      type[i] = CTD_FORMAT_WOCE;
+  }
+  std::vector<cnv_file> cnv(n);
+  std::vector<odf_file> odf(n);
+  std::vector<woce_file> woce(n);
+  std::vector<int> parsed(n, 0);
+  const std::vector<std::string> no_character;
+  // Files vary in size, so they are handed out one at a time.
+#ifdef _OPENMP
+  int nthreads_value = nthreads.size() < 1 || nthreads[0] < 1 ? 1 : nthreads[0];
+#pragma omp parallel for num_threads(nthreads_value) schedule(dynamic, 1)
+#endif
+  for (int i = 0; i < n; i++) {
+    std::string message;
+    try {
+      if (type[i] == CTD_FORMAT_CNV)
+        parsed[i] = cnv_parse(fn[i], 0, 0.0, 1, &cnv[i], &message);
+      else if (type[i] == CTD_FORMAT_ODF)
+        parsed[i] = odf_parse(fn[i], &odf[i], &message);
+      else if (type[i] == CTD_FORMAT_WOCE)
+        parsed[i] = woce_parse(fn[i], no_character, std::string(), &woce[i], &message);
+    } catch (std::bad_alloc &) {
+      parsed[i] = 0;
+    }
+  }
+  List res(n);
+  for (int i = 0; i < n; i++) {
+    if (parsed[i]) {
+      if (type[i] == CTD_FORMAT_CNV)
+        res[i] = cnv_list(&cnv[i]);
+      else if (type[i] == CTD_FORMAT_ODF)
+        res[i] = odf_list(&odf[i]);
+      else
+        res[i] = woce_list(&woce[i]);
+    }
+    cnv[i] = cnv_file();
+    odf[i] = odf_file();
+    woce[i] = woce_file();
+  }
+  return(res);
+}
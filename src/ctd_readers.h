@@ -0,0 +1,68 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+// Parsers for the text formats of CTD files: Sea-Bird .cnv
+// (ctd_sbe.cpp), ODF (odf.cpp) and WOCE exchange (woce_exchange.cpp).
+//
+// Each parser works in two stages. The parse stage reads a file into
+// a plain C++ structure, and calls no R functions, so that
+// do_read_ctd_files() (ctd_bulk.cpp) can run it for many files at
+// once, in separate threads. The list stage turns that structure into
+// the list returned to R, and must be run in the main thread. The
+// do_read_cnv(), do_read_odf() and do_read_woce_exchange() functions
+// run the two stages in turn.
+//
+// A parse function returns 0, with an explanation in *message, if the
+// file cannot be read.
+
+#ifndef OCE_CTD_READERS_H
+#define OCE_CTD_READERS_H
+
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+
+struct cnv_file {
+  std::vector<std::string> header;
+  int found_end, data_start, ok;
+  double bad_flag;
+  std::vector<std::vector<double> > column;
+  std::vector<int> all_int, all_na;
+};
+
+struct odf_file {
+  std::vector<std::string> header;
+  int data_start, ok;
+  std::vector<int> is_char, is_time;
+  std::vector<std::vector<double> > num, time;
+  std::vector<std::vector<std::string> > chr;
+  std::vector<std::vector<int> > chr_na;
+};
+
+struct woce_file {
+  std::vector<std::string> header, headers, names, units;
+  int data_start, ok, nrow;
+  std::vector<int> is_char, is_int;
+  std::vector<std::vector<double> > num;
+  std::vector<std::vector<std::string> > chr;
+  std::vector<std::vector<int> > chr_na;
+  std::vector<std::string> group_names;
+  std::vector<std::vector<int> > groups;
+};
+
+// If 'have_missing' is nonzero, data equal to 'missing_value' are set
+// to NA, as are data equal to the "# bad_flag" value, if 'use_bad_flag'
+// is nonzero and the header holds one.
+int cnv_parse(const std::string &filename, int have_missing, double missing_value,
+    int use_bad_flag, cnv_file *f, std::string *message);
+Rcpp::List cnv_list(cnv_file *f);
+
+int odf_parse(const std::string &filename, odf_file *f, std::string *message);
+Rcpp::List odf_list(odf_file *f);
+
+// Columns named in 'character' are returned as character. If
+// 'group_by' is not empty, the rows are grouped by that column.
+int woce_parse(const std::string &filename, const std::vector<std::string> &character,
+    const std::string &group_by, woce_file *f, std::string *message);
+Rcpp::List woce_list(woce_file *f);
+
+#endif
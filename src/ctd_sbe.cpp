@@ -0,0 +1,259 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+#include <Rcpp.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include "input_file.h"
+#include "text_parse.h"
+#include "ctd_readers.h"
+using namespace Rcpp;
+
+// Cross-reference work:
+// 1. update ../src/registerDynamicSymbol.c with an item for this
+// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
+
+// Is the line from 'p' to 'end' the "*END*" line that ends the header?
+static int cnv_is_end(const char *p, const char *end)
+{
+  return oce_trim(p, end) == "*END*";
+}
+
+// Does the line from 'p' to 'end' contain a letter other than d, D, e
+// or E (which may be exponents)? If so, read.ctd.sbe() takes it to be
+// an extra header line, after "*END*".
+static int cnv_has_letter(const char *p, const char *end)
+{
+  for (; p < end; p++) {
+    char c = *p;
+    if ((c >= 'a' && c <= 'c') || (c >= 'f' && c <= 'z') || (c >= 'A' && c <= 'C') || (c >= 'F' && c <= 'Z'))
+      return 1;
+  }
+  return 0;
+}
+
+// If the line from 'p' to 'end' is of the form "# bad_flag = value",
+// store the value (or NA, if it is not a number) in *value and return 1.
+static int cnv_bad_flag(const char *p, const char *end, double *value)
+{
+  if (p == end || *p != '#')
+    return 0;
+  const char *q = p + 1;
+  if (q == end || (*q != ' ' && *q != '\t'))
+    return 0;
+  while (q < end && (*q == ' ' || *q == '\t'))
+    q++;
+  for (const char *key = "bad_flag"; *key; key++, q++) {
+    if (q == end || tolower((unsigned char)*q) != *key)
+      return 0;
+  }
+  while (q < end && (*q == ' ' || *q == '\t'))
+    q++;
+  if (q == end || *q != '=')
+    return 0;
+  q++;
+  std::string v = oce_trim(q, end);
+  if (!oce_parse_number(v.c_str(), v.c_str() + v.size(), value, NULL))
+    *value = NA_REAL;
+  return 1;
+}
+
+/*
+
+Read a Sea-Bird .cnv file
+
+@description
+
+Read the header and the data of a Sea-Bird .cnv file in a single pass
+through the file, which is held in memory (see input_file.h). The
+header is returned as lines, for interpretation by read.ctd.sbe(), and
+the data are parsed into columns, as read.table() would do.
+
+@details
+
+The header runs up to the "*END*" line. The data start on the next
+line, unless that line contains a letter other than d or e, in which
+case they start on the line after that, as in read.ctd.sbe().
+
+The data lines are split at whitespace, and must all have the same
+number of fields. A field of "NA" is a missing value. As for
+read.table(), a column is integer if all of its fields are integers,
+logical if all of its fields are "NA", and numeric otherwise. If any
+field is not a number, or if the lines do not all have the same
+number of fields, then "ok" is FALSE and "data" is NULL, so that the
+caller can fall back to read.table().
+
+@param filename character string indicating the file name.
+
+@param missingValue numeric value to be replaced by NA in the data.
+If this is of length 0, nothing is replaced.
+
+@param useBadFlag logical value indicating whether to use the value of
+the first "# bad_flag =" header line, if there is one, instead of
+missingValue.
+
+@value a list containing "header" (character, the lines up to and
+including "*END*", or all the lines, if there is no "*END*"),
+"foundEnd" (logical), "dataStart" (integer, the line number of the
+first data line, counting from 1), "badFlag" (numeric, the value of
+the bad_flag header line, or NA), "ok" (logical) and "data" (a list of
+columns, or NULL).
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_read_cnv(CharacterVector filename, NumericVector missingValue, LogicalVector useBadFlag)
+{
+  std::string fn = Rcpp::as<std::string>(filename(0));
+  cnv_file f;
+  std::string message;
+  if (!cnv_parse(fn, missingValue.size() > 0, missingValue.size() > 0 ? missingValue[0] : 0.0,
+        useBadFlag[0], &f, &message))
+    ::Rf_error("cannot read file '%s' (%s)\n", fn.c_str(), message.c_str());
+  return(cnv_list(&f));
+}
+
+int cnv_parse(const std::string &filename, int have_missing, double missing_value,
+    int use_bad_flag, cnv_file *f, std::string *message)
+{
+  InputFile mf(filename);
+  if (!mf.ok()) {
+    *message = mf.message();
+    return 0;
+  }
+  const char *p = (const char*)mf.data();
+  const char *end = p + mf.size();
+
+  // Header
+  std::vector<std::string> &header = f->header;
+  int found_end = 0, have_bad_flag = 0;
+  double bad_flag = NA_REAL;
+  const char *line_end;
+  while (p < end) {
+    const char *next = oce_next_line(p, end, &line_end);
+    header.push_back(std::string(p, line_end - p));
+    if (!have_bad_flag)
+      have_bad_flag = cnv_bad_flag(p, line_end, &bad_flag);
+    p = next;
+    if (cnv_is_end(header.back().data(), header.back().data() + header.back().size())) {
+      found_end = 1;
+      break;
+    }
+  }
+  int data_start = header.size() + 1;
+  if (found_end && p < end) {
+    const char *next = oce_next_line(p, end, &line_end);
+    if (cnv_has_letter(p, line_end)) {
+      p = next;
+      data_start++;
+    }
+  }
+
+  // Data
+  int replace = 0;
+  double missing = 0.0;
+  if (use_bad_flag && have_bad_flag) {
+    replace = 1;
+    missing = bad_flag;
+  } else if (have_missing) {
+    replace = 1;
+    missing = missing_value;
+  }
+  // As for x==missing in R, a missing value of NA makes all data NA.
+  int replace_all = replace && ISNAN(missing);
+  std::vector<std::vector<double> > &column = f->column;
+  std::vector<int> &all_int = f->all_int, &all_na = f->all_na;
+  int ok = found_end, nline = 0;
+  while (ok && p < end) {
+    const char *next = oce_next_line(p, end, &line_end);
+    // As for read.table(), '#' starts a comment, and blank lines are skipped.
+    const char *hash = (const char*)memchr(p, '#', line_end - p);
+    if (hash)
+      line_end = hash;
+    size_t icol = 0;
+    const char *t = oce_skip_space(p, line_end);
+    while (t < line_end) {
+      const char *te = oce_token_end(t, line_end);
+      if (icol == column.size()) {
+        if (nline > 0) {
+          ok = 0; // more fields than in the previous lines
+          break;
+        }
+        column.push_back(std::vector<double>());
+        all_int.push_back(1);
+        all_na.push_back(1);
+      }
+      double v;
+      int is_int = 1;
+      if (te - t == 2 && t[0] == 'N' && t[1] == 'A') {
+        v = NA_REAL;
+      } else if (oce_parse_number(t, te, &v, &is_int)) {
+        all_na[icol] = 0;
+        if (!is_int)
+          all_int[icol] = 0;
+        if (replace && (replace_all || v == missing))
+          v = NA_REAL;
+      } else {
+        ok = 0;
+        break;
+      }
+      column[icol].push_back(v);
+      icol++;
+      t = oce_skip_space(te, line_end);
+    }
+    if (icol > 0) {
+      if (icol != column.size())
+        ok = 0; // fewer fields than in the previous lines
+      nline++;
+    }
+    p = next;
+  }
+  mf.close();
+  f->found_end = found_end;
+  f->data_start = data_start;
+  f->bad_flag = bad_flag;
+  f->ok = ok;
+  if (!ok)
+    std::vector<std::vector<double> >().swap(column);
+  return 1;
+}
+
+List cnv_list(cnv_file *f)
+{
+  List res;
+  CharacterVector h(f->header.size());
+  for (size_t i = 0; i < f->header.size(); i++)
+    SET_STRING_ELT(h, i, Rf_mkCharCE(f->header[i].c_str(), CE_UTF8));
+  std::vector<std::string>().swap(f->header);
+  if (f->ok) {
+    std::vector<std::vector<double> > &column = f->column;
+    List data(column.size());
+    for (size_t j = 0; j < column.size(); j++) {
+      size_t n = column[j].size();
+      if (f->all_na[j]) {
+        data[j] = LogicalVector(n, NA_LOGICAL);
+      } else if (f->all_int[j]) {
+        IntegerVector c(n);
+        for (size_t i = 0; i < n; i++)
+          c[i] = ISNAN(column[j][i]) ? NA_INTEGER : (int)column[j][i];
+        data[j] = c;
+      } else {
+        data[j] = NumericVector(column[j].begin(), column[j].end());
+      }
+      std::vector<double>().swap(column[j]);
+    }
+    res = List::create(Named("header")=h, Named("foundEnd")=f->found_end != 0,
+        Named("dataStart")=f->data_start, Named("badFlag")=f->bad_flag,
+        Named("ok")=true, Named("data")=data);
+  } else {
+    res = List::create(Named("header")=h, Named("foundEnd")=f->found_end != 0,
+        Named("dataStart")=f->data_start, Named("badFlag")=f->bad_flag,
+        Named("ok")=false, Named("data")=R_NilValue);
+  }
+  return(res);
+}
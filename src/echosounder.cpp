@@ -1,125 +1,87 @@
 /* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
 
 #include <Rcpp.h>
+#include <vector>
+#include <algorithm>
+#include <cstring>
 using namespace Rcpp;
 
-// FIXME 1: think about whether this saved-storage is thread-safe, and
-// also whether we may need to resize (are all pings created equal?)
-//
-// FIXME 2: this code should be altered to handle dual- and split-beam
-// data.  In single-beam data, the procedure is to work in 2-byte
-// chunks (as is done here) but for the other cases, it should work in
-// 4-byte chunks.
+// FIXME: for dual-beam data, only the narrow-beam data are decoded
+// (into 'a'); 'b' and 'c' are set to zero.
 //
 // REFERENCES:
 // [1] "DT4 Data File Format Specification" [July, 2010] DT4_format_2010.pdf
 
 //#define DEBUG 1
 
-// 1. Routines to maintain static storage to avoid possibly thousands
-// of allocations of identical size (are we sure on that?, for a fixed purpose.
-// FIXME: see if OK on multicore; if not, use R method (if that's ok).
-static unsigned char *buffer = NULL; // single-beam uses just first 2 bytes of each 4-byte entry
-void biosonics_allocate_storage(int spp, int byte_per_sample)
+// Cross-reference work:
+// 1. update ../src/registerDynamicSymbol.c with an item for this
+// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
+
+// 1. decode biosonics two-byte floating format
+double biosonic_float(unsigned char byte1, unsigned char byte2)
 {
-  if (buffer == NULL) {
-#ifdef DEBUG
-    Rprintf("should allocate space for %d data now\n", spp * byte_per_sample);
-#endif
-    buffer = (unsigned char*)calloc(spp * byte_per_sample, sizeof(unsigned char));
-    if (buffer == NULL) {
-      ::Rf_error("cannot allocate space for temporary buffer, of length %d bytes", spp * byte_per_sample);
+    unsigned int assembled_bytes = ((short)byte2 << 8) | ((short)byte1); // little endian
+    unsigned int mantissa = (assembled_bytes & 0x0FFF); // rightmost 12 bits (again, little endian)
+    int exponent = (assembled_bytes & 0xF000) >> 12; // leftmost 4 bits, shifted to RHS
+    unsigned long res;
+    if (exponent == 0) {
+      res = mantissa;
+    } else {
+      res = (mantissa + 0x1000) << (exponent - 1);
     }
-#ifdef DEBUG
-    Rprintf("... allocation was OK; address is %lx\n", buffer);
-#endif
-  }
+//#ifdef DEBUG
+//    Rprintf(" ***  0x%x%x mantissa=%d exponent=%d res=%f\n", byte1, byte2, mantissa, exponent, resp[i]);
+//#endif
+    return((double)res);
 }
 
-extern "C" {
-void biosonics_free_storage()
+// Fill a lookup table for biosonic_float(), indexed by the
+// little-endian 2-byte value, so that decoding a sample is a single
+// load, instead of a branch and shift.
+static void biosonic_float_table(std::vector<double>& table)
 {
-#ifdef DEBUG
-    Rprintf("freeing up 'buffer' storage at address %lx\n", buffer);
-#endif
-  if (buffer != NULL)
-    free(buffer);
-  buffer = NULL;
-}
+  table.resize(65536);
+  for (int i = 0; i < 65536; i++)
+    table[i] = biosonic_float(i & 0xFF, i >> 8);
 }
 
 // 2. run-length expansion
-void rle(unsigned char *samp, int ns, int spp, int byte_per_sample)
+//
+// This code is patterned on [1 p36-37] for runlength expansion of data
+// stored in 2-byte (single-beam) or 4-byte (dual- and split-beam)
+// chunks.  The main difference is that the present function uses
+// bytewise operations, which means that it should work the same on
+// big-endian and little-endian computers.  The 'ns' samples in 'samp'
+// are expanded into 'out', which holds spp*byte_per_sample bytes,
+// and which is zero-filled beyond the end of the data.
+static void rle(const unsigned char *samp, int ns, int spp, int byte_per_sample, unsigned char *out)
 {
-  // This code is patterned on [1 p36-37] for runlength expansion
-  // of data stored in 4-byte chunks.  The main difference is
-  // that the present function uses bytewise operations, which
-  // means that it should work the same on big-endian
-  // and little-endian computers.  After this function returns,
-  // the global-storage 'buffer' contains runlength expanded
-  // data taken from the 'samp', and the length of that buffer
-  // is 4*spp bytes.
 #ifdef DEBUG
-  Rprintf("rle(0x%02x%02x%02x%02x ..., ns=%d, spp=%d, byte_per_sample=%d)\n",
-      samp[0], samp[1], samp[2], samp[3], ns, spp, byte_per_sample);
+  Rprintf("rle(0x%02x%02x ..., ns=%d, spp=%d, byte_per_sample=%d)\n",
+      samp[0], samp[1], ns, spp, byte_per_sample);
 #endif
   int i = 0, k = 0;
-  unsigned char b1, b2, b3, b4;
   int NS = ns * byte_per_sample;
   int SPP = spp * byte_per_sample;
-  while (i < NS) {
-    //Rprintf("i=%d k=%d\n", i, k);
-    b1 = samp[i++];
-    b2 = samp[i++];
-    if (byte_per_sample == 4) {
-      b3 = samp[i++];
-      b4 = samp[i++];
-    }
-    if (b2 == 0xFF) {
-      int n = (int)b1 + 2;
-#ifdef DEBUG
-      Rprintf("zero-fill %d samples at i=%d k=%d\n", n, i, k);
-#endif
-      while (n > 0) {
-        if (k < SPP) {
-          buffer[k++] = 0x00;
-          buffer[k++] = 0x00;
-          if (byte_per_sample == 4) {
-            buffer[k++] = 0x00;
-            buffer[k++] = 0x00;
-          }
-          --n;
-        } else {
-          break; // prevent overfill (probably will never happen)
-        }
-      }
+  while (i < NS && k < SPP) {
+    if (samp[i + 1] == 0xFF) {
+      // zero-fill, without overfilling (which probably will never happen)
+      int n = ((int)samp[i] + 2) * byte_per_sample;
+      if (n > SPP - k)
+        n = SPP - k;
+      memset(out + k, 0, n);
+      k += n;
     } else {
-      if (k < SPP) {
-        buffer[k++] = b1;
-        buffer[k++] = b2;
-        if (byte_per_sample == 4) {
-          buffer[k++] = b3;
-          buffer[k++] = b4;
-        }
-      } else {
-        break;
-      }
-    }
-  }
-#ifdef DEBUG
-  Rprintf("zero-fill at end for %d elements\n", (SPP-k)/4);
-#endif
-  while (k < SPP) {
-    buffer[k++] = 0x00;
-    buffer[k++] = 0x00;
-    if (byte_per_sample == 4) {
-      buffer[k++] = 0x00;
-      buffer[k++] = 0x00;
+      memcpy(out + k, samp + i, byte_per_sample);
+      k += byte_per_sample;
     }
+    i += byte_per_sample;
   }
+  if (k < SPP)
+    memset(out + k, 0, SPP - k);
 }
 
-
 // 3. subsecond time for Biosonic echosounder [1 p19], wrapped
 // as C for use in R/echosounder.R.
 extern "C" {
@@ -132,80 +94,279 @@ void biosonics_ss(unsigned char *byte, double *out)
 }
 }
 
-// 4. decode biosonics two-byte floating format
-double biosonic_float(unsigned char byte1, unsigned char byte2)
+// 4. Decode an expanded ping into row 'row' of a, b and c, reversing
+// the order of samples, so that the first column is the deepest. The
+// beam type is 0 (single-beam), 1 (dual-beam) or 2 (split-beam).
+static void biosonics_store(const unsigned char *buffer, int spp, int type, const std::vector<double>& table,
+    double *a, double *b, double *c, long int nrow, long int row)
 {
-    unsigned int assembled_bytes = ((short)byte2 << 8) | ((short)byte1); // little endian
-    unsigned int mantissa = (assembled_bytes & 0x0FFF); // rightmost 12 bits (again, little endian)
-    int exponent = (assembled_bytes & 0xF000) >> 12; // leftmost 4 bits, shifted to RHS
-    unsigned long res;
-    if (exponent == 0) {
-      res = mantissa;
-    } else {
-      res = (mantissa + 0x1000) << (exponent - 1);
-    }
-//#ifdef DEBUG
-//    Rprintf(" ***  0x%x%x mantissa=%d exponent=%d res=%f\n", byte1, byte2, mantissa, exponent, resp[i]);
-//#endif
-    return((double)res);
-}
-
-// Cross-reference work:
-// 1. update ../src/registerDynamicSymbol.c with an item for this
-// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
-// [[Rcpp::export]]
-List do_biosonics_ping(RawVector bytes, NumericVector Rspp, NumericVector Rns, NumericVector Rtype)
-{
-  int spp = (int)floor(0.5 + Rspp[0]);
-  int ns = (int)floor(0.5 + Rns[0]);
-  int type = (int)floor(0.5 + Rtype[0]); // beam type
-#ifdef DEBUG
-  Rprintf("biosonics_ping() decoded type:%d, spp:%d, ns:%d\n", type, spp, ns);
-#endif
-  int byte_per_sample = 2;
-  if (type == 1 || type == 2) {
-    byte_per_sample = 4;
-  }
-  NumericVector a(spp);
-  NumericVector b(spp);
-  NumericVector c(spp);
-
-  // Get static storage; FIXME: is this thread-safe?
-  biosonics_allocate_storage(spp, byte_per_sample);
   if (type == 0) { // single-beam
-    rle((unsigned char*)&bytes[0], ns, spp, 2);
     for (int k = 0; k < spp; k++) {
-      a[k] = biosonic_float(buffer[byte_per_sample * k], buffer[1 + byte_per_sample * k]);
-      b[k] = 0.0;
-      c[k] = 0.0;
+      long int ij = row + nrow * (spp - 1 - k);
+      a[ij] = table[buffer[2*k] | (buffer[2*k+1] << 8)];
+      if (b) {
+        b[ij] = 0.0;
+        c[ij] = 0.0;
+      }
     }
   } else if (type == 1) { // dual-beam
-    rle((unsigned char*)&bytes[0], ns, spp, 4);
     for (int k = 0; k < spp; k++) {
       // Quote [1 p37 re dual-beam]: "For an RLE-expanded sample x, the low-order
       // word (ie, (USHORT)(x & 0x0000FFFF)) contains the narrow-beam data. The
       // high-order word (ie, (USHORT)((x & 0xFFFF0000) >> 16)) contains the
       // wide beam data."
-      a[k] = biosonic_float(buffer[    byte_per_sample * k], buffer[1 + byte_per_sample * k]);
-      b[k] = biosonic_float(buffer[2 + byte_per_sample * k], buffer[3 + byte_per_sample * k]);
-      b[k] = 0.0;
+      long int ij = row + nrow * (spp - 1 - k);
+      a[ij] = table[buffer[4*k] | (buffer[4*k+1] << 8)];
+      b[ij] = 0.0;
+      c[ij] = 0.0;
     }
-  } else if (type == 2) { // split-beam
-    rle((unsigned char*)&bytes[0], ns, spp, 4);
+  } else { // split-beam
     for (int k = 0; k < spp; k++) {
       // Quote [1 p38 split-beam e.g. 01-Fish.dt4 example]: "the low-order word
       // (ie, (USHORT)(x & 0x0000FFFF)) contains the amplitude data. The
       // high-order byte (ie, (TINY)((x & 0xFF000000) >> 24)) contains the
       // raw X-axis angle data. The other byte
       // (ie, (TINY)((x & 0x00FF0000) >> 16)) contains the raw Y-axis angle data.
-      a[k] = biosonic_float(buffer[byte_per_sample * k], buffer[1 + byte_per_sample * k]);
-      b[k] = (double)buffer[2 + byte_per_sample * k];
-      c[k] = (double)buffer[3 + byte_per_sample * k];
+      long int ij = row + nrow * (spp - 1 - k);
+      a[ij] = table[buffer[4*k] | (buffer[4*k+1] << 8)];
+      b[ij] = (double)buffer[4*k+2];
+      c[ij] = (double)buffer[4*k+3];
     }
-  } else {
+  }
+}
+
+// [[Rcpp::export]]
+List do_biosonics_ping(RawVector bytes, NumericVector Rspp, NumericVector Rns, NumericVector Rtype)
+{
+  int spp = (int)floor(0.5 + Rspp[0]);
+  int ns = (int)floor(0.5 + Rns[0]);
+  int type = (int)floor(0.5 + Rtype[0]); // beam type
+#ifdef DEBUG
+  Rprintf("biosonics_ping() decoded type:%d, spp:%d, ns:%d\n", type, spp, ns);
+#endif
+  if (type < 0 || type > 2)
     ::Rf_error("unknown type, %d", type);
+  int byte_per_sample = type == 0 ? 2 : 4;
+  if (ns * byte_per_sample > bytes.size())
+    ::Rf_error("need %d bytes for %d samples, but got %d", ns * byte_per_sample, ns, (int)bytes.size());
+  NumericVector a(spp);
+  NumericVector b(spp);
+  NumericVector c(spp);
+  std::vector<double> table;
+  biosonic_float_table(table);
+  std::vector<unsigned char> buffer(spp * byte_per_sample);
+  if (spp > 0) {
+    rle((unsigned char*)&bytes[0], ns, spp, byte_per_sample, &buffer[0]);
+    // biosonics_store() reverses the samples, so undo that here
+    std::vector<double> ra(spp), rb(spp), rc(spp);
+    biosonics_store(&buffer[0], spp, type, table, &ra[0], &rb[0], &rc[0], 1, 0);
+    for (int k = 0; k < spp; k++) {
+      a[k] = ra[spp - 1 - k];
+      b[k] = rb[spp - 1 - k];
+      c[k] = rc[spp - 1 - k];
+    }
   }
   return(List::create(Named("a")=a, Named("b")=b, Named("c")=c));
 }
 
+static inline unsigned int biosonics_u16(const unsigned char *p)
+{
+  return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static inline int biosonics_s32(const unsigned char *p)
+{
+  return (int)((unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24));
+}
 
+// The smallest data length N for a tuple of the given type, so that
+// the fields read from it here lie within it. Tuples of other types are
+// not read here.
+static inline long int biosonics_min_length(unsigned char code1, unsigned char code2)
+{
+  if (code1 == 0x15 || code1 == 0x1c || code1 == 0x1d)
+    return 12; // ping: channel, ..., number of samples, then samples
+  if (code1 == 0x0f || (code1 == 0x20 && code2 == 0x00))
+    return 6; // time: seconds, and hundredths in p[9]
+  if (code1 == 0x0e)
+    return 8; // position: latitude, longitude
+  if (code1 == 0x12)
+    return 8; // channel descriptor: channel, pings, samples per ping
+  if (code1 == 0x32)
+    return 20; // bottom pick: flag at p+14, range at p+20
+  return 0;
+}
+
+/*
+
+Decode the pings of a BioSonics file
+
+@description
+
+Walk the tuple stream of a BioSonics DT4 file [1 sec 3.3], and
+run-length expand all the pings for one channel into matrices, for
+read.echosounder(). This replaces R code that called
+do_biosonics_ping() for each ping.
+
+@details
+
+Each tuple holds a 2-byte length N, a 2-byte code, N bytes of data,
+and a 2-byte value that must equal N+6. As in the R code that this
+replaces, the tuple type is determined from the low byte of the code,
+and the stream ends at the second tuple whose code has 0xFF as its high
+byte (the first being the signature at the start of the file). A
+tuple that is too short to hold the fields of its type is skipped,
+and counted in 'badTuples'.
+
+@param buf raw vector holding the file contents.
+
+@param channel integer value indicating which channel to decode,
+counting channel descriptor tuples from 1.
+
+@value a list containing 'a', 'b' and 'c', matrices with one row per
+ping (or per ping in the file, as stated in the channel descriptor, if
+that is larger, in which case extra rows hold NA) and one column per
+sample, with the deepest first; 'time', the time of the latest time
+tuple preceding each ping (0 if there is none); 'timeSlow',
+'latitudeSlow' and 'longitudeSlow', from time and position tuples;
+'range', from bottom-pick tuples; 'beamType', 0, 1 or 2 for a
+single-, dual- or split-beam ping (using the last ping), or -1 if
+there are no pings; 'headerOffset', the offsets (from 0) of file
+header and channel descriptor tuples, to be decoded in R; and
+'badTuples', the number of tuples skipped for being too short.
+
+@references
+
+1. "DT4 Data File Format Specification" [July, 2010] DT4_format_2010.pdf
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_biosonics_file(RawVector buf, IntegerVector channel)
+{
+  const unsigned char *pbuf = &buf[0];
+  long int nbuf = buf.size();
+  int ichannel = channel[0];
+  if (ichannel < 1)
+    Rcpp::stop("channel must be 1 or larger, but it is %d", ichannel);
+  // 1. Walk the tuples, recording the locations of the pings, and the
+  // time in effect for each of them, and decoding the small tuples.
+  // Errors and interrupts are handled with Rcpp::stop() and
+  // Rcpp::checkUserInterrupt(), which throw, so that these vectors
+  // are released.
+  std::vector<long int> pingOffset;
+  std::vector<int> pingType;
+  std::vector<double> time, timeSlow, latitudeSlow, longitudeSlow, range;
+  std::vector<int> headerOffset, channelNumber, channelSpp, channelPings;
+  double timeLast = 0.0;
+  long int offset = 0;
+  int tuple = 1, badTuples = 0;
+  while (offset < nbuf) {
+    if (offset + 4 > nbuf)
+      Rcpp::stop("error reading tuple number %d (file ends within its header)", tuple);
+    const unsigned char *p = pbuf + offset;
+    long int N = biosonics_u16(p);
+    unsigned char code1 = p[2], code2 = p[3];
+    if (code2 == 0xFF && tuple > 1)
+      break; // end of file
+    if (offset + N + 6 > nbuf || (long int)biosonics_u16(p + N + 4) != N + 6)
+      Rcpp::stop("error reading tuple number %d (mismatch in redundant header-length flags)", tuple);
+    if (N < biosonics_min_length(code1, code2)) {
+#ifdef DEBUG
+      Rprintf("skipping tuple %d (code 0x%02x%02x), since it has only %ld bytes\n", tuple, code2, code1, N);
+#endif
+      badTuples++;
+    } else if (code1 == 0x15 || code1 == 0x1c || code1 == 0x1d) {
+      // single-beam, dual-beam, or split-beam ping
+      int thisChannel = biosonics_u16(p + 4);
+      if (ichannel > (int)channelNumber.size())
+        Rcpp::stop("ping in tuple number %d precedes the descriptor for channel %d", tuple, ichannel);
+      if (thisChannel == channelNumber[ichannel - 1]) {
+        pingOffset.push_back(offset);
+        pingType.push_back(code1 == 0x15 ? 0 : (code1 == 0x1c ? 1 : 2));
+        time.push_back(timeLast); // FIXME many pings between times, so this is wrong
+      }
+    } else if (code1 == 0x0f || (code1 == 0x20 && code2 == 0x00)) {
+      // time [1 sec 4.7]
+      double ss = 0.0;
+      if (0x80 & p[9])
+        ss = (float)((int)(0x7F & p[9])) / 100;
+      timeLast = biosonics_s32(p + 4) + ss;
+    } else if (code1 == 0x0e) {
+      // position
+      latitudeSlow.push_back(biosonics_s32(p + 4) / 6e6);
+      longitudeSlow.push_back(biosonics_s32(p + 8) / 6e6);
+      timeSlow.push_back(timeLast);
+    } else if (code1 == 0x12) {
+      // channel descriptor [1 p13]
+      headerOffset.push_back(offset);
+      channelNumber.push_back(biosonics_u16(p + 4));
+      channelPings.push_back(biosonics_s32(p + 6));
+      channelSpp.push_back(biosonics_u16(p + 10));
+    } else if (code1 == 0x1e || code1 == 0x18 || code1 == 0x01) {
+      // V3, V2 or V1 file header
+      headerOffset.push_back(offset);
+    } else if (code1 == 0x32) {
+      // bottom pick [1 sec 4.12]
+      if (biosonics_u16(p + 14)) {
+        float r;
+        memcpy(&r, p + 20, 4); // FIXME: assumes little-endian IEEE, as readBin() did
+        range.push_back(r);
+      } else {
+        range.push_back(NA_REAL);
+      }
+    }
+    offset += N + 6;
+    tuple++;
+  }
+  if (ichannel > (int)channelNumber.size())
+    Rcpp::stop("cannot read channel %d, because the file has only %d channel descriptors",
+        ichannel, (int)channelNumber.size());
+#ifdef DEBUG
+  Rprintf("tuples=%d pings=%ld\n", tuple, (long)pingOffset.size());
+#endif
+
+  // 2. Expand the pings into preallocated matrices.
+  int spp = channelSpp[ichannel - 1];
+  long int nping = pingOffset.size();
+  long int nrow = nping > channelPings[ichannel - 1] ? nping : channelPings[ichannel - 1];
+  bool multibyte = false;
+  for (long int i = 0; i < nping; i++)
+    if (pingType[i] != 0)
+      multibyte = true;
+  NumericMatrix a(nrow, spp);
+  NumericMatrix b(multibyte ? nrow : 0, multibyte ? spp : 0);
+  NumericMatrix c(multibyte ? nrow : 0, multibyte ? spp : 0);
+  std::fill(a.begin(), a.end(), NA_REAL);
+  std::fill(b.begin(), b.end(), NA_REAL);
+  std::fill(c.begin(), c.end(), NA_REAL);
+  std::vector<double> table;
+  biosonic_float_table(table);
+  std::vector<unsigned char> buffer(4 * (spp > 0 ? spp : 1));
+  for (long int i = 0; i < nping; i++) {
+    const unsigned char *p = pbuf + pingOffset[i];
+    int byte_per_sample = pingType[i] == 0 ? 2 : 4;
+    int ns = biosonics_u16(p + 14); // number of samples
+    long int available = ((long int)biosonics_u16(p) - 12) / byte_per_sample;
+    if (ns > available)
+      ns = available > 0 ? (int)available : 0;
+    rle(p + 16, ns, spp, byte_per_sample, &buffer[0]);
+    biosonics_store(&buffer[0], spp, pingType[i], table, &a[0],
+        multibyte ? &b[0] : NULL, multibyte ? &c[0] : NULL, nrow, i);
+    if (i % 1000 == 0)
+      Rcpp::checkUserInterrupt();
+  }
+  return(List::create(Named("a")=a, Named("b")=b, Named("c")=c,
+        Named("time")=NumericVector(time.begin(), time.end()),
+        Named("timeSlow")=NumericVector(timeSlow.begin(), timeSlow.end()),
+        Named("latitudeSlow")=NumericVector(latitudeSlow.begin(), latitudeSlow.end()),
+        Named("longitudeSlow")=NumericVector(longitudeSlow.begin(), longitudeSlow.end()),
+        Named("range")=NumericVector(range.begin(), range.end()),
+        Named("beamType")=nping > 0 ? pingType[nping - 1] : -1,
+        Named("headerOffset")=IntegerVector(headerOffset.begin(), headerOffset.end()),
+        Named("badTuples")=badTuples));
+}
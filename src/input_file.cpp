@@ -0,0 +1,239 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+// See input_file.h for an explanation.
+
+#include "input_file.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#ifdef OCE_HAVE_LZMA
+#include <lzma.h>
+#endif
+
+// Compressed data are read in blocks of this size.
+#define INPUT_FILE_BLOCK (1 << 20)
+
+// Identify the compression from the first few bytes of a file.
+static int input_file_type(const std::string &filename)
+{
+  unsigned char magic[6];
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp)
+    return -1;
+  size_t n = fread(magic, 1, 6, fp);
+  fclose(fp);
+  if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+    return INPUT_FILE_GZIP;
+  if (n == 6 && !memcmp(magic, "\xfd" "7zXZ\0", 6))
+    return INPUT_FILE_XZ;
+  if (n >= 3 && !memcmp(magic, "BZh", 3))
+    return INPUT_FILE_BZIP2;
+  return INPUT_FILE_PLAIN;
+}
+
+// Guess the decompressed size of a file, for the first allocation of
+// the output buffer, which is doubled if need be. For gzip, the last
+// 4 bytes hold the size (modulo 2^32) of the last member, which is the
+// whole file in the usual case; otherwise, assume a ratio of 3.
+static size_t input_file_guess(FILE *fp, int type)
+{
+  long n = 0;
+  if (fseek(fp, 0, SEEK_END) == 0)
+    n = ftell(fp);
+  size_t guess = n > 0 ? 3 * (size_t)n : 0;
+  if (type == INPUT_FILE_GZIP && n >= 18 && fseek(fp, -4, SEEK_END) == 0) {
+    unsigned char isize[4];
+    if (4 == fread(isize, 1, 4, fp)) {
+      size_t s = isize[0] | (isize[1] << 8) | (isize[2] << 16) | ((size_t)isize[3] << 24);
+      if (s >= (size_t)n / 2)
+        guess = s;
+    }
+  }
+  fseek(fp, 0, SEEK_SET);
+  return guess + INPUT_FILE_BLOCK;
+}
+
+InputFile::InputFile(const std::string &filename)
+  : mapped(NULL), buf(NULL), len(0), cap(0), type(INPUT_FILE_PLAIN), is_ok(false)
+{
+  type = input_file_type(filename);
+  if (type < 0) {
+    msg = "cannot open file";
+    return;
+  }
+  if (type == INPUT_FILE_PLAIN) {
+    mapped = new MappedFile(filename);
+    is_ok = mapped->ok();
+    if (!is_ok)
+      msg = "cannot map file";
+  } else if (type == INPUT_FILE_GZIP) {
+    is_ok = inflate_gzip(filename);
+  } else if (type == INPUT_FILE_XZ) {
+#ifdef OCE_HAVE_LZMA
+    is_ok = inflate_xz(filename);
+#else
+    msg = "xz-compressed files are not supported, since oce was built without liblzma; please use gzip";
+#endif
+  } else {
+    msg = "bzip2-compressed files are not supported; please use gzip or xz";
+  }
+  if (!is_ok)
+    close();
+}
+
+// Ensure room for at least n more bytes of output. realloc() is used,
+// instead of a std::vector, so that the storage is neither zeroed nor
+// copied needlessly as it grows.
+bool InputFile::grow(size_t n)
+{
+  if (cap - len >= n)
+    return true;
+  size_t newcap = cap ? cap : n;
+  while (newcap - len < n)
+    newcap *= 2;
+  unsigned char *p = (unsigned char*)realloc(buf, newcap);
+  if (!p) {
+    msg = "cannot allocate storage for decompressed data";
+    return false;
+  }
+  buf = p;
+  cap = newcap;
+  return true;
+}
+
+// Decompress a gzip file, which may hold several gzip members, one
+// after the other, as made by e.g. 'cat a.gz b.gz'.
+bool InputFile::inflate_gzip(const std::string &filename)
+{
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp) {
+    msg = "cannot open file";
+    return false;
+  }
+  if (!grow(input_file_guess(fp, INPUT_FILE_GZIP))) {
+    fclose(fp);
+    return false;
+  }
+  unsigned char *in = (unsigned char*)malloc(INPUT_FILE_BLOCK);
+  z_stream zs;
+  memset(&zs, 0, sizeof(zs));
+  if (!in || inflateInit2(&zs, 15 + 32) != Z_OK) { // 32: expect a gzip or zlib header
+    free(in);
+    fclose(fp);
+    msg = "cannot initialize zlib";
+    return false;
+  }
+  int status = Z_OK;
+  bool eof = false;
+  while (1) {
+    if (zs.avail_in < 2 && !eof) {
+      // Keep any leftover byte, which may start the next member.
+      if (zs.avail_in)
+        in[0] = zs.next_in[0];
+      size_t got = fread(in + zs.avail_in, 1, INPUT_FILE_BLOCK - zs.avail_in, fp);
+      eof = got == 0;
+      zs.avail_in += (uInt)got;
+      zs.next_in = in;
+    }
+    if (status == Z_STREAM_END) {
+      // Another member may follow; if only padding follows, stop.
+      if (zs.avail_in < 2 || zs.next_in[0] != 0x1f || zs.next_in[1] != 0x8b)
+        break;
+      inflateReset(&zs);
+    }
+    if (eof && zs.avail_in == 0)
+      break;
+    if (!grow(INPUT_FILE_BLOCK)) {
+      status = Z_MEM_ERROR;
+      break;
+    }
+    zs.next_out = buf + len;
+    zs.avail_out = (uInt)INPUT_FILE_BLOCK;
+    status = inflate(&zs, Z_NO_FLUSH);
+    len += INPUT_FILE_BLOCK - zs.avail_out;
+    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+      break;
+  }
+  inflateEnd(&zs);
+  free(in);
+  fclose(fp);
+  if (status == Z_MEM_ERROR)
+    return false;
+  if (status != Z_STREAM_END) {
+    msg = "gzip data are damaged or incomplete";
+    return false;
+  }
+  return true;
+}
+
+#ifdef OCE_HAVE_LZMA
+// Decompress an xz file, which may hold several xz streams. This is
+// only built if the configure script found liblzma.
+bool InputFile::inflate_xz(const std::string &filename)
+{
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp) {
+    msg = "cannot open file";
+    return false;
+  }
+  if (!grow(input_file_guess(fp, INPUT_FILE_XZ))) {
+    fclose(fp);
+    return false;
+  }
+  unsigned char *in = (unsigned char*)malloc(INPUT_FILE_BLOCK);
+  lzma_stream xs = LZMA_STREAM_INIT;
+  if (!in || lzma_stream_decoder(&xs, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+    free(in);
+    fclose(fp);
+    msg = "cannot initialize liblzma";
+    return false;
+  }
+  lzma_action action = LZMA_RUN;
+  lzma_ret status = LZMA_OK;
+  while (1) {
+    if (xs.avail_in == 0 && action == LZMA_RUN) {
+      xs.avail_in = fread(in, 1, INPUT_FILE_BLOCK, fp);
+      xs.next_in = in;
+      if (xs.avail_in == 0)
+        action = LZMA_FINISH;
+    }
+    if (!grow(INPUT_FILE_BLOCK)) {
+      status = LZMA_MEM_ERROR;
+      break;
+    }
+    xs.next_out = buf + len;
+    xs.avail_out = INPUT_FILE_BLOCK;
+    status = lzma_code(&xs, action);
+    len += INPUT_FILE_BLOCK - xs.avail_out;
+    if (status != LZMA_OK)
+      break;
+  }
+  lzma_end(&xs);
+  free(in);
+  fclose(fp);
+  if (status == LZMA_MEM_ERROR)
+    return false;
+  if (status != LZMA_STREAM_END) {
+    msg = "xz data are damaged or incomplete";
+    return false;
+  }
+  return true;
+}
+#endif
+
+void InputFile::close()
+{
+  if (mapped) {
+    delete mapped;
+    mapped = NULL;
+  }
+  free(buf);
+  buf = NULL;
+  len = cap = 0;
+}
+
+InputFile::~InputFile()
+{
+  close();
+}
@@ -0,0 +1,59 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+// Whole-file input for the binary scanners and the text readers, which
+// may be handed either a plain file or one that has been compressed
+// with gzip or xz.
+//
+// A plain file is memory-mapped, with MappedFile. A compressed file is
+// recognized by its leading bytes (not its name), and is decompressed
+// in large blocks, directly into memory, so that no temporary file is
+// written. In either case, the scanners see one contiguous buffer,
+// so their resynchronization and checksum logic is unaffected by the
+// block structure of the compressed stream.
+//
+// Reading xz files requires liblzma, and is enabled by defining
+// OCE_HAVE_LZMA, which the configure script does if liblzma is found.
+//
+// As with MappedFile, callers should call close() before ::Rf_error(),
+// and an empty file is not an error. If ok() is false, message()
+// explains why.
+
+#ifndef OCE_INPUT_FILE_H
+#define OCE_INPUT_FILE_H
+
+#include <stddef.h>
+#include <string>
+#include "mapped_file.h"
+
+#define INPUT_FILE_PLAIN 0
+#define INPUT_FILE_GZIP 1
+#define INPUT_FILE_XZ 2
+#define INPUT_FILE_BZIP2 3
+
+class InputFile {
+public:
+  InputFile(const std::string &filename);
+  ~InputFile();
+  bool ok() const { return is_ok; }
+  const unsigned char *data() const { return mapped ? mapped->data() : buf; }
+  size_t size() const { return mapped ? mapped->size() : len; }
+  int compression() const { return type; }
+  const char *message() const { return msg.c_str(); }
+  void close();
+private:
+  InputFile(const InputFile&);            // not copyable
+  InputFile& operator=(const InputFile&); // not assignable
+  bool inflate_gzip(const std::string &filename);
+#ifdef OCE_HAVE_LZMA
+  bool inflate_xz(const std::string &filename);
+#endif
+  bool grow(size_t n);
+  MappedFile *mapped;
+  unsigned char *buf; // decompressed data, if not mapped
+  size_t len, cap;
+  int type;
+  bool is_ok;
+  std::string msg;
+};
+
+#endif
@@ -1,6 +1,9 @@
 /* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
 
 #include <Rcpp.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 using namespace Rcpp;
 
 // Cross-reference work:
@@ -155,3 +158,111 @@ List do_landsat_numeric_to_bytes(NumericMatrix m, IntegerVector bits)
 #endif
   return(List::create(Named("lsb")=lsb, Named("msb")=msb));
 }
+
+// Side length of the square output tiles used by do_landsat_band().
+// 64x64 tiles keep both the strided reads and the contiguous writes of
+// one tile within L1/L2 cache.
+#define LANDSAT_TILE 64
+
+/*
+
+   Convert a band, as read by tiff::readTIFF(), to the raw storage used
+   by read.landsat(), in a single pass.
+
+   This fuses do_landsat_numeric_to_bytes() and
+   do_landsat_transpose_flip(), and also does the decimation that
+   read.landsat() used to do with seq.int(..., by=decimate), plus an
+   optional crop as done by landsatTrim(). The output is filled in
+   square tiles, so the reads from 'm' stay in cache, and the tiles are
+   shared out across threads.
+
+   @param m numeric matrix of values in [0,1], as from readTIFF().
+
+   @param bits integer, either 8 or 16. For 16, the msb matrix has the
+   same dimension as lsb; for 8 it is a 1x1 matrix holding 0.
+
+   @param decimate integer step for subsampling both dimensions of 'm',
+   with the meaning of seq.int(1, dim, by=decimate).
+
+   @param ilim,jlim integer vectors of length 2 holding the 1-based,
+   inclusive range of the output (i.e. the transposed, flipped and
+   decimated) matrix that is to be retained. Use NA to retain all.
+
+   @param nthreads integer giving the number of threads to use.
+
+   @value a list containing raw matrices 'lsb' and 'msb'.
+
+*/
+
+// [[Rcpp::export]]
+List do_landsat_band(NumericMatrix m, IntegerVector bits, IntegerVector decimate,
+    IntegerVector ilim, IntegerVector jlim, IntegerVector nthreads)
+{
+  int nrow = m.nrow();
+  int ncol = m.ncol();
+  int two_byte = bits[0] > 8;
+  int dec = decimate[0] < 1 ? 1 : decimate[0];
+  int nthreads_value = nthreads[0] < 1 ? 1 : nthreads[0];
+  // Dimension of the output before cropping: the number of rows and
+  // columns that seq.int(1, dim, by=dec) selects, swapped.
+  int nrow_dec = (nrow + dec - 1) / dec;
+  int ncol_dec = (ncol + dec - 1) / dec;
+  int i0 = 0, i1 = ncol_dec - 1, j0 = 0, j1 = nrow_dec - 1;
+  if (ilim.size() == 2 && ilim[0] != NA_INTEGER && ilim[1] != NA_INTEGER) {
+    i0 = ilim[0] - 1;
+    i1 = ilim[1] - 1;
+  }
+  if (jlim.size() == 2 && jlim[0] != NA_INTEGER && jlim[1] != NA_INTEGER) {
+    j0 = jlim[0] - 1;
+    j1 = jlim[1] - 1;
+  }
+  if (i0 < 0 || i1 >= ncol_dec || i1 < i0 || j0 < 0 || j1 >= nrow_dec || j1 < j0)
+    ::Rf_error("ilim=%d:%d and jlim=%d:%d must lie within the %dx%d decimated image",
+        i0 + 1, i1 + 1, j0 + 1, j1 + 1, ncol_dec, nrow_dec);
+  int nout = i1 - i0 + 1;
+  int mout = j1 - j0 + 1;
+#ifdef DEBUG
+  Rprintf("do_landsat_band() nrow=%d ncol=%d dec=%d -> %dx%d (crop i=%d:%d j=%d:%d) nthreads=%d\n",
+      nrow, ncol, dec, nout, mout, i0 + 1, i1 + 1, j0 + 1, j1 + 1, nthreads_value);
+#endif
+  RawMatrix lsb(nout, mout);
+  RawMatrix msb(two_byte ? nout : 1, two_byte ? mout : 1);
+  // Use bare pointers, so no R data structures are touched in the
+  // threaded loop below.
+  const double *pm = &m[0];
+  unsigned char *plsb = &lsb[0];
+  unsigned char *pmsb = &msb[0];
+  if (!two_byte)
+    pmsb[0] = 0;
+  int ntile_i = (nout + LANDSAT_TILE - 1) / LANDSAT_TILE;
+  int ntile_j = (mout + LANDSAT_TILE - 1) / LANDSAT_TILE;
+  int ntile = ntile_i * ntile_j;
+  // Output element (i, j) comes from element
+  // (nrow_dec-1-(j+j0))*dec, (i+i0)*dec of 'm' (0-based), i.e. the
+  // transpose of the decimated matrix, flipped in its second dimension.
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads_value) schedule(static)
+#endif
+  for (int t = 0; t < ntile; t++) {
+    int ti = (t % ntile_i) * LANDSAT_TILE;
+    int tj = (t / ntile_i) * LANDSAT_TILE;
+    int ti_end = ti + LANDSAT_TILE < nout ? ti + LANDSAT_TILE : nout;
+    int tj_end = tj + LANDSAT_TILE < mout ? tj + LANDSAT_TILE : mout;
+    for (int j = tj; j < tj_end; j++) {
+      const double *src = pm + (size_t)(nrow_dec - 1 - (j + j0)) * dec;
+      size_t o = (size_t)j * nout;
+      if (two_byte) {
+        for (int i = ti; i < ti_end; i++) {
+          unsigned int v = (unsigned int)(65535 * src[(size_t)(i + i0) * dec * nrow]);
+          plsb[o + i] = v & 0x00FF;
+          pmsb[o + i] = (v & 0xFF00) >> 8;
+        }
+      } else {
+        for (int i = ti; i < ti_end; i++) {
+          plsb[o + i] = (unsigned char)(unsigned int)(255 * src[(size_t)(i + i0) * dec * nrow]);
+        }
+      }
+    }
+  }
+  return(List::create(Named("lsb")=lsb, Named("msb")=msb));
+}
@@ -1,6 +1,15 @@
 /* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
 
 #include <Rcpp.h>
+#include <string.h>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "mapped_file.h"
+#include "input_file.h"
+#include "scan_diagnostics.h"
+#include "checksum.h"
 using namespace Rcpp;
 
 // Cross-reference work:
@@ -40,18 +49,31 @@ int ID_ALLOWED[NID_ALLOWED]={21, 22, 23, 24, 26, 27, 28, 29, 30, 31, 160};
    a value of 1 means to retrieve all the profiles, while a value of 2
    means to get every second profile.
 
-   @value a list containing 'index', 'length' and 'id'. The last of
+   @param nthreads integer giving the number of threads to use. If
+   this exceeds 1, and if the file is large, it is split into segments
+   that are scanned in parallel (see ad2cp_scan()). The result does
+   not depend on the number of threads.
+
+   @param parallelMinBytes numeric giving the smallest file, in bytes,
+   that is split for a parallel scan. A negative value means
+   AD2CP_PARALLEL_MIN_BYTES (16MB). The tests set this to 0, to
+   exercise the parallel scan on small files.
+
+   @value a list containing 'index', 'length' and 'id'. The first two
+   are numeric, so that offsets past 2GB are representable. The last of
    these mean: 0x16=21 for Burst Data Record; 0x16=22 for Average Data
    Record; 0x17=23 for Bottom Track Data Record; 0x18=24 for
    Interleaved Burst Data Record (beam 5); 0xA0=160 forString Data
-   Record, eg. GPS NMEA data, comment from the FWRITE command.
+   Record, eg. GPS NMEA data, comment from the FWRITE command. The list
+   also holds 'diagnostics', a list of counts of the problems found in
+   scanning the file (see scan_diagnostics.h).
 
    @examples
 
    system("R CMD SHLIB ldc_ad2cp_in_file.c")
    f <- "/Users/kelley/Dropbox/oce_ad2cp/labtestsig3.ad2cp"
    dyn.load("ldc_ad2cp_in_file.so")
-   a <- .Call("ldc_ad2cp_in_file", f, 1, 10, 1)
+   a <- .Call("ldc_ad2cp_in_file", f, 1, 10, 1, 1)
 
 @section: notes
 
@@ -97,36 +119,247 @@ Dan Kelley
 
 */
 
-// Check the header checksum.
+// Compute a header or data checksum.
 //
 // The code for this differs from that suggested by Nortek,
 // because we don't use a specific (msoft) compiler, so we
-// do not have access to misaligned_load16(). Also, I don't
-// think this will work properly if the number of bytes
-// is odd.
-//
-// FIXME: handle odd-numbered byte case.
-unsigned short cs(unsigned char *data, unsigned short size)
+// do not have access to misaligned_load16(). For an odd
+// number of bytes, the last byte is added as the high byte
+// of a final word, as in the code given in [1].
+static inline unsigned short cs(const unsigned char *data, unsigned short size)
 {
   // It might be worth checking the matlab code at
   //     https://github.com/aodn/imos-toolbox/blob/master/Parser/readAD2CPBinary.m
   // for context, if problems ever arise.
-  unsigned short checksum = 0xB58C;
-  for (int i = 0; i < size; i += 2) {
-    checksum += (unsigned short)data[i] + 256*(unsigned short)data[i+1];
+  return (unsigned short)(0xB58C + oce_sum_words_le(data, size));
+}
+
+// A record found by ad2cp_follow(). 'index' is the offset of the data,
+// just past the header, and the checksum items are saved so that any
+// warnings can be issued after the scan, in file order. Offsets are
+// held in size_t, since files may exceed 4GB.
+typedef struct {
+  size_t index;
+  size_t length;
+  unsigned int id;
+  unsigned short header_checksum, header_checksum_wanted;
+  unsigned short data_checksum, data_checksum_wanted;
+} ad2cp_record;
+
+// Return values of ad2cp_follow()
+#define AD2CP_SEGMENT_END 0 // reached a record starting at or beyond 'end'
+#define AD2CP_MAXREC 1 // found 'maxrec' records
+#define AD2CP_SHORT 2 // fewer than HEADER_SIZE bytes remain
+#define AD2CP_NOSYNC 3 // a header does not start with SYNC
+#define AD2CP_TRUNCATED 4 // the file ends within a data record
+
+// Follow the chain of records in the mapped file 'p' (of length 'n'),
+// starting with a header at offset 'pos' and stopping at the first
+// record that starts at or beyond 'end', or when 'rec' holds 'maxrec'
+// records. Each header is followed by the number of data bytes that
+// it states, unless it is not an AD2CP header (i.e. if the header
+// size or family is wrong), in which case the next header is assumed
+// to follow immediately; such records are stored with zero index,
+// length and id. The position where the chain stops is stored in
+// *stop. No R functions are called, so this may be run in a thread.
+static int ad2cp_follow(const unsigned char *p, size_t n, size_t pos, size_t end,
+    size_t maxrec, std::vector<ad2cp_record> &rec, size_t *stop)
+{
+  int status = AD2CP_SEGMENT_END;
+  while (1) {
+    if (pos >= end) {
+      status = AD2CP_SEGMENT_END;
+      break;
+    }
+    if (rec.size() >= maxrec) {
+      status = AD2CP_MAXREC;
+      break;
+    }
+    if (n - pos < HEADER_SIZE) {
+      status = AD2CP_SHORT;
+      break;
+    }
+    const unsigned char *hbuf = p + pos;
+#if defined(DEBUG) && DEBUG > 1
+    Rprintf("buf: 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n",
+        hbuf[0], hbuf[1], hbuf[2], hbuf[3], hbuf[4],
+        hbuf[5], hbuf[6], hbuf[7], hbuf[8], hbuf[9]);
+#endif
+    // It's prudent to check.
+    if (hbuf[0] != SYNC) {
+      status = AD2CP_NOSYNC;
+      break;
+    }
+    ad2cp_record r;
+    memset(&r, 0, sizeof(r));
+    // Check that it's an actual header
+    if (hbuf[1] == HEADER_SIZE && hbuf[3] == FAMILY) {
+      unsigned int dataSize = hbuf[4] + 256 * hbuf[5];
+      if (n - pos - HEADER_SIZE < dataSize) {
+        status = AD2CP_TRUNCATED;
+        break;
+      }
+      r.index = pos + HEADER_SIZE;
+      r.length = dataSize;
+      r.id = hbuf[2];
+      r.header_checksum = cs(hbuf, HEADER_SIZE-2);
+      r.header_checksum_wanted = hbuf[8] + 256 * hbuf[9];
+      r.data_checksum = cs(hbuf + HEADER_SIZE, dataSize);
+      r.data_checksum_wanted = hbuf[6] + 256 * hbuf[7];
+      pos += dataSize;
+    }
+    pos += HEADER_SIZE;
+    rec.push_back(r);
+  }
+  *stop = pos;
+  return status;
+}
+
+// Is there a header at p[pos], with correct SYNC, size, family and
+// checksum? This is used to find a starting point for each segment of
+// the file, in a parallel scan.
+static inline int ad2cp_is_header(const unsigned char *p, size_t n, size_t pos)
+{
+  return n - pos >= HEADER_SIZE && p[pos] == SYNC && p[pos+1] == HEADER_SIZE
+    && p[pos+3] == FAMILY && cs(p + pos, HEADER_SIZE-2) == p[pos+8] + 256 * p[pos+9];
+}
+
+// A file is only split into segments for a parallel scan if it is at
+// least this large, unless do_ldc_ad2cp_in_file() is told otherwise
+// (as the tests do, to exercise the parallel scan on small files).
+#ifndef AD2CP_PARALLEL_MIN_BYTES
+#define AD2CP_PARALLEL_MIN_BYTES 16777216
+#endif
+
+/*
+
+Scan the records in the mapped file 'p' of length 'n', starting at
+offset 'start', storing up to 'maxrec' of them in 'rec'. The return
+value is as for ad2cp_follow(), and *stop is the stopping position.
+
+If 'nthreads' exceeds 1, and at least 'min_bytes' remain to be
+scanned, the file is split into that many segments, each scanned in
+its own thread. A thread starts at the first valid header (with
+checksum) at or after the start of its segment, and follows the
+record chain until it passes the end of the segment. The
+segment results are then joined, in order, checking that each segment
+starts where the chain of the previous one left off. This will be the
+case unless a segment started at a spurious header, in which case that
+segment is scanned again, from the correct place, in the main thread.
+The result is thus the same as for a single-threaded scan.
+
+*/
+static int ad2cp_scan(const unsigned char *p, size_t n, size_t start, size_t maxrec,
+    int nthreads, size_t min_bytes, std::vector<ad2cp_record> &rec, size_t *stop)
+{
+#ifdef _OPENMP
+  if (nthreads > 1 && n - start >= min_bytes) {
+    int nseg = nthreads;
+    std::vector<size_t> seg_start(nseg + 1), seg_first(nseg), seg_stop(nseg);
+    std::vector<int> seg_status(nseg);
+    std::vector<std::vector<ad2cp_record> > seg_rec(nseg);
+    for (int k = 0; k <= nseg; k++)
+      seg_start[k] = start + (n - start) / nseg * k;
+    seg_start[nseg] = n;
+#pragma omp parallel for num_threads(nthreads) schedule(static, 1)
+    for (int k = 0; k < nseg; k++) {
+      size_t first = seg_start[k];
+      if (k > 0) {
+        while (first < seg_start[k+1]) {
+          const unsigned char *q = (const unsigned char*)memchr(p + first, SYNC, seg_start[k+1] - first);
+          if (!q) {
+            first = seg_start[k+1];
+            break;
+          }
+          first = q - p;
+          if (ad2cp_is_header(p, n, first))
+            break;
+          first++;
+        }
+      }
+      seg_first[k] = first;
+      if (first < seg_start[k+1])
+        seg_status[k] = ad2cp_follow(p, n, first, seg_start[k+1], maxrec, seg_rec[k], &seg_stop[k]);
+    }
+    // Join the segments. 'pos' is where the chain leaves off.
+    size_t pos = start;
+    for (int k = 0; k < nseg; k++) {
+      if (pos >= seg_start[k+1])
+        continue; // a record spans the whole segment
+      int status;
+      if (seg_first[k] == pos) {
+        size_t room = maxrec - rec.size();
+        if (seg_rec[k].size() > room) {
+          rec.insert(rec.end(), seg_rec[k].begin(), seg_rec[k].begin() + room);
+          status = AD2CP_MAXREC;
+        } else {
+          rec.insert(rec.end(), seg_rec[k].begin(), seg_rec[k].end());
+          status = seg_status[k];
+        }
+        *stop = seg_stop[k];
+      } else {
+#ifdef DEBUG
+        Rprintf("rescanning segment %d from %.0f, since it was started at %.0f\n", k, (double)pos, (double)seg_first[k]);
+#endif
+        status = ad2cp_follow(p, n, pos, seg_start[k+1], maxrec, rec, stop);
+      }
+      std::vector<ad2cp_record>().swap(seg_rec[k]);
+      pos = *stop;
+      if (status != AD2CP_SEGMENT_END)
+        return status;
+    }
+    return AD2CP_SEGMENT_END;
   }
-  return(checksum);
+#endif
+  return ad2cp_follow(p, n, start, n, maxrec, rec, stop);
 }
 
+// Count records with unknown ids, or with bad checksums, and headers
+// that are not of the AD2CP type, in 'diag'. The records in 'rec'
+// form a chain starting at offset 'pos'. This is done after the
+// scan, so that the events are in file order, even for a parallel
+// scan.
+static void ad2cp_diagnose(const std::vector<ad2cp_record> &rec, size_t pos, ScanDiagnostics &diag)
+{
+  for (size_t i = 0; i < rec.size(); i++) {
+    const ad2cp_record &r = rec[i];
+    if (r.index == 0) {
+      diag.event(SCAN_BAD_HEADER, pos);
+      pos += HEADER_SIZE;
+      continue;
+    }
+    int found = 0;
+    for (int idi = 0; idi < NID_ALLOWED; idi++) {
+      if ((int)r.id == ID_ALLOWED[idi]) {
+        found = 1;
+        break;
+      }
+    }
+    if (!found)
+      diag.event(SCAN_BAD_ID, pos);
+    if (r.header_checksum != r.header_checksum_wanted
+        || r.data_checksum != r.data_checksum_wanted)
+      diag.event(SCAN_CHECKSUM, pos);
+#if defined(DEBUG)
+    if (!found)
+      Rprintf("warning: odd id (%d) at chunk %d, index=%.0f\n", r.id, (int)i, (double)r.index);
+    if (r.header_checksum != r.header_checksum_wanted)
+      Rprintf("warning: at cindex=%.0f, header checksum is %d but it should be %d\n",
+          (double)r.index, r.header_checksum, r.header_checksum_wanted);
+    if (r.data_checksum != r.data_checksum_wanted)
+      Rprintf("warning: at cindex=%.0f, data checksum is %d but it should be %d\n",
+          (double)r.index, r.data_checksum, r.data_checksum_wanted);
+#endif
+    diag.record(pos, HEADER_SIZE + r.length);
+    pos += HEADER_SIZE + r.length;
+  }
+}
 
 // [[Rcpp::export]]
-List do_ldc_ad2cp_in_file(CharacterVector filename, IntegerVector from, IntegerVector to, IntegerVector by)
+List do_ldc_ad2cp_in_file(CharacterVector filename, IntegerVector from, IntegerVector to, IntegerVector by,
+    IntegerVector nthreads, NumericVector parallelMinBytes)
 {
   std::string fn = Rcpp::as<std::string>(filename(0));
-  FILE *fp = fopen(fn.c_str(), "rb");
-  if (!fp)
-    ::Rf_error("cannot open file '%s'\n", fn.c_str());
-
   if (from[0] < 0)
     ::Rf_error("'from' must be positive but it is %d", from[0]);
   unsigned int from_value = from[0];
@@ -136,144 +369,212 @@ List do_ldc_ad2cp_in_file(CharacterVector filename, IntegerVector from, IntegerV
   if (by[0] < 0)
     ::Rf_error("'by' must be positive but it is %d", by[0]);
   unsigned int by_value = by[0];
+  int nthreads_value = nthreads[0] < 1 ? 1 : nthreads[0];
+  size_t min_bytes = parallelMinBytes[0] < 0 ? AD2CP_PARALLEL_MIN_BYTES : (size_t)parallelMinBytes[0];
 #if defined(DEBUG)
-  Rprintf("from=%d, to=%d, by=%d\n", from_value, to_value, by_value);
+  Rprintf("from=%d, to=%d, by=%d, nthreads=%d\n", from_value, to_value, by_value, nthreads_value);
+#else
+  (void)from_value;
+  (void)by_value;
 #endif
-
-  // FIXME: should we just get this from R? and do we even need it??
-  fseek(fp, 0L, SEEK_END);
-  unsigned long int fileSize = ftell(fp);
-  fseek(fp, 0L, SEEK_SET);
+  InputFile mf(fn);
+  if (!mf.ok())
+    ::Rf_error("cannot read file '%s' (%s)\n", fn.c_str(), mf.message());
+  const unsigned char *p = mf.data();
+  size_t fileSize = mf.size();
 #if defined(DEBUG)
-  Rprintf("fileSize=%d\n", fileSize);
+  Rprintf("fileSize=%.0f\n", (double)fileSize);
 #endif
-  unsigned int chunk = 0;
-  unsigned int cindex = 0;
 
   // Ensure that the first byte we point to equals SYNC.
   // In a conventional file, starting with a SYNC char, this
-  // just gets a byte and puts it back, leaving cindex=0.
-  // But if the file does not start with a SYNC char, e.g.
-  // if this is a fragment, we step through the file
-  // until we find a SYNC, setting cindex appropriately.
-  int c;
-  while (1) {
-    c = getc(fp);
-    if (EOF == c) {
-      ::Rf_error("this file does not contain a single 0x", SYNC, " byte");
-      break;
-    }
-    // // Extremely low-level debugging.
-    // #if defined(DEBUG) && DEBUG > 3
-    //     Rprintf("< c=0x%x\n", c);
-    // #endif
-    if (SYNC == c) {
-      fseek(fp, -1, SEEK_CUR);
-      break;
-    }
-    cindex++;
+  // is the first byte. But if the file does not start with a
+  // SYNC char, e.g. if this is a fragment, we step through
+  // the file until we find a SYNC.
+  const unsigned char *first = fileSize ? (const unsigned char*)memchr(p, SYNC, fileSize) : NULL;
+  if (!first) {
+    mf.close();
+    ::Rf_error("this file does not contain a single 0x%x byte", SYNC);
   }
-  // The table in [1 sec 6.1] says header pieces are 10 bytes
-  // long, so once we get an 0xA5, we'll try to get 9 more bytes.
-  unsigned char hbuf[HEADER_SIZE]; // header buffer
-  unsigned int dbuflen = 10000; // may be increased later
-  unsigned char *dbuf = (unsigned char *)Calloc((size_t)dbuflen, unsigned char);
-  unsigned int nchunk = 100000;
-  unsigned int *index_buf = (unsigned int*)Calloc((size_t)nchunk, unsigned int);
-  unsigned int *length_buf = (unsigned int*)Calloc((size_t)nchunk, unsigned int);
-  unsigned int *id_buf = (unsigned int*)Calloc((size_t)nchunk, unsigned int);
-  while (chunk < to_value) {// FIXME: use whole file here
-    if (chunk > nchunk - 1) {
-#if defined(DEBUG)
-      Rprintf("about to increase buffer size from %d\n", nchunk);
-#endif
-      nchunk = (unsigned int) chunk * 2; // double buffer size
-      index_buf = (unsigned int*)Realloc(index_buf, nchunk, unsigned int);
-      length_buf = (unsigned int*)Realloc(length_buf, nchunk, unsigned int);
-      id_buf = (unsigned int*)Realloc(id_buf, nchunk, unsigned int);
-#if defined(DEBUG)
-      Rprintf("successfully increased buffer size to %d\n", nchunk);
-#endif
-    }
-    int id;
-    unsigned int dataSize;
-    unsigned short dataChecksum, headerChecksum;
-    size_t bytes_read;
-    bytes_read = fread(hbuf, 1, HEADER_SIZE, fp);
-    if (bytes_read != HEADER_SIZE) {
-      if (cindex != fileSize)
-        Rprintf("warning: cannot read record starting at byte %d of a %d-byte file. This may mean that the file is incomplete.\n", cindex, fileSize);
-      break;
+  int status;
+  size_t stop;
+  NumericVector index, length;
+  IntegerVector id;
+  ScanDiagnostics diag;
+  {
+    std::vector<ad2cp_record> rec;
+    status = ad2cp_scan(p, fileSize, first - p, to_value, nthreads_value, min_bytes, rec, &stop);
+    size_t chunk = rec.size();
+    ad2cp_diagnose(rec, first - p, diag);
+    if (status != AD2CP_NOSYNC && status != AD2CP_TRUNCATED) {
+      index = NumericVector(chunk);
+      length = NumericVector(chunk);
+      id = IntegerVector(chunk);
+      for (size_t i = 0; i < chunk; i++) {
+        index[i] = (double)rec[i].index;
+        length[i] = (double)rec[i].length;
+        id[i] = rec[i].id;
+      }
     }
-    cindex += bytes_read;
-#if defined(DEBUG) && DEBUG > 1
-      Rprintf("buf: 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n",
-          hbuf[0], hbuf[1], hbuf[2], hbuf[3], hbuf[4],
-          hbuf[5], hbuf[6], hbuf[7], hbuf[8], hbuf[9]);
-#endif
-    // It's prudent to check.
-    if (hbuf[0] != SYNC) {
-      ::Rf_error("coding error in reading the header at cindex=%d; expecting 0x%x but found 0x%x\n",
-          cindex, SYNC, hbuf[0]);
+  }
+  if (status == AD2CP_SHORT && stop != fileSize)
+    diag.event(SCAN_TRUNCATED, stop);
+  if (status == AD2CP_NOSYNC) {
+    int c = p[stop];
+    mf.close();
+    ::Rf_error("coding error in reading the header at cindex=%.0f; expecting 0x%x but found 0x%x\n",
+        (double)(stop + HEADER_SIZE), SYNC, c);
+  }
+  if (status == AD2CP_TRUNCATED) {
+    int dataSize = p[stop+4] + 256 * p[stop+5];
+    mf.close();
+    ::Rf_error("ran out of file on data chunk near cindex=%.0f; wanted %d bytes but got only %.0f\n",
+        (double)(stop + HEADER_SIZE), dataSize, (double)(fileSize - stop - HEADER_SIZE));
+  }
+  mf.close();
+  diag.finish(stop < fileSize ? stop : fileSize);
+  return(List::create(Named("index")=index, Named("length")=length, Named("id")=id,
+        Named("diagnostics")=diag.as_list()));
+}
+
+// State of a tail-following scan, for a file that is still being
+// written. 'good' is the offset of the header after the last complete
+// record (or 0, if no SYNC byte has been seen yet), and 'nrecord'
+// counts the records found so far.
+typedef struct {
+  std::string filename;
+  size_t good;
+  unsigned long int nrecord;
+  int started;
+} ad2cp_follow_state;
+
+/*
+
+Open a tail-following scan of a Nortek AD2CP file
+
+@description
+
+Create a handle for do_ldc_ad2cp_follow(), which reads the records
+that have been appended to a file since the previous call. This is
+meant for files that are still being written, e.g. by an instrument
+that is connected by a cable.
+
+@param filename character string indicating the file name. The file
+need not exist yet.
+
+@value an external pointer, which is to be handed to
+do_ldc_ad2cp_follow(). It holds the file name, the position of the
+header after the last complete record, and the number of records
+found so far.
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+SEXP do_ldc_ad2cp_follow_open(CharacterVector filename)
+{
+  ad2cp_follow_state *state = new ad2cp_follow_state;
+  state->filename = Rcpp::as<std::string>(filename(0));
+  state->good = 0;
+  state->nrecord = 0;
+  state->started = 0;
+  XPtr<ad2cp_follow_state> handle(state, true);
+  return(handle);
+}
+
+/*
+
+Read the records appended to a Nortek AD2CP file
+
+@description
+
+Follow the chain of records in an AD2CP file, starting at the header
+after the last complete record found by a previous call (or at the
+first SYNC byte in the file, on the first call), and return the
+records found, in the form used by do_ldc_ad2cp_in_file(). A partial
+header or record at the end of the file is not reported, and does not
+cause a warning; it is read by a later call, once the rest of it has
+been written.
+
+@param handle an external pointer made by do_ldc_ad2cp_follow_open().
+
+@value a list containing 'index', 'length' and 'id' (as for
+do_ldc_ad2cp_in_file(), for the new records only), 'first' (integer,
+the number of the first of these records in the file, counting from
+1) and 'pending' (numeric, the number of bytes after the last complete
+record, which will be examined again by the next call) and
+'diagnostics' (as for do_ldc_ad2cp_in_file()).
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_ldc_ad2cp_follow(SEXP handle)
+{
+  XPtr<ad2cp_follow_state> state(handle);
+  std::string fn = state->filename;
+  MappedFile mf(fn);
+  if (!mf.ok())
+    ::Rf_error("cannot open file '%s'\n", fn.c_str());
+  const unsigned char *p = mf.data();
+  size_t fileSize = mf.size();
+  if (fileSize < state->good) {
+    mf.close();
+    ::Rf_error("file '%s' has shrunk from at least %.0f bytes to %.0f bytes, since the last call",
+        fn.c_str(), (double)state->good, (double)fileSize);
+  }
+  ScanDiagnostics diag(state->good);
+  if (!state->started) {
+    // As in do_ldc_ad2cp_in_file(), skip to the first SYNC byte.
+    const unsigned char *first = fileSize ? (const unsigned char*)memchr(p, SYNC, fileSize) : NULL;
+    if (first) {
+      state->good = first - p;
+      state->started = 1;
     }
-    // Check that it's an actual header
-    if (hbuf[1] == HEADER_SIZE && hbuf[3] == FAMILY) {
-      id = (int)hbuf[2];
-      dataSize = hbuf[4] + 256 * hbuf[5];
-      //Rprintf("\n\tdataSize=%5d ", dataSize);
-      dataChecksum = hbuf[6] + 256 * hbuf[7];
-      //Rprintf(" dataChecksum=%5d", dataChecksum);
-      headerChecksum = hbuf[8] + 256 * hbuf[9];
-      //Rprintf(" > saved to chunk %d (id=%d)\n", chunk, id);
-      index_buf[chunk] = cindex;
-      length_buf[chunk] = dataSize;
-
-      int found = 0;
-      for (int idi = 0; idi < NID_ALLOWED; idi++) {
-        if (id == ID_ALLOWED[idi]) {
-          found = 1;
-          break;
-        }
-      }
-      if (!found)
-        Rprintf("warning: odd id (%d) at chunk %d, index=%d\n", id, chunk, cindex);
-      id_buf[chunk] = id;
-      // Check the header checksum.
-      unsigned short hbufcs = cs(hbuf, HEADER_SIZE-2);
-      if (hbufcs != headerChecksum) {
-        Rprintf("warning: at cindex=%d, header checksum is %d but it should be %d\n",
-            cindex, hbufcs, headerChecksum);
-      }
-      // Increase size of data buffer, if required.
-      if (dataSize > dbuflen) { // expand the buffer if required
-        dbuflen = dataSize;
-        dbuf = (unsigned char *)Realloc(dbuf, dbuflen, unsigned char);
-      }
-      // Read the data
-      bytes_read = fread(dbuf, 1, dataSize, fp);
-      // Check that we got all the data
-      if (bytes_read != dataSize)
-        ::Rf_error("ran out of file on data chunk near cindex=%d; wanted %d bytes but got only %d\n",
-            cindex, dataSize, bytes_read);
-      // Compare data checksum to the value stated in the header
-      unsigned short dbufcs;
-      dbufcs = cs(dbuf, dataSize);
-      if (dbufcs != dataChecksum) {
-        Rprintf("warning: at cindex=%d, data checksum is %d but it should be %d\n",
-            cindex, dbufcs, dataChecksum);
+  }
+  unsigned long int first_record = state->nrecord + 1;
+  int status = AD2CP_SEGMENT_END;
+  size_t stop = state->good;
+  NumericVector index, length;
+  IntegerVector id;
+  {
+    std::vector<ad2cp_record> rec;
+    if (state->started)
+      status = ad2cp_follow(p, fileSize, state->good, fileSize, (size_t)-1, rec, &stop);
+    ad2cp_diagnose(rec, state->good, diag);
+    if (status != AD2CP_NOSYNC) {
+      // Either the records run to the end of the file, or the last
+      // one is incomplete (AD2CP_SHORT or AD2CP_TRUNCATED); in both
+      // cases, the next call starts where this one stopped.
+      size_t chunk = rec.size();
+      index = NumericVector(chunk);
+      length = NumericVector(chunk);
+      id = IntegerVector(chunk);
+      for (size_t i = 0; i < chunk; i++) {
+        index[i] = (double)rec[i].index;
+        length[i] = (double)rec[i].length;
+        id[i] = rec[i].id;
       }
-      cindex += dataSize;
+      state->good = stop;
+      state->nrecord += chunk;
     }
-    chunk++;
   }
-  IntegerVector index(chunk), length(chunk), id(chunk);
-  for (unsigned int i = 0; i < chunk; i++) {
-    index[i] = index_buf[i];
-    length[i] = length_buf[i];
-    id[i] = id_buf[i];
+  if (status == AD2CP_NOSYNC) {
+    int c = p[stop];
+    mf.close();
+    ::Rf_error("coding error in reading the header at cindex=%.0f; expecting 0x%x but found 0x%x\n",
+        (double)(stop + HEADER_SIZE), SYNC, c);
   }
-  Free(index_buf);
-  Free(length_buf);
-  Free(id_buf);
-  return(List::create(Named("index")=index, Named("length")=length, Named("id")=id));
+  mf.close();
+  // Bytes after the last complete record are pending, not skipped.
+  diag.finish(state->good);
+  return(List::create(Named("index")=index, Named("length")=length, Named("id")=id,
+        Named("first")=(int)first_record, Named("pending")=(double)(fileSize - state->good),
+        Named("diagnostics")=diag.as_list()));
 }
@@ -3,6 +3,13 @@
 #include <Rcpp.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "mapped_file.h"
+#include "input_file.h"
+#include "scan_diagnostics.h"
+#include "checksum.h"
 using namespace Rcpp;
 
 // Cross-reference work:
@@ -141,7 +148,8 @@ but calling `read.adp.rdi(...,debug=2)` does.
 
 @value a list containing "ensembleStart", "time", "sec100", and "buf",
 and "ensemble_in_file", which are used in the calling R
-function, read.adp.rdi().
+function, read.adp.rdi(), along with "diagnostics", a list of counts of
+the problems found in scanning the file (see scan_diagnostics.h).
 
 @examples
 
@@ -169,378 +177,783 @@ Dan Kelley
 
 */
 
-// [[Rcpp::export]]
-List do_ldc_rdi_in_file(StringVector filename, IntegerVector from, IntegerVector to, IntegerVector by, IntegerVector mode,
-    IntegerVector debug)
+// Byte access to the mapped file, mimicking fgetc(): a read at or
+// beyond the end of the file yields EOF and leaves the position
+// unchanged.
+static inline int rdi_getc(const unsigned char *p, size_t n, size_t *pos)
 {
-  struct tm etime; // time of the ensemble under examination
-  time_t ensemble_time = 0; // integer-ish form of the above (only calculated if mode=1)
-  time_t ensemble_time_last = 0; // we use this for 'by', if mode is 1
-  std::string fn = Rcpp::as<std::string>(filename(0));
+  if (*pos < n)
+    return (int)p[(*pos)++];
+  return EOF;
+}
 
-  FILE *fp = fopen(fn.c_str(), "rb");
-  if (!fp)
-    ::Rf_error("cannot open file '%s'\n", fn.c_str());
-  if (from[0] < 0)
-    ::Rf_error("'from' must be positive");
-  unsigned long int from_value = from[0];
-  if (to[0] < 0)
-    ::Rf_error("'to' must be positive");
-  unsigned long int to_value = to[0];
-  if (by[0] < 0)
-    ::Rf_error("'by' must be positive");
-  unsigned long int by_value = by[0];
-  int mode_value = mode[0];
-  if (mode_value != 0 && mode_value != 1)
-    ::Rf_error("'mode' must be 0 or 1");
-  int debug_value = debug[0];
-  if (debug_value < 0)
-    debug_value = 0;
-  if (debug_value > 0)
-    Rprintf("In C++ function named do_ldc_rdi_in_file. Diagnostics will be printed because debug>0\n");
-  //Rprintf("from=%d, to=%d, by=%d, mode_value=%d\n", from_value, to_value, by_value, mode_value);
-  int c, clast=0x00;
-  int byte1 = 0x7f;
-  int byte2 = 0x7f;
-  unsigned short int check_sum, desired_check_sum;
-  unsigned int bytes_to_check = 0;
-  unsigned int bytes_to_check_last = 0; // used to prevent freakouts if the chunk length is wrong (issue 1437)
-  unsigned long int cindex = 0;
-  unsigned long outEnsemblePointer = 1;
-  clast = fgetc(fp);
-  cindex++;
-  if (clast == EOF)
-    ::Rf_error("empty file '%s'", fn.c_str());
-  // 'obuf' is a growable C buffer to hold the output, which eventually
-  // gets saved in the R item "buf".
-  unsigned long int nobuf = 100000; // BUFFER SIZE
-  unsigned char *obuf = (unsigned char *)Calloc((size_t)nobuf, unsigned char);
-  unsigned long int iobuf = 0;
-
-  // 'ensembles', 'times' and 'sec100s' are growable buffers of equal length, with one
-  // element for each ensemble.  We also use 'ebuf', another growable buffer, for
-  // storage of data within the ensemble that is under consideration
-  // at the moment.
-  //
-  // Note that we do not check the Calloc() results because the R docs say that
-  // Calloc() performs its won tests, and that R will handle any problems.
-  unsigned long int nensembles = 100000; // BUFFER SIZE
-  unsigned int *ensemble_in_files = (unsigned int *)Calloc((size_t)nensembles, unsigned int);
-  int *ensembles = (int *)Calloc((size_t)nensembles, int);
-  int *times = (int *)Calloc((size_t)nensembles, int);
-  int *sec100s = (int *)Calloc((size_t)nensembles, int);
-  unsigned long int nebuf = 50000; // BUFFER SIZE
-  unsigned char *ebuf = (unsigned char *)Calloc((size_t)nebuf, unsigned char);
-
-  unsigned long int in_ensemble = 1, out_ensemble = 0;
-  int b1, b2;
-
-  unsigned long int counter = 0, counter_last = 0;
-  unsigned int long last7f7f = 0;
+// Byte at a given position in the mapped file, or 0 if the position
+// is past the end of the file (which can only happen with a damaged
+// file).
+static inline unsigned char rdi_byte(const unsigned char *p, size_t n, size_t i)
+{
+  return i < n ? p[i] : 0;
+}
 
+// Search for a 0x7f 0x7f pair, in the same way as a loop of at most
+// 'limit' rdi_getc() calls that stops when the previous byte ('clast')
+// and the current byte are both 0x7f. On success, the return value is
+// the position just past the second 0x7f, and *found is set to 1.
+// Otherwise, the return value is where such a loop would have left
+// off. The search uses memchr(), which is vectorized in all the C
+// libraries we know of, so it is much faster than checking bytes one
+// at a time.
+static size_t rdi_find_7f7f(const unsigned char *p, size_t n, size_t pos, int clast,
+    size_t limit, int *found)
+{
+  size_t end = (limit < n - pos) ? pos + limit : n;
+  *found = 0;
+  if (pos >= end)
+    return end;
+  if (clast == 0x7f && p[pos] == 0x7f) {
+    *found = 1;
+    return pos + 1;
+  }
+  size_t j = pos;
+  while (j + 1 < end) {
+    const unsigned char *q = (const unsigned char*)memchr(p + j, 0x7f, end - 1 - j);
+    if (!q)
+      break;
+    size_t k = q - p;
+    if (p[k + 1] == 0x7f) {
+      *found = 1;
+      return k + 2;
+    }
+    j = k + 1;
+  }
+  return end;
+}
+
+// An ensemble with a good checksum. 'start' is the offset of the
+// 0x7f 0x7f pair within the file, and 'length' counts all the bytes
+// from there to the end of the checksum.
+typedef struct {
+  size_t start;
+  unsigned int length;
+  time_t time;
+  int sec100;
+} rdi_ensemble;
+
+// Return values of RdiScanner::next()
+#define RDI_SCAN_ENSEMBLE 1
+#define RDI_SCAN_END 0
+#define RDI_SCAN_EMPTY -1
+#define RDI_SCAN_BAD_LENGTH -2
+#define RDI_SCAN_BAD_FIRST -3
+
+// Step through the ensembles of a mapped RDI file. Each call to next()
+// resumes where the last one stopped, and returns RDI_SCAN_ENSEMBLE
+// (having filled in *e) when it finds an ensemble with a good checksum,
+// RDI_SCAN_END at the end of the data, or one of the negative codes
+// above, if the file cannot be read. A scan may be started at any
+// position that follows an ensemble, by setting 'pos' (and
+// 'bytes_to_check_last') before the first call to next(). The logic is that of an earlier
+// version, which used fgetc(), fread() and fseek(), with 'pos' playing
+// the role of the file pointer. It is retained byte for byte, so that
+// files with damaged ensembles are handled in exactly the same way as
+// before (see issue 1437). Problems (bad checksums, realignments, and
+// so on) are counted in 'diag', if it is set, and are only printed if
+// debug > 0.
+class RdiScanner {
+  public:
+    RdiScanner(int debug_value, int quiet_value=0)
+      : pos(0), clast(0x00), bytes_to_check_last(0), nensemble(0), diag(NULL),
+      started(0), resume(0), debug(debug_value), quiet(quiet_value) {}
+    int next(const unsigned char *fbuf, size_t fsize, rdi_ensemble *e);
+    void event(int type, size_t offset) { if (diag) diag->event(type, offset); }
+    size_t pos;
+    int clast;
+    unsigned int bytes_to_check_last; // used to prevent freakouts if the chunk length is wrong (issue 1437)
+    unsigned long int nensemble; // number of good ensembles found so far
+    ScanDiagnostics *diag;
+  private:
+    int started, resume, debug;
+    int quiet; // if nonzero, reaching the end of the file within an ensemble is not reported
+};
+
+int RdiScanner::next(const unsigned char *fbuf, size_t fsize, rdi_ensemble *e)
+{
+  const int byte1 = 0x7f;
+  const int byte2 = 0x7f;
+  int c;
+  if (!started) {
+    clast = rdi_getc(fbuf, fsize, &pos);
+    if (clast == EOF)
+      return RDI_SCAN_EMPTY;
+    started = 1;
+  } else if (resume) {
+    // Pick up at the bottom of the loop, after the last good ensemble.
+    resume = 0;
+    c = rdi_getc(fbuf, fsize, &pos);
+    clast = c;
+    if (c == EOF)
+      return RDI_SCAN_END;
+  }
   while (1) {
-    c = fgetc(fp);
-    cindex++;
+    c = rdi_getc(fbuf, fsize, &pos);
     if (c == EOF) {
-      Rprintf("Got to end of data while trying to read the first header byte of an RDI file (cindex=%d)\n", cindex);
-      break;
+      if (!quiet) {
+        event(SCAN_TRUNCATED, pos);
+        if (debug > 0)
+          Rprintf("Got to end of data while trying to read the first header byte of an RDI file (cindex=%d)\n", (int)pos + 1);
+      }
+      return RDI_SCAN_END;
     }
     // Locate "ensemble starts", spots where a 0x7f is followed by a second 0x7f,
     // then followed by data that match a checksum.
     if (clast == byte1 && c == byte2) {
-      last7f7f = cindex - 2;
+      size_t last7f7f = pos - 2;
       // The checksum includes the starting (0x7f, 0x7f) sequence, the
       // two bytes that specify the number of bytes in the
       // ensemble, and the data in the ensemble (sans the two bytes
       // at the end of the data, which store the checksum).
-      if (debug_value > 0)
-        Rprintf("0x7f 0x7f at position %d (cindex %d) last7f7f=%d\n", ftell(fp), cindex, last7f7f);
-      check_sum = (unsigned short int)byte1;
+      if (debug > 0)
+        Rprintf("0x7f 0x7f at position %d (cindex %d) last7f7f=%d\n", (int)pos, (int)pos, (int)last7f7f);
+      unsigned short int check_sum = (unsigned short int)byte1;
       check_sum += (unsigned short int)byte2;
-      b1 = fgetc(fp);
-      cindex++;
+      int b1 = rdi_getc(fbuf, fsize, &pos);
       if (b1 == EOF) {
-        Rprintf("Got to end of data while trying to read the 'b1' byte of an RDI file (cindex=%d)\n", cindex);
-        break;
+        if (!quiet) {
+          event(SCAN_TRUNCATED, last7f7f);
+          if (debug > 0)
+            Rprintf("Got to end of data while trying to read the 'b1' byte of an RDI file (cindex=%d)\n", (int)pos + 1);
+        }
+        return RDI_SCAN_END;
       }
       check_sum += (unsigned short int)b1;
-      b2 = fgetc(fp);
-      cindex++;
+      int b2 = rdi_getc(fbuf, fsize, &pos);
       if (b2 == EOF) {
-        Rprintf("Got to end of data while trying to read the 'b2' byte of an RDI file (cindex=%d)\n", cindex);
-        break;
+        if (!quiet) {
+          event(SCAN_TRUNCATED, last7f7f);
+          if (debug > 0)
+            Rprintf("Got to end of data while trying to read the 'b2' byte of an RDI file (cindex=%d)\n", (int)pos + 1);
+        }
+        return RDI_SCAN_END;
       }
       check_sum += (unsigned short int)b2;
       // Now we are ready to look at the rest of the bytes. Note that
       // our loop starts at index 4, because we have already handled
       // those 4 bytes of the ensemble (i.e. those 4 bytes are include
       // in the bytes_to_check value that we now calculate).
-      bytes_to_check = (unsigned int)b1 + 256 * (unsigned int)b2;
-      if (debug_value > 0)
+      unsigned int bytes_to_check = (unsigned int)b1 + 256 * (unsigned int)b2;
+      if (debug > 0)
         Rprintf("\nbytes_to_check=%d based on b1=%d(0x%02x) and b2=%d(0x%02x)\n", bytes_to_check, b1, b1, b2, b2);
-      if (bytes_to_check < 5) { // this will only happen in error; we check so bytes_to_read won't be crazy
-        Free(ensembles);
-        Free(times);
-        Free(sec100s);
-        Free(ebuf);
-        ::Rf_error("cannot decode the length of ensemble number %d", in_ensemble);
-      }
-      if (bytes_to_check < 4)
-        ::Rf_error("bytes_to_check should be >=4 but it is %d\n", bytes_to_check);
+      if (bytes_to_check < 5) // this will only happen in error; we check so bytes_to_read won't be crazy
+        return RDI_SCAN_BAD_LENGTH;
       unsigned int bytes_to_read = bytes_to_check - 4; // byte1&byte2&check_sum used 4 bytes already
-
-      // Expand the ensemble buffer, ebuf, if need be.
-      if (bytes_to_read > nebuf) {
-        if (debug_value > 0)
-          Rprintf("Increasing 'ebuf' buffer size from %d bytes to %d bytes\n", nebuf, bytes_to_read);
-        ebuf = (unsigned char *)Realloc(ebuf, bytes_to_read, unsigned char);
-        nebuf = bytes_to_read;
-      }
-      // Read the bytes in one operation, because fgetc() is too slow.
-      unsigned int bytesRead;
-      bytesRead = fread(ebuf, bytes_to_read, sizeof(unsigned char), fp);
-      if (feof(fp) || bytesRead == 0) {
-        Rprintf("Got to end of data while trying to read an RDI file (cindex=%d)\n", cindex);
-        break;
-      }
-      cindex += bytes_to_read;
-      for (unsigned int ib = 0; ib < bytes_to_read; ib++) {
-        check_sum += (unsigned short int)ebuf[ib];
+      if (fsize - pos < bytes_to_read) {
+        if (!quiet) {
+          event(SCAN_TRUNCATED, last7f7f);
+          if (debug > 0)
+            Rprintf("Got to end of data while trying to read an RDI file (cindex=%d)\n", (int)pos);
+        }
+        return RDI_SCAN_END;
       }
+      // 'ebuf' points to the ensemble data, just past the 4 bytes
+      // handled above.
+      const unsigned char *ebuf = fbuf + pos;
+      pos += bytes_to_read;
+      check_sum += oce_sum_bytes(ebuf, bytes_to_read);
       int cs1, cs2;
-      cs1 = fgetc(fp);
-      cindex++;
+      cs1 = rdi_getc(fbuf, fsize, &pos);
       if (cs1 == EOF) {
-        Rprintf("Got to end of data while trying to get the first checksum byte in an RDI file (cindex=%d)\n", cindex);
-        break;
+        if (!quiet) {
+          event(SCAN_TRUNCATED, last7f7f);
+          if (debug > 0)
+            Rprintf("Got to end of data while trying to get the first checksum byte in an RDI file (cindex=%d)\n", (int)pos + 1);
+        }
+        return RDI_SCAN_END;
       }
-      cs2 = fgetc(fp);
-      cindex++;
+      cs2 = rdi_getc(fbuf, fsize, &pos);
       if (cs2 == EOF) {
-        Rprintf("Got to end of data while trying to get second checksum byte in an RDI file (cindex=%d)\n", cindex);
-        break;
+        if (!quiet) {
+          event(SCAN_TRUNCATED, last7f7f);
+          if (debug > 0)
+            Rprintf("Got to end of data while trying to get second checksum byte in an RDI file (cindex=%d)\n", (int)pos + 1);
+        }
+        return RDI_SCAN_END;
       }
-      desired_check_sum = ((unsigned short int)cs1) | ((unsigned short int)(cs2 << 8));
+      unsigned short int desired_check_sum = ((unsigned short int)cs1) | ((unsigned short int)(cs2 << 8));
+      // Only check once per ensemble, for speed. This throws, instead of
+      // jumping, so the caller's InputFile and vectors are released.
+      Rcpp::checkUserInterrupt();
       if (check_sum == desired_check_sum) {
-        if (debug_value > 0)
+        if (debug > 0)
           Rprintf("good checksum at cindex=%d (check_sum=%d desired_check_sum=%d bytes_to_read=%d last7f7f=%d)\n",
-              cindex, check_sum, desired_check_sum, bytes_to_read, last7f7f);
+              (int)pos, check_sum, desired_check_sum, bytes_to_read, (int)last7f7f);
         bytes_to_check_last = bytes_to_check; // use later, if find bad checksum (issue 1437)
-        // The check_sum is ok, so we may want to store the results for
-        // this profile.
-        //
-        // First, ensure that there will be sufficient storage to store results.
-        // We do this before checking to see if we are actually going
-        // to store the results, so possibly this might get done one
-        // more time than required, before this function returns.
-        if (out_ensemble >= nensembles) {
-          // Enlarge the buffer. We do not check the Realloc() result, because this
-          // is an R macro that is supposed to check for errors and handle them.
-          nensembles = 3 * nensembles / 2;
-          if (debug_value > -1)
-            Rprintf("Increasing ensembles,times,sec100s storage to %d elements ...\n", nensembles);
-          ensemble_in_files = (unsigned int *) Realloc(ensemble_in_files, nensembles, unsigned int);
-          ensembles = (int *) Realloc(ensembles, nensembles, int);
-          times = (int *) Realloc(times, nensembles, int);
-          sec100s = (int *)Realloc(sec100s, nensembles, int);
-        }
-        // We will decide whether to keep this ensemble, based on ensemble
-        // number, if mode_value==0 or on time, if mode_value==1. That
-        // means we only need to compute a time if mode_value==1.
-        unsigned int time_pointer = (unsigned int)ebuf[4] + 256 * (unsigned int) ebuf[5];
-        etime.tm_year = 100 + (int) ebuf[time_pointer+0];
-        etime.tm_mon = -1 + (int) ebuf[time_pointer+1];
-        etime.tm_mday = (int) ebuf[time_pointer+2];
-        etime.tm_hour = (int) ebuf[time_pointer+3];
-        etime.tm_min = (int) ebuf[time_pointer+4];
-        etime.tm_sec = (int) ebuf[time_pointer+5];
+        // The time bytes are looked up in the mapped file, guarding
+        // against a pointer that is broken so badly that it points
+        // past the end of the file.
+        size_t time_pointer = last7f7f + 4 + rdi_byte(fbuf, fsize, last7f7f + 8)
+          + 256 * (size_t)rdi_byte(fbuf, fsize, last7f7f + 9);
+        unsigned char tbuf[7];
+        for (int it = 0; it < 7; it++)
+          tbuf[it] = rdi_byte(fbuf, fsize, time_pointer + it);
+        struct tm etime; // time of the ensemble under examination
+        etime.tm_year = 100 + (int) tbuf[0];
+        etime.tm_mon = -1 + (int) tbuf[1];
+        etime.tm_mday = (int) tbuf[2];
+        etime.tm_hour = (int) tbuf[3];
+        etime.tm_min = (int) tbuf[4];
+        etime.tm_sec = (int) tbuf[5];
         etime.tm_isdst = 0;
         // Use local timegm code, which I suppose is risky, but it
         // does not seem that Microsoft Windows provides this function
         // in a workable form.
-        ensemble_time = oce_timegm(&etime);
-        // See whether we are past the 'from' condition. Note the "-1"
-        // for the ensemble case, because R starts counts at 1, not 0,
-        // and the calling R code is (naturally) in R notation.
-        if (debug_value > 0 && out_ensemble<OUTLIM)
-          Rprintf("  in_ensemble=%d; from_value=%d; counter=%d; counter_last=%d\n", in_ensemble, from_value, counter,  counter_last);
-        // Have we got to the starting location yet?
-        if ((mode_value == 0 && in_ensemble >= (from_value-1)) ||
-            (mode_value == 1 && ensemble_time >= (time_t)from_value)) {
-          //if (out_ensemble<OUTLIM) Rprintf("  STAGE 2 in_ensemble=%d; from_value=%d; counter=%d; counter_last=%d\n", in_ensemble, from_value, counter,  counter_last);
-          // Handle the 'by' value.
-          if ((mode_value == 0 && (counter==from_value-1 || (counter - counter_last) >= by_value)) ||
-              (mode_value == 1 && (ensemble_time - ensemble_time_last) >= (time_t)by_value)) {
-            //if (out_ensemble<OUTLIM) Rprintf("  STAGE 3 in_ensemble=%d; from_value=%d; counter=%d; counter_last=%d\n", in_ensemble, from_value, counter,  counter_last);
-            // Copy ensemble to output buffer, after 6 bytes of header
-            // FIXME: next is wrong. should have a cumsum
-            ensemble_in_files[out_ensemble] = 1 + last7f7f; // use R index-from-1 notation
-            ensembles[out_ensemble] = outEnsemblePointer;
-            outEnsemblePointer = outEnsemblePointer + 6 + bytes_to_read; // 6 bytes for: 0x7f,0x7f,b1,b2,cs1,cs2
-            times[out_ensemble] = ensemble_time;
-            // Increment counter (can be of two types)
-            if (mode_value == 1) {
-              ensemble_time_last = ensemble_time;
-            } else {
-              counter_last = counter;
-            }
-            //Rprintf("saving at in_ensemble=%d, counter=%d, by=%d\n", in_ensemble, counter, by_value);
-            //    ensembles[out_ensemble] = last_start;
-            unsigned int timePointer = (unsigned int)ebuf[4] + 256 * (unsigned int) ebuf[5];
-            sec100s[out_ensemble] = ebuf[timePointer+6];
-            out_ensemble++;
-            // Save to output buffer.
-            // {{{
-            if ((iobuf + 100 + bytes_to_read) >= nobuf) {
-              nobuf = nobuf + 100 + bytes_to_read + nobuf / 2;
-              if (debug_value > 0)
-                Rprintf("about to enlarge obuf storage to %d elements ...\n", nobuf);
-              obuf = (unsigned char *)Realloc(obuf, nobuf, unsigned char);
-              if (debug_value > 0)
-                Rprintf("    ... allocation was successful\n");
-            }
-            obuf[iobuf++] = byte1; // 0x7f
-            obuf[iobuf++] = byte2; // 0x7f
-            obuf[iobuf++] = b1; // length of ensemble, byte 1
-            obuf[iobuf++] = b2; // length of ensemble, byte 1
-            for (unsigned int i = 0; i < bytes_to_read; i++)
-              obuf[iobuf++] = ebuf[i]; // data, not including the checksum
-            obuf[iobuf++] = cs1; // checksum  byte 1
-            obuf[iobuf++] = cs2; // checksum  byte 2
-            // }}}
-          } else {
-            if (debug_value > 0)
-              Rprintf("Skipping at in_ensemble=%d, counter=%d, by=%d\n", in_ensemble, counter, by_value);
-          }
-          counter++;
-        }
-        in_ensemble++;
-        // If 'max' is positive, check that we return only that many
-        // ensemble pointers.
-        //> Rprintf("L417 in_ensemble=%d from_value=%d to_value=%d\n", in_ensemble, from_value, to_value);
-        if ((mode_value == 0 && (to_value > 0 && in_ensemble > to_value)) ||
-            (mode_value == 1 && (ensemble_time >= (time_t)to_value))) {
-          break;
-        }
+        e->start = last7f7f;
+        e->length = 6 + bytes_to_read; // 6 bytes for: 0x7f,0x7f,b1,b2,cs1,cs2
+        e->time = (time_t)oce_timegm(&etime);
+        e->sec100 = tbuf[6];
+        if (diag)
+          diag->record(e->start, e->length);
+        nensemble++;
+        resume = 1;
+        return RDI_SCAN_ENSEMBLE;
       } else {
-        cindex = ftell(fp); // synch up, just to be sure (cost is low since this rarely happens)
-        Rprintf("Warning: bad checksum at byte %d in file (check_sum=%d desired_check_sum=%d bytes_to_read=%d bytes_to_read_last=%d)\n", cindex, check_sum, desired_check_sum, bytes_to_read, bytes_to_check_last);
+        event(SCAN_CHECKSUM, last7f7f);
+        if (debug > 0)
+          Rprintf("Warning: bad checksum at byte %d in file (check_sum=%d desired_check_sum=%d bytes_to_read=%d bytes_to_read_last=%d)\n", (int)pos, check_sum, desired_check_sum, bytes_to_read, bytes_to_check_last);
         // maybe the number of bytes to check was wrong (issue 1437)
         if (bytes_to_check_last != bytes_to_check) {
-          if (bytes_to_check == 0)
-            ::Rf_error("cannot read this file, because the first ensemble has a checksum error\n");
-          if (debug_value > 0)
+          if (bytes_to_check_last == 0)
+            return RDI_SCAN_BAD_FIRST;
+          if (debug > 0)
             Rprintf("the problem may be that length (%d bytes) disagrees with previous (%d bytes)\n", bytes_to_check, bytes_to_check_last);
           // Skip to just past the last 7f7f, and then start looking
-          // for the next valid 7f7f.
-          cindex = last7f7f;
-          fseek(fp, last7f7f, SEEK_SET);
+          // for the next valid 7f7f whose length matches that of the
+          // last good ensemble. An unsuitable match (i.e. one with
+          // the wrong length) consumes its two length bytes without
+          // counting them towards the search limit, and leaves the
+          // second 0x7f as the previous byte for the next search.
+          size_t search_start = last7f7f;
+          size_t limit = 2 * (size_t)bytes_to_check_last;
+          int found;
+          pos = last7f7f;
           clast = 0;
-          for (unsigned int iii = 0; iii < 2 * bytes_to_check_last; iii++) {
-            c = fgetc(fp);
-            cindex++;
-            if (debug_value > 0)
-              Rprintf("realign iii=%d cindex=%d c=0x%02x clast=0x%02x\n", iii, cindex, c, clast);
-            if (clast==byte1 && c == byte2) {
-              if (debug_value > 0)
-                Rprintf(" got 7f 7f again at byte %d, after realigning. FYI bytes_to_check_last=%d\n", ftell(fp), bytes_to_check_last);
-              // check if next two bytes give the expected length as
-              // before
-              b1 = fgetc(fp);
-              cindex++;
-              b2 = fgetc(fp);
-              cindex++;
-              bytes_to_check = (unsigned int)b1 + 256 * (unsigned int)b2;
-              if (bytes_to_check == bytes_to_check_last) {
-                fseek(fp, -2L, SEEK_CUR);
-                cindex = ftell(fp); // synch up, just to be sure (cost is low since this rarely happens)
-                Rprintf("    ... recovered from bad checksum by restarting at byte %d in file\n", cindex);
-                break;
-              } else {
-                if (debug_value > 0)
-                  Rprintf(" ACCIDENTALLY MATCH since bytes_to_check=%d, not expected %d\n",bytes_to_check,bytes_to_check_last);
-              }
+          while (limit > 0) {
+            pos = rdi_find_7f7f(fbuf, fsize, pos, clast, limit, &found);
+            if (!found)
+              break;
+            limit -= pos - search_start;
+            c = byte2;
+            if (debug > 0)
+              Rprintf(" got 7f 7f again at byte %d, after realigning. FYI bytes_to_check_last=%d\n", (int)pos, bytes_to_check_last);
+            // check if next two bytes give the expected length as
+            // before
+            b1 = rdi_getc(fbuf, fsize, &pos);
+            b2 = rdi_getc(fbuf, fsize, &pos);
+            bytes_to_check = (unsigned int)b1 + 256 * (unsigned int)b2;
+            if (bytes_to_check == bytes_to_check_last) {
+              pos -= 2;
+              event(SCAN_RESYNC, pos);
+              if (debug > 0)
+                Rprintf("    ... recovered from bad checksum by restarting at byte %d in file\n", (int)pos);
+              break;
+            } else {
+              if (debug > 0)
+                Rprintf(" ACCIDENTALLY MATCH since bytes_to_check=%d, not expected %d\n",bytes_to_check,bytes_to_check_last);
             }
             clast = c;
+            search_start = pos;
           }
-          //Rprintf(" moving file pointer to %d\n", last7f7f + bytes_to_check_last + 1);
-          //Rprintf("  BEFORE, ftell() says at %d\n", ftell(fp));
-          //fseek(fp, last7f7f + bytes_to_check_last + 1, SEEK_SET); // FIXME: may need to add 2 or 4 bytes, or subtract
-          //cindex = last7f7f + bytes_to_check_last + 1;
-          //clast = 0; // FIXME: is this right?
-          //Rprintf("  AFTER, ftell() says at %d\n", ftell(fp));
-          //c = 0; // FIXME: is this right?
         }
-
-        if (debug_value > 0 && out_ensemble < OUTLIM)
-          Rprintf("  in_ensemble=%d; from_value=%d; counter=%d; counter_last=%d\n", in_ensemble, from_value, counter,  counter_last);
       }
-      R_CheckUserInterrupt(); // only check once per ensemble, for speed
-      //fseek(fp,-1L,SEEK_CUR);Rprintf("OK  test at %d c=0x%02x\n", ftell(fp), fgetc(fp));
-      clast = c;
     } else {
-      // Either clast != byte1 or c != byte2) {
-      //Rprintf("skipping byte. c=0x%02x clast=0x%02x  cindex=%d (ftell() says at pointer %d)\n", c, clast, cindex, ftell(fp));
-      //fseek(fp,-1L,SEEK_CUR);Rprintf("BAD test at %d c=0x%02x\n", ftell(fp), fgetc(fp));
-      cindex = ftell(fp); // synch up, just to be sure (cost is low since this rarely happens)
-      Rprintf("Warning: bad ensemble-start byte-pair at byte %d in file\n", cindex);
-      if (debug_value > 0)
+      // Either clast != byte1 or c != byte2.
+      event(SCAN_BAD_START, pos);
+      if (debug > 0)
+        Rprintf("Warning: bad ensemble-start byte-pair at byte %d in file\n", (int)pos);
+      if (debug > 0)
         Rprintf("try skipping to get 0x7f 0x7f pair\n");
-      for (unsigned int iii = 0; iii < 2 * bytes_to_check_last; iii++) {
-        c = fgetc(fp);
-        cindex++;
-        if (debug_value > 0)
-          Rprintf("skipping iii=%d cindex=%d c=0x%02x clast=0x%02x\n", iii, cindex, c, clast);
-        if (clast==byte1 && c == byte2) {
-          if (debug_value > 0)
-            Rprintf(" got 7f 7f again at byte %d, after skipping. FYI bytes_to_check_last=%d\n", ftell(fp), bytes_to_check_last);
-          Rprintf("    ... recovered from bad ensemble-start byte-pair by restarting at byte %d in file\n", cindex);
-          // adjust file pointer
-          fseek(fp, -2L, SEEK_CUR);
-          cindex = ftell(fp); // synch again, for code clarity (cost is low since this rarely happens)
-          break;
-        }
-        clast = c;
+      int found;
+      pos = rdi_find_7f7f(fbuf, fsize, pos, clast, 2 * (size_t)bytes_to_check_last, &found);
+      if (found) {
+        // adjust file pointer
+        pos -= 2;
+        event(SCAN_RESYNC, pos);
+        if (debug > 0)
+          Rprintf("    ... recovered from bad ensemble-start byte-pair by restarting at byte %d in file\n", (int)pos);
       }
-      if (debug_value > 0)
+      if (debug > 0)
       Rprintf("====\n");
     }
-    c = fgetc(fp);
-    cindex++;
+    c = rdi_getc(fbuf, fsize, &pos);
     clast = c;
     if (c == EOF)
-      break;
+      return RDI_SCAN_END;
   }
-  fclose(fp);
-
-  // Finally, copy into some R memory. Possibly we should have been
-  // using this all along, but I wasn't clear on how to reallocate it.
-  IntegerVector ensemble_in_file(out_ensemble);
-  IntegerVector ensemble(out_ensemble);
-  IntegerVector sec100(out_ensemble);
-  IntegerVector time(out_ensemble);
-  RawVector buf(iobuf);
-
-  for (unsigned long int i = 0; i < out_ensemble; i++) {
-    ensemble_in_file[i] = ensemble_in_files[i];
-    ensemble[i] = ensembles[i];
-    time[i] = times[i];
-    sec100[i] = sec100s[i];
-    //Rprintf("i=%d ensemble=%d time=%d sec100=%d\n", i, ensemble[i], time[i], (int)sec100[i]);
+}
+
+// Decide which ensembles to keep, based on ensemble number, if
+// mode==0, or on time, if mode==1. The ensembles must be presented
+// in file order. The return value is 1 if the ensemble is to be kept,
+// and *stop is set to 1 if no further ensembles are wanted.
+class RdiSelector {
+  public:
+    RdiSelector(unsigned long int from, unsigned long int to, unsigned long int by, int mode)
+      : from_value(from), to_value(to), by_value(by), mode_value(mode),
+      in_ensemble(1), counter(0), counter_last(0), ensemble_time_last(0) {}
+    int keep(time_t ensemble_time, int *stop);
+    unsigned long int from_value, to_value, by_value;
+    int mode_value;
+    unsigned long int in_ensemble, counter, counter_last;
+    time_t ensemble_time_last; // we use this for 'by', if mode is 1
+};
+
+int RdiSelector::keep(time_t ensemble_time, int *stop)
+{
+  int res = 0;
+  // See whether we are past the 'from' condition. Note the "-1"
+  // for the ensemble case, because R starts counts at 1, not 0,
+  // and the calling R code is (naturally) in R notation.
+  if ((mode_value == 0 && in_ensemble >= (from_value-1)) ||
+      (mode_value == 1 && ensemble_time >= (time_t)from_value)) {
+    // Handle the 'by' value.
+    if ((mode_value == 0 && (counter==from_value-1 || (counter - counter_last) >= by_value)) ||
+        (mode_value == 1 && (ensemble_time - ensemble_time_last) >= (time_t)by_value)) {
+      // Increment counter (can be of two types)
+      if (mode_value == 1) {
+        ensemble_time_last = ensemble_time;
+      } else {
+        counter_last = counter;
+      }
+      res = 1;
+    }
+    counter++;
   }
-  Free(ensemble_in_files);
-  Free(ensembles);
-  Free(times);
-  Free(sec100s);
-  Free(ebuf);
-  for (unsigned long int i = 0; i < iobuf; i++) {
-    buf[i] = obuf[i];
+  in_ensemble++;
+  // If 'max' is positive, check that we return only that many
+  // ensemble pointers.
+  *stop = (mode_value == 0 && (to_value > 0 && in_ensemble > to_value)) ||
+    (mode_value == 1 && (ensemble_time >= (time_t)to_value));
+  return res;
+}
+
+// Check the from, to, by and mode arguments that are common to
+// do_ldc_rdi_in_file() and do_ldc_rdi_from_index().
+static RdiSelector rdi_selector(IntegerVector from, IntegerVector to, IntegerVector by, IntegerVector mode)
+{
+  if (from[0] < 0)
+    ::Rf_error("'from' must be positive");
+  if (to[0] < 0)
+    ::Rf_error("'to' must be positive");
+  if (by[0] < 0)
+    ::Rf_error("'by' must be positive");
+  if (mode[0] != 0 && mode[0] != 1)
+    ::Rf_error("'mode' must be 0 or 1");
+  return RdiSelector(from[0], to[0], by[0], mode[0]);
+}
+
+// Construct the list returned by do_ldc_rdi_in_file(), copying the
+// kept ensembles from the mapped file to "buf".
+static List rdi_result(const unsigned char *fbuf, const std::vector<rdi_ensemble> &kept)
+{
+  size_t n = kept.size();
+  IntegerVector ensemble_in_file(n);
+  IntegerVector ensemble(n);
+  IntegerVector sec100(n);
+  IntegerVector time(n);
+  size_t nbuf = 0;
+  for (size_t i = 0; i < n; i++)
+    nbuf += kept[i].length;
+  RawVector buf(nbuf);
+  size_t ibuf = 0;
+  for (size_t i = 0; i < n; i++) {
+    ensemble_in_file[i] = 1 + kept[i].start; // use R index-from-1 notation
+    ensemble[i] = 1 + ibuf;
+    time[i] = kept[i].time;
+    sec100[i] = kept[i].sec100;
+    // The ensemble is contiguous in the file, from the 0x7f 0x7f pair
+    // to the checksum bytes, so it can be copied in one operation.
+    memcpy(&buf[0] + ibuf, fbuf + kept[i].start, kept[i].length);
+    ibuf += kept[i].length;
   }
-  Free(obuf);
-  if (debug_value > 0)
-    Rprintf("Returning from C++ function named do_ldc_rdi_in_file.\n");
   return(List::create(Named("ensembleStart")=ensemble, Named("time")=time,
         Named("sec100")=sec100, Named("buf")=buf,
         Named("ensemble_in_file")=ensemble_in_file));
 }
 
+// The length of the data in a file, after decompression if it is
+// compressed. This lets read.adp.rdi() learn the size of a compressed
+// file without decompressing it in R.
+// [[Rcpp::export]]
+double do_input_file_size(StringVector filename)
+{
+  std::string fn = Rcpp::as<std::string>(filename(0));
+  InputFile mf(fn);
+  if (!mf.ok())
+    ::Rf_error("cannot read file '%s' (%s)\n", fn.c_str(), mf.message());
+  double size = mf.size();
+  mf.close();
+  return size;
+}
+
+// Report an error found by RdiScanner::next(). This is done after the
+// file is unmapped and any storage is released, because ::Rf_error()
+// does not return.
+static void rdi_scan_error(int status, std::string fn, unsigned long int in_ensemble)
+{
+  if (status == RDI_SCAN_EMPTY)
+    ::Rf_error("empty file '%s'", fn.c_str());
+  else if (status == RDI_SCAN_BAD_LENGTH)
+    ::Rf_error("cannot decode the length of ensemble number %d", in_ensemble);
+  else if (status == RDI_SCAN_BAD_FIRST)
+    ::Rf_error("cannot read this file, because the first ensemble has a checksum error\n");
+}
+
+// [[Rcpp::export]]
+List do_ldc_rdi_in_file(StringVector filename, IntegerVector from, IntegerVector to, IntegerVector by, IntegerVector mode,
+    IntegerVector debug)
+{
+  std::string fn = Rcpp::as<std::string>(filename(0));
+  RdiSelector selector = rdi_selector(from, to, by, mode);
+  int debug_value = debug[0];
+  if (debug_value < 0)
+    debug_value = 0;
+  if (debug_value > 0)
+    Rprintf("In C++ function named do_ldc_rdi_in_file. Diagnostics will be printed because debug>0\n");
+  //Rprintf("from=%d, to=%d, by=%d, mode_value=%d\n", from_value, to_value, by_value, mode_value);
+
+  InputFile mf(fn);
+  if (!mf.ok())
+    ::Rf_error("cannot read file '%s' (%s)\n", fn.c_str(), mf.message());
+  const unsigned char *fbuf = mf.data();
+  size_t fsize = mf.size();
+
+  RdiScanner scanner(debug_value);
+  ScanDiagnostics diag;
+  scanner.diag = &diag;
+  int status;
+  List res;
+  {
+    std::vector<rdi_ensemble> kept;
+    rdi_ensemble e;
+    while (RDI_SCAN_ENSEMBLE == (status = scanner.next(fbuf, fsize, &e))) {
+      if (debug_value > 0 && kept.size() < OUTLIM)
+        Rprintf("  in_ensemble=%d; from_value=%d; counter=%d; counter_last=%d\n",
+            selector.in_ensemble, selector.from_value, selector.counter, selector.counter_last);
+      int stop;
+      if (selector.keep(e.time, &stop))
+        kept.push_back(e);
+      else if (debug_value > 0)
+        Rprintf("Skipping at in_ensemble=%d, counter=%d, by=%d\n",
+            selector.in_ensemble, selector.counter, selector.by_value);
+      if (stop)
+        break;
+    }
+    if (status >= 0) {
+      res = rdi_result(fbuf, kept);
+      diag.finish(status == RDI_SCAN_END ? fsize : scanner.pos);
+      res["diagnostics"] = diag.as_list();
+    }
+  }
+  mf.close();
+  if (status < 0)
+    rdi_scan_error(status, fn, scanner.nensemble + 1);
+  if (debug_value > 0)
+    Rprintf("Returning from C++ function named do_ldc_rdi_in_file.\n");
+  return(res);
+}
+
+/*
+
+Index the ensembles of an RDI file
+
+@description
+
+Scan a whole RDI file, in the same way as do_ldc_rdi_in_file(), but
+instead of copying the ensembles, just record where they are. The
+result may be saved, and handed to do_ldc_rdi_from_index() to read
+windows of the file without scanning it again.
+
+@param filename character string indicating the name of an RDI adp
+file.
+
+@param debug integer, 1 or higher to turn on printing.
+
+@value a list containing "start" (numeric, giving the location of each
+ensemble in the file, in R index-from-1 notation), "length" (integer,
+the number of bytes in the ensemble, including the checksum),
+"time" (integer, the ensemble time in seconds since the unix epoch)
+"sec100" (integer, the hundredths of a second to add to "time") and
+"diagnostics" (as for do_ldc_rdi_in_file()).
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_ldc_rdi_index(StringVector filename, IntegerVector debug)
+{
+  std::string fn = Rcpp::as<std::string>(filename(0));
+  int debug_value = debug[0];
+  if (debug_value < 0)
+    debug_value = 0;
+  InputFile mf(fn);
+  if (!mf.ok())
+    ::Rf_error("cannot read file '%s' (%s)\n", fn.c_str(), mf.message());
+  RdiScanner scanner(debug_value);
+  ScanDiagnostics diag;
+  scanner.diag = &diag;
+  int status;
+  List res;
+  {
+    std::vector<rdi_ensemble> found;
+    rdi_ensemble e;
+    while (RDI_SCAN_ENSEMBLE == (status = scanner.next(mf.data(), mf.size(), &e)))
+      found.push_back(e);
+    if (status >= 0) {
+      size_t n = found.size();
+      NumericVector start(n);
+      IntegerVector length(n), time(n), sec100(n);
+      for (size_t i = 0; i < n; i++) {
+        start[i] = 1.0 + (double)found[i].start;
+        length[i] = found[i].length;
+        time[i] = found[i].time;
+        sec100[i] = found[i].sec100;
+      }
+      diag.finish(mf.size());
+      res = List::create(Named("start")=start, Named("length")=length,
+          Named("time")=time, Named("sec100")=sec100,
+          Named("diagnostics")=diag.as_list());
+    }
+  }
+  mf.close();
+  if (status < 0)
+    rdi_scan_error(status, fn, scanner.nensemble + 1);
+  return(res);
+}
+
+/*
+
+Read RDI ensembles, using an index
+
+@description
+
+Do what do_ldc_rdi_in_file() does, but with the work of locating
+ensembles replaced by a lookup in an index made by do_ldc_rdi_index().
+Only the selected ensembles are read from the file.
+
+@details
+
+The selection logic is the same as in do_ldc_rdi_in_file(). If mode=1
+and the times in the index are in increasing order (as they will be
+for a normal file), a binary search is used to find the first
+ensemble that might be selected.
+
+@param filename, from, to, by, mode and debug as for
+do_ldc_rdi_in_file().
+
+@param start, length, time, sec100 as returned by do_ldc_rdi_index().
+
+@value a list as returned by do_ldc_rdi_in_file().
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_ldc_rdi_from_index(StringVector filename, NumericVector start, IntegerVector length,
+    IntegerVector time, IntegerVector sec100, IntegerVector from, IntegerVector to,
+    IntegerVector by, IntegerVector mode, IntegerVector debug)
+{
+  std::string fn = Rcpp::as<std::string>(filename(0));
+  RdiSelector selector = rdi_selector(from, to, by, mode);
+  long int n = start.size();
+  if (length.size() != n || time.size() != n || sec100.size() != n)
+    ::Rf_error("lengths of start, length, time and sec100 must agree, but they are %d, %d, %d and %d",
+        (int)n, (int)length.size(), (int)time.size(), (int)sec100.size());
+  long int i0 = 0;
+  if (selector.mode_value == 1 && n > 0) {
+    // Ensembles before both the 'from' and 'to' times have no effect on
+    // the selection, so they may be skipped.
+    int *t = &time[0];
+    if (std::is_sorted(t, t + n)) {
+      int tlim = (int)std::min(selector.from_value, selector.to_value);
+      i0 = std::lower_bound(t, t + n, tlim) - t;
+    }
+  }
+  if (debug[0] > 0)
+    Rprintf("do_ldc_rdi_from_index() starting at ensemble %ld of %ld\n", i0 + 1, n);
+  InputFile mf(fn);
+  if (!mf.ok())
+    ::Rf_error("cannot read file '%s' (%s)\n", fn.c_str(), mf.message());
+  List res;
+  int bad = 0;
+  {
+    std::vector<rdi_ensemble> kept;
+    for (long int i = i0; i < n; i++) {
+      rdi_ensemble e;
+      e.start = (size_t)(start[i] - 1.0); // R to C notation
+      e.length = length[i];
+      e.time = time[i];
+      e.sec100 = sec100[i];
+      if (start[i] < 1.0 || e.start + e.length > mf.size()) {
+        bad = 1;
+        break;
+      }
+      int stop;
+      if (selector.keep(e.time, &stop))
+        kept.push_back(e);
+      if (stop)
+        break;
+    }
+    if (!bad)
+      res = rdi_result(mf.data(), kept);
+  }
+  mf.close();
+  if (bad)
+    ::Rf_error("the index does not match the file '%s'", fn.c_str());
+  return(res);
+}
+
+// State of a tail-following scan, for a file that is still being
+// written. 'good' is the offset just past the last ensemble found,
+// so that bytes beyond it (e.g. a partial ensemble) are examined
+// again by the next call. 'nensemble' counts the ensembles found so
+// far, and 'length_last' is the scanner's 'bytes_to_check_last' value,
+// carried over so that damaged ensembles are handled as in a scan of
+// the whole file.
+typedef struct {
+  std::string filename;
+  size_t good;
+  unsigned long int nensemble;
+  unsigned int length_last;
+} rdi_follow_state;
+
+/*
+
+Open a tail-following scan of an RDI file
+
+@description
+
+Create a handle for do_ldc_rdi_follow(), which reads the ensembles
+that have been appended to a file since the previous call. This is
+meant for files that are still being written, e.g. by an instrument
+that is connected by a cable.
+
+@param filename character string indicating the name of an RDI adp
+file. The file need not exist yet.
+
+@value an external pointer, which is to be handed to
+do_ldc_rdi_follow(). It holds the file name, the position just past
+the last good ensemble, and the number of ensembles found so far.
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+SEXP do_ldc_rdi_follow_open(StringVector filename)
+{
+  rdi_follow_state *state = new rdi_follow_state;
+  state->filename = Rcpp::as<std::string>(filename(0));
+  state->good = 0;
+  state->nensemble = 0;
+  state->length_last = 0;
+  XPtr<rdi_follow_state> handle(state, true);
+  return(handle);
+}
+
+/*
+
+Read the ensembles appended to an RDI file
+
+@description
+
+Scan an RDI file from the position just past the last ensemble found
+by a previous call (or from the start of the file, on the first call),
+and return the ensembles found, in the form used by
+do_ldc_rdi_in_file(). A partial ensemble at the end of the file is not
+reported; it is read by a later call, once the rest of it has been
+written.
+
+@details
+
+The scan gives the same ensembles as do_ldc_rdi_in_file() would give
+for the whole file, with from=1, to=0, by=1 and mode=0.
+
+@param handle an external pointer made by do_ldc_rdi_follow_open().
+
+@param debug integer, 1 or higher to turn on printing.
+
+@value a list holding the items returned by do_ldc_rdi_in_file(), for
+the new ensembles only, along with "first" (integer, the number of the
+first of these ensembles within the file, counting from 1) and
+"pending" (numeric, the number of bytes after the last ensemble, which
+will be examined again by the next call).
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_ldc_rdi_follow(SEXP handle, IntegerVector debug)
+{
+  XPtr<rdi_follow_state> state(handle);
+  std::string fn = state->filename;
+  int debug_value = debug[0];
+  if (debug_value < 0)
+    debug_value = 0;
+  MappedFile mf(fn);
+  if (!mf.ok())
+    ::Rf_error("cannot open file '%s'\n", fn.c_str());
+  const unsigned char *fbuf = mf.data();
+  size_t fsize = mf.size();
+  if (fsize < state->good) {
+    mf.close();
+    ::Rf_error("file '%s' has shrunk from at least %.0f bytes to %.0f bytes, since the last call",
+        fn.c_str(), (double)state->good, (double)fsize);
+  }
+  if (debug_value > 0)
+    Rprintf("do_ldc_rdi_follow() starting at byte %.0f of %.0f, after %lu ensembles\n",
+        (double)state->good, (double)fsize, state->nensemble);
+  RdiScanner scanner(debug_value, 1);
+  scanner.pos = state->good;
+  scanner.bytes_to_check_last = state->length_last;
+  ScanDiagnostics diag(state->good);
+  scanner.diag = &diag;
+  unsigned long int first = state->nensemble + 1;
+  int status;
+  List res;
+  {
+    std::vector<rdi_ensemble> found;
+    rdi_ensemble e;
+    while (RDI_SCAN_ENSEMBLE == (status = scanner.next(fbuf, fsize, &e))) {
+      found.push_back(e);
+      state->good = e.start + e.length;
+      state->length_last = scanner.bytes_to_check_last;
+      state->nensemble++;
+    }
+    // An empty file, or nothing after the last ensemble, just means
+    // that no more data have been written yet.
+    if (status == RDI_SCAN_EMPTY)
+      status = RDI_SCAN_END;
+    if (status >= 0) {
+      res = rdi_result(fbuf, found);
+      res["first"] = (int)first;
+      res["pending"] = (double)(fsize - state->good);
+      // Bytes after the last ensemble are pending, not skipped.
+      diag.finish(state->good);
+      res["diagnostics"] = diag.as_list();
+    }
+  }
+  mf.close();
+  if (status < 0)
+    rdi_scan_error(status, fn, state->nensemble + 1);
+  return(res);
+}
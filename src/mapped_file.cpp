@@ -0,0 +1,110 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+// See mapped_file.h for an explanation.
+
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(const std::string &filename)
+  : ptr(NULL), len(0), is_ok(false), file_handle(NULL), map_handle(NULL)
+{
+  HANDLE fh = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE,
+      NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (fh == INVALID_HANDLE_VALUE)
+    return;
+  LARGE_INTEGER fsize;
+  if (!GetFileSizeEx(fh, &fsize)) {
+    CloseHandle(fh);
+    return;
+  }
+  file_handle = (void*)fh;
+  len = (size_t)fsize.QuadPart;
+  if (len == 0) { // cannot map an empty file, but it is not an error
+    is_ok = true;
+    return;
+  }
+  HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mh == NULL) {
+    close();
+    return;
+  }
+  map_handle = (void*)mh;
+  ptr = (const unsigned char*)MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+  if (ptr == NULL) {
+    close();
+    return;
+  }
+  is_ok = true;
+}
+
+void MappedFile::close()
+{
+  if (ptr)
+    UnmapViewOfFile((LPCVOID)ptr);
+  if (map_handle)
+    CloseHandle((HANDLE)map_handle);
+  if (file_handle)
+    CloseHandle((HANDLE)file_handle);
+  ptr = NULL;
+  map_handle = NULL;
+  file_handle = NULL;
+  len = 0;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &filename)
+  : ptr(NULL), len(0), is_ok(false)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    ::close(fd);
+    return;
+  }
+  len = (size_t)st.st_size;
+  if (len == 0) { // cannot map an empty file, but it is not an error
+    ::close(fd);
+    is_ok = true;
+    return;
+  }
+  void *p = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd); // the mapping holds its own reference to the file
+  if (p == MAP_FAILED) {
+    len = 0;
+    return;
+  }
+#if defined(MADV_SEQUENTIAL)
+  madvise(p, len, MADV_SEQUENTIAL); // a hint only, so ignore failure
+#endif
+  ptr = (const unsigned char*)p;
+  is_ok = true;
+}
+
+void MappedFile::close()
+{
+  if (ptr)
+    munmap((void*)ptr, len);
+  ptr = NULL;
+  len = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+  close();
+}
@@ -0,0 +1,40 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+// Read-only memory mapping of a whole file, used by the binary
+// scanners (e.g. ldc_rdi_in_file.cpp) so that they can examine bytes
+// in place instead of pulling them through stdio one at a time.
+//
+// On unix-like systems this uses mmap(); on windows it uses
+// CreateFileMapping() and MapViewOfFile(). An empty file is mapped
+// as a NULL pointer with size 0, which is not an error.
+//
+// NB. R errors are signalled with a longjmp, which skips C++
+// destructors, so callers should call close() before ::Rf_error().
+
+#ifndef OCE_MAPPED_FILE_H
+#define OCE_MAPPED_FILE_H
+
+#include <stddef.h>
+#include <string>
+
+class MappedFile {
+public:
+  MappedFile(const std::string &filename);
+  ~MappedFile();
+  bool ok() const { return is_ok; }
+  const unsigned char *data() const { return ptr; }
+  size_t size() const { return len; }
+  void close();
+private:
+  MappedFile(const MappedFile&);            // not copyable
+  MappedFile& operator=(const MappedFile&); // not assignable
+  const unsigned char *ptr;
+  size_t len;
+  bool is_ok;
+#if defined(_WIN32)
+  void *file_handle;
+  void *map_handle;
+#endif
+};
+
+#endif
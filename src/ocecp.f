@@ -1,4 +1,5 @@
       subroutine cp_driver(S, T, p, n, cp)
+      integer n
       double precision S(n), T(n), p(n), cp(n)
       do i = 1, n
          call ocecp(S(i), T(i), p(i), cp(i))
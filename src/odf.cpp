@@ -0,0 +1,425 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+#include <Rcpp.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include "input_file.h"
+#include "text_parse.h"
+#include "ctd_readers.h"
+using namespace Rcpp;
+
+// Cross-reference work:
+// 1. update ../src/registerDynamicSymbol.c with an item for this
+// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
+
+// Is the line from 'p' to 'end' the "-- DATA --" line that ends the
+// header? As in read.odf(), only spaces may surround the text.
+static int odf_is_data(const char *p, const char *end)
+{
+  while (p < end && *p == ' ')
+    p++;
+  while (end > p && end[-1] == ' ')
+    end--;
+  return end - p == 10 && !strncmp(p, "-- DATA --", 10);
+}
+
+// Is the line from 'p' to 'end' the start of a PARAMETER_HEADER block?
+static int odf_is_parameter_header(const char *p, const char *end)
+{
+  std::string s = oce_trim(p, end);
+  return s == "PARAMETER_HEADER,";
+}
+
+static const char *odf_month[12] = {
+  "january", "february", "march", "april", "may", "june", "july",
+  "august", "september", "october", "november", "december"
+};
+
+// Read an unsigned integer of at most 'maxdigit' digits.
+static int odf_digits(const char **pp, const char *end, int maxdigit, int *value)
+{
+  const char *p = *pp;
+  int n = 0, v = 0;
+  while (p < end && n < maxdigit && *p >= '0' && *p <= '9') {
+    v = 10 * v + (*p - '0');
+    p++;
+    n++;
+  }
+  if (!n)
+    return 0;
+  *pp = p;
+  *value = v;
+  return 1;
+}
+
+// Days from 1970-01-01 to the given date, in the proleptic Gregorian
+// calendar. Days beyond the end of the month carry into the next
+// month, as for as.POSIXct() of a POSIXlt value.
+static double odf_days(int y, int m, int d)
+{
+  y -= m <= 2;
+  long era = (y >= 0 ? y : y - 399) / 400;
+  long yoe = y - era * 400;
+  long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5;
+  long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return (double)(era * 146097 + doe - 719468) + (d - 1);
+}
+
+// Parse an ODF time string (in SYTM columns) such as
+// "16-DEC-2014 14:09:09.00", storing the number of seconds since
+// 1970-01-01 UTC in *t. This does what
+//   as.POSIXct(strptime(s, "%d-%b-%Y %H:%M:%S", tz="UTC"))
+// does, so the fractional seconds are dropped, and anything after
+// them is ignored.
+static int odf_parse_time(const char *p, const char *end, double *t)
+{
+  int day, month = -1, year, hour, minute, second;
+  p = oce_skip_space(p, end);
+  if (!odf_digits(&p, end, 2, &day) || day < 1 || day > 31)
+    return 0;
+  if (p == end || *p++ != '-')
+    return 0;
+  for (int m = 0; m < 12; m++) {
+    const char *name = odf_month[m];
+    int n = 0;
+    while (p + n < end && name[n] && tolower((unsigned char)p[n]) == name[n])
+      n++;
+    if (n >= 3) {
+      month = m + 1;
+      p += name[n] ? 3 : n; // full name, or abbreviation
+      break;
+    }
+  }
+  if (month < 0)
+    return 0;
+  if (p == end || *p++ != '-')
+    return 0;
+  if (!odf_digits(&p, end, 4, &year))
+    return 0;
+  p = oce_skip_space(p, end);
+  if (!odf_digits(&p, end, 2, &hour) || hour > 23)
+    return 0;
+  if (p == end || *p++ != ':')
+    return 0;
+  if (!odf_digits(&p, end, 2, &minute) || minute > 59)
+    return 0;
+  if (p == end || *p++ != ':')
+    return 0;
+  if (!odf_digits(&p, end, 2, &second) || second > 61)
+    return 0;
+  *t = 86400.0 * odf_days(year, month, day) + 3600.0 * hour + 60.0 * minute + second;
+  return 1;
+}
+
+// A field of the data block. As for scan(), a field that starts with
+// a single or double quote runs to the matching quote (which may be on
+// a later line), and the quotes are removed.
+typedef struct {
+  std::string text;
+  int quoted;
+} odf_field;
+
+static const char *odf_next_field(const char *p, const char *end, odf_field *f)
+{
+  f->text.clear();
+  f->quoted = 0;
+  if (*p == '\'' || *p == '"') {
+    char q = *p++;
+    const char *close = (const char*)memchr(p, q, end - p);
+    if (!close)
+      close = end;
+    f->text.assign(p, close - p);
+    f->quoted = 1;
+    p = close < end ? close + 1 : end;
+  }
+  const char *e = oce_token_end(p, end);
+  f->text.append(p, e - p);
+  return e;
+}
+
+/*
+
+Read an ODF file
+
+@description
+
+Read the header and the data block of an ODF file in a single pass
+through the file, which is held in memory (see input_file.h). The
+header is returned as lines, for interpretation by read.odf(), and
+the data are returned as columns.
+
+@details
+
+The header runs up to the "-- DATA --" line. The number of columns is
+the number of PARAMETER_HEADER blocks in the header. The data block is
+split into fields as scan(what="character") would do, i.e. at
+whitespace, except within quotes, and the fields are taken to fill the
+rows of the data matrix in turn.
+
+As in read.odf(), a column is character if its first field contains a
+letter, and numeric otherwise. A numeric field of "NA", or one that is
+not a number, yields NA. For each character column whose first
+non-missing field is a time (such as "16-DEC-2014 14:09:09.00"), the
+times are returned in "time", as seconds since 1970-01-01 UTC.
+
+@param filename character string indicating the file name.
+
+@value a list containing "header" (character, the lines up to and
+including "-- DATA --"), "dataStart" (integer, the line number of the
+"-- DATA --" line, or 0 if there is none), "ok" (logical, FALSE if
+the number of data fields is not a multiple of the number of
+columns), "data" (a list of columns, or NULL) and "time" (a list
+holding a numeric vector for each column of times, and NULL for other
+columns).
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_read_odf(CharacterVector filename)
+{
+  std::string fn = Rcpp::as<std::string>(filename(0));
+  odf_file f;
+  std::string message;
+  if (!odf_parse(fn, &f, &message))
+    ::Rf_error("cannot read file '%s' (%s)\n", fn.c_str(), message.c_str());
+  return(odf_list(&f));
+}
+
+int odf_parse(const std::string &filename, odf_file *f, std::string *message)
+{
+  InputFile mf(filename);
+  if (!mf.ok()) {
+    *message = mf.message();
+    return 0;
+  }
+  const char *p = (const char*)mf.data();
+  const char *end = p + mf.size();
+
+  // Header
+  std::vector<std::string> &header = f->header;
+  int data_start = 0;
+  size_t ncol = 0;
+  const char *line_end;
+  while (p < end) {
+    const char *next = oce_next_line(p, end, &line_end);
+    header.push_back(std::string(p, line_end - p));
+    if (odf_is_parameter_header(p, line_end))
+      ncol++;
+    p = next;
+    if (odf_is_data(header.back().data(), header.back().data() + header.back().size())) {
+      data_start = header.size();
+      break;
+    }
+  }
+
+  // Data. The type of each column is set by its first field.
+  int ok = data_start > 0 && ncol > 0;
+  std::vector<int> &is_char = f->is_char;
+  std::vector<std::vector<double> > &num = f->num;
+  std::vector<std::vector<std::string> > &chr = f->chr;
+  std::vector<std::vector<int> > &chr_na = f->chr_na;
+  is_char.assign(ncol, 0);
+  num.resize(ncol);
+  chr.resize(ncol);
+  chr_na.resize(ncol);
+  size_t nfield = 0;
+  odf_field field;
+  while (ok) {
+    p = oce_skip_space(p, end);
+    if (p >= end)
+      break;
+    p = odf_next_field(p, end, &field);
+    size_t j = nfield % ncol;
+    int na = !field.quoted && field.text == "NA";
+    if (nfield < ncol) {
+      for (size_t k = 0; k < field.text.size(); k++) {
+        if (isalpha((unsigned char)field.text[k])) {
+          is_char[j] = !na;
+          break;
+        }
+      }
+    }
+    if (is_char[j]) {
+      chr[j].push_back(field.text);
+      chr_na[j].push_back(na);
+    } else {
+      double v;
+      if (na || !oce_parse_number(field.text.data(), field.text.data() + field.text.size(), &v, NULL))
+        v = NA_REAL;
+      num[j].push_back(v);
+    }
+    nfield++;
+  }
+  if (ok && nfield % ncol)
+    ok = 0; // an incomplete row, which scan() and matrix() would recycle
+  mf.close();
+
+  // Times, in character columns whose first non-missing field is a time
+  f->is_time.assign(ncol, 0);
+  f->time.resize(ncol);
+  for (size_t j = 0; ok && j < ncol; j++) {
+    if (!is_char[j])
+      continue;
+    size_t n = chr[j].size();
+    std::vector<double> t(n, NA_REAL);
+    int is_time = -1; // unknown, until the first non-missing field
+    for (size_t i = 0; i < n && is_time; i++) {
+      if (chr_na[j][i])
+        continue;
+      const std::string &s = chr[j][i];
+      double ti;
+      int parsed = odf_parse_time(s.data(), s.data() + s.size(), &ti);
+      if (is_time < 0)
+        is_time = parsed;
+      if (parsed)
+        t[i] = ti;
+    }
+    if (is_time == 1) {
+      f->is_time[j] = 1;
+      f->time[j].swap(t);
+    }
+  }
+  f->data_start = data_start;
+  f->ok = ok;
+  return 1;
+}
+
+List odf_list(odf_file *f)
+{
+  List res;
+  CharacterVector h(f->header.size());
+  for (size_t i = 0; i < f->header.size(); i++)
+    SET_STRING_ELT(h, i, Rf_mkCharCE(f->header[i].c_str(), CE_LATIN1)); // issue 1430 re encoding
+  std::vector<std::string>().swap(f->header);
+  if (f->ok) {
+    size_t ncol = f->is_char.size();
+    List data(ncol), time(ncol);
+    for (size_t j = 0; j < ncol; j++) {
+      if (f->is_char[j]) {
+        size_t n = f->chr[j].size();
+        CharacterVector c(n);
+        for (size_t i = 0; i < n; i++) {
+          if (f->chr_na[j][i])
+            SET_STRING_ELT(c, i, NA_STRING);
+          else
+            c[i] = f->chr[j][i];
+        }
+        data[j] = c;
+        if (f->is_time[j])
+          time[j] = NumericVector(f->time[j].begin(), f->time[j].end());
+        std::vector<std::string>().swap(f->chr[j]);
+      } else {
+        data[j] = NumericVector(f->num[j].begin(), f->num[j].end());
+        std::vector<double>().swap(f->num[j]);
+      }
+    }
+    res = List::create(Named("header")=h, Named("dataStart")=f->data_start,
+        Named("ok")=true, Named("data")=data, Named("time")=time);
+  } else {
+    res = List::create(Named("header")=h, Named("dataStart")=f->data_start,
+        Named("ok")=false, Named("data")=R_NilValue, Named("time")=R_NilValue);
+  }
+  return(res);
+}
+
+/*
+
+Parse the blocks of an ODF header
+
+@description
+
+Split the header lines of an ODF file into blocks, each starting with
+a line such as "EVENT_HEADER," or "PARAMETER_HEADER," and holding
+lines of the form "NAME= VALUE," for ODFListFromHeader().
+
+@details
+
+A block starts at a line that begins with an upper-case letter and
+ends with a comma (after trailing spaces are removed), and its name is
+the part of that line before the first comma. In the lines that
+follow, the name of an item is the text before the first "=", with
+leading spaces removed, and the value is the text after it, with
+leading spaces and one trailing comma removed. If the value starts
+with a single quote, it is removed, along with a matching single
+quote at the end.
+
+@param header character vector holding the header lines.
+
+@value a list containing "names" (character, the block names),
+"blocks" (a list holding, for each block, a character vector of
+values, named by item) and "malformed" (character, lines with a
+value that starts with a single quote but does not end with one).
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_odf_header_list(CharacterVector header)
+{
+  size_t n = header.size();
+  std::vector<std::string> line(n);
+  std::vector<cetype_t> enc(n); // e.g. latin1, from read.odf()
+  for (size_t i = 0; i < n; i++) {
+    enc[i] = Rf_getCharCE(STRING_ELT(header, i));
+    std::string s = Rcpp::as<std::string>(header[i]);
+    size_t e = s.find_last_not_of(' ');
+    s.erase(e == std::string::npos ? 0 : e + 1);
+    line[i] = s;
+  }
+  std::vector<size_t> start;
+  for (size_t i = 0; i < n; i++) {
+    const std::string &s = line[i];
+    if (s.size() > 1 && s[0] >= 'A' && s[0] <= 'Z' && s[s.size()-1] == ',')
+      start.push_back(i);
+  }
+  size_t nblock = start.size();
+  CharacterVector names(nblock);
+  List blocks(nblock);
+  std::vector<size_t> malformed;
+  for (size_t b = 0; b < nblock; b++) {
+    std::string bname = line[start[b]].substr(0, line[start[b]].find(','));
+    SET_STRING_ELT(names, b, Rf_mkCharCE(bname.c_str(), enc[start[b]]));
+    size_t first = start[b] + 1, last = b + 1 < nblock ? start[b+1] : n;
+    CharacterVector value(last - first), item(last - first);
+    for (size_t i = first; i < last; i++) {
+      const std::string &s = line[i];
+      size_t eq = s.find('=');
+      std::string name, v;
+      if (eq == std::string::npos) {
+        name = v = s;
+      } else {
+        size_t ns = s.find_first_not_of(' ');
+        name = s.substr(ns, eq - ns);
+        size_t vs = s.find_first_not_of(' ', eq + 1);
+        v = vs == std::string::npos ? "" : s.substr(vs);
+      }
+      if (v.size() && v[v.size()-1] == ',')
+        v.erase(v.size() - 1);
+      if (v.size() && v[0] == '\'') {
+        v.erase(0, 1);
+        if (v.size() && v[v.size()-1] == '\'')
+          v.erase(v.size() - 1);
+        else
+          malformed.push_back(i);
+      }
+      SET_STRING_ELT(item, i - first, Rf_mkCharCE(name.c_str(), enc[i]));
+      SET_STRING_ELT(value, i - first, Rf_mkCharCE(v.c_str(), enc[i]));
+    }
+    value.attr("names") = item;
+    blocks[b] = value;
+  }
+  CharacterVector bad(malformed.size());
+  for (size_t k = 0; k < malformed.size(); k++)
+    SET_STRING_ELT(bad, k, Rf_mkCharCE(line[malformed[k]].c_str(), enc[malformed[k]]));
+  return(List::create(Named("names")=names, Named("blocks")=blocks,
+        Named("malformed")=bad));
+}
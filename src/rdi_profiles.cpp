@@ -0,0 +1,165 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+#include <Rcpp.h>
+using namespace Rcpp;
+
+// Cross-reference work:
+// 1. update ../src/registerDynamicSymbol.c with an item for this
+// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
+
+//#define DEBUG
+
+/*
+
+Decode RDI velocity, correlation, echo intensity and percent-good data
+
+@description
+
+Fill the 'v', 'q', 'a' and 'g' arrays of read.adp.rdi() in a single
+pass through the buffer returned by do_ldc_rdi_in_file(). This
+replaces R code that built index vectors of length 2*cells*beams for
+every ensemble, and then called readBin() on the gathered bytes.
+
+@details
+
+Each ensemble starts with a header that holds the number of data types
+(at byte 5) and a table of 2-byte offsets to those data types (from
+byte 6). These are read afresh for each ensemble, because files can
+have interlaced data types (see issue 1401). A data type is recognized
+by its first two bytes [1 p124-126], viz.
+    0x00 0x01 velocity (2-byte signed, in mm/s; -32768 means bad)
+    0x00 0x02 correlation (1 byte per item)
+    0x00 0x03 echo intensity (1 byte per item)
+    0x00 0x04 percent good (1 byte per item)
+and in each case the data follow, in cell-major order (i.e. all beams
+for the first cell, then all beams for the second cell, etc).
+Other data types are left for the R code to handle.
+
+@param buf raw vector holding the ensembles, as returned by
+do_ldc_rdi_in_file().
+
+@param ensembleStart integer vector of ensemble starting indices
+within 'buf', in the R (index-from-1) notation.
+
+@param numberOfCells integer, the number of cells.
+
+@param numberOfBeams integer, the number of beams.
+
+@param want integer vector of length 4, with nonzero values indicating
+that 'v', 'q', 'a' and 'g', respectively, should be decoded. Any that
+are not wanted are returned as NULL.
+
+@param velocityScale numeric, the factor for converting velocity
+counts to m/s.
+
+@value a list containing 'v' (a numeric array), and 'q', 'a' and 'g'
+(raw arrays), each of dimension
+c(length(ensembleStart), numberOfCells, numberOfBeams). Velocity
+values are set to NA if they are flagged as bad, or if the ensemble
+lacks velocity data. Raw values for ensembles that lack the data type
+are set to 0x00, as they would be by array(raw(), ...).
+
+@references
+
+1. WorkHorse Commands and Output Data Format_Nov07.pdf
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_rdi_profiles(RawVector buf, IntegerVector ensembleStart, IntegerVector numberOfCells,
+    IntegerVector numberOfBeams, IntegerVector want, NumericVector velocityScale)
+{
+  if (want.size() != 4)
+    ::Rf_error("'want' must be of length 4, but it is of length %d", (int)want.size());
+  int ncell = numberOfCells[0];
+  int nbeam = numberOfBeams[0];
+  if (ncell < 1)
+    ::Rf_error("'numberOfCells' must be positive, but it is %d", ncell);
+  if (nbeam < 1)
+    ::Rf_error("'numberOfBeams' must be positive, but it is %d", nbeam);
+  double scale = velocityScale[0];
+  long int nensemble = ensembleStart.size();
+  long int items = (long int)ncell * nbeam;
+  long int nbuf = buf.size();
+  unsigned char *pbuf = &buf[0];
+#ifdef DEBUG
+  Rprintf("do_rdi_profiles(): nensemble=%ld ncell=%d nbeam=%d nbuf=%ld\n", nensemble, ncell, nbeam, nbuf);
+#endif
+  // The arrays are allocated with length 1 if they are not wanted,
+  // but are returned as NULL in that case.
+  long int n = nensemble * items;
+  NumericVector v(want[0] ? n : 1, NA_REAL);
+  RawVector q(want[1] ? n : 1);
+  RawVector a(want[2] ? n : 1);
+  RawVector g(want[3] ? n : 1);
+  // Item k of the data for ensemble i is for cell k/nbeam and
+  // beam k%nbeam, which goes in R array element [i, cell, beam].
+  // Thus, successive items are written with a stride of nensemble,
+  // when moving through beams, and nensemble*ncell when moving from
+  // the last beam of one cell to the first beam of the next.
+  long int stride_cell = nensemble;
+  long int stride_beam = nensemble * ncell;
+  for (long int i = 0; i < nensemble; i++) {
+    long int e = (long int)ensembleStart[i] - 1; // R to C notation
+    if (e < 0 || e + 6 > nbuf)
+      ::Rf_error("ensembleStart[%ld]=%d is outside the buffer, which has %ld bytes", i+1, ensembleStart[i], nbuf);
+    int ntypes = pbuf[e + 5];
+    for (int type = 0; type < ntypes; type++) {
+      long int ooff = e + 6 + 2 * type;
+      if (ooff + 2 > nbuf)
+        break;
+      long int o = e + (long int)pbuf[ooff] + 256 * (long int)pbuf[ooff + 1];
+      if (o + 2 > nbuf || pbuf[o] != 0x00)
+        continue;
+      int id = pbuf[o + 1];
+      const unsigned char *src = pbuf + o + 2;
+      if (id == 0x01 && want[0]) {
+        if (o + 2 + 2 * items > nbuf)
+          continue;
+        for (int cell = 0; cell < ncell; cell++) {
+          double *dest = &v[i + stride_cell * cell];
+          for (int beam = 0; beam < nbeam; beam++) {
+            short int count = (short int)((unsigned short int)src[0] | ((unsigned short int)src[1] << 8));
+            dest[stride_beam * beam] = count == -32768 ? NA_REAL : scale * count;
+            src += 2;
+          }
+        }
+      } else if ((id == 0x02 && want[1]) || (id == 0x03 && want[2]) || (id == 0x04 && want[3])) {
+        if (o + 2 + items > nbuf)
+          continue;
+        unsigned char *dest0 = (id == 0x02) ? &q[0] : ((id == 0x03) ? &a[0] : &g[0]);
+        for (int cell = 0; cell < ncell; cell++) {
+          unsigned char *dest = dest0 + i + stride_cell * cell;
+          for (int beam = 0; beam < nbeam; beam++)
+            dest[stride_beam * beam] = *src++;
+        }
+      }
+    }
+    if (i % 1000 == 0)
+      R_CheckUserInterrupt();
+  }
+  Dimension dim(nensemble, ncell, nbeam);
+  List res = List::create(Named("v")=R_NilValue, Named("q")=R_NilValue,
+      Named("a")=R_NilValue, Named("g")=R_NilValue);
+  if (want[0]) {
+    v.attr("dim") = dim;
+    res["v"] = v;
+  }
+  if (want[1]) {
+    q.attr("dim") = dim;
+    res["q"] = q;
+  }
+  if (want[2]) {
+    a.attr("dim") = dim;
+    res["a"] = a;
+  }
+  if (want[3]) {
+    g.attr("dim") = dim;
+    res["g"] = g;
+  }
+  return(res);
+}
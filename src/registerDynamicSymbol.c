@@ -3,9 +3,19 @@
 #include <R_ext/Rdynload.h>
 
 extern SEXP _oce_bilinearInterp(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _oce_do_read_cnv(SEXP, SEXP, SEXP);
+extern SEXP _oce_do_read_odf(SEXP);
+extern SEXP _oce_do_odf_header_list(SEXP);
+extern SEXP _oce_do_read_woce_exchange(SEXP, SEXP, SEXP);
+extern SEXP _oce_do_read_ctd_files(SEXP, SEXP, SEXP);
 extern SEXP _oce_do_ad2cp_ahrs(SEXP, SEXP);
+extern SEXP _oce_do_adv_vector(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _oce_do_adv_vector_time(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _oce_do_amsr_composite(SEXP, SEXP);
+extern SEXP _oce_do_amsr_composite_open(SEXP);
+extern SEXP _oce_do_amsr_composite_add(SEXP, SEXP);
+extern SEXP _oce_do_amsr_composite_finish(SEXP);
+extern SEXP _oce_do_biosonics_file(SEXP, SEXP);
 extern SEXP _oce_do_amsr_average(SEXP, SEXP);
 extern SEXP _oce_do_approx3d(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _oce_do_biosonics_ping(SEXP, SEXP, SEXP, SEXP);
@@ -22,12 +32,22 @@ extern SEXP _oce_do_gradient(SEXP, SEXP, SEXP);
 extern SEXP _oce_do_interp_barnes(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _oce_do_landsat_transpose_flip(SEXP);
 extern SEXP _oce_do_landsat_numeric_to_bytes(SEXP, SEXP);
-extern SEXP _oce_do_ldc_ad2cp_in_file(SEXP, SEXP, SEXP, SEXP);
+extern SEXP _oce_do_landsat_band(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _oce_do_ldc_ad2cp_in_file(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _oce_do_ldc_ad2cp_follow_open(SEXP);
+extern SEXP _oce_do_ldc_ad2cp_follow(SEXP);
+extern SEXP _oce_do_ad2cp_records(SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _oce_do_input_file_size(SEXP);
 extern SEXP _oce_do_ldc_rdi_in_file(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _oce_do_ldc_rdi_index(SEXP, SEXP);
+extern SEXP _oce_do_ldc_rdi_from_index(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
+extern SEXP _oce_do_ldc_rdi_follow_open(SEXP);
+extern SEXP _oce_do_ldc_rdi_follow(SEXP, SEXP);
 extern SEXP _oce_do_ldc_sontek_adp(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _oce_do_oceApprox(SEXP, SEXP, SEXP, SEXP);
 extern SEXP _oce_do_oce_convolve(SEXP, SEXP, SEXP);
 extern SEXP _oce_do_oce_filter(SEXP, SEXP, SEXP);
+extern SEXP _oce_do_rdi_profiles(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _oce_do_matrix_smooth(SEXP);
 extern SEXP _oce_do_runlm(SEXP, SEXP, SEXP, SEXP, SEXP);
 extern SEXP _oce_do_sfm_enu(SEXP, SEXP, SEXP, SEXP, SEXP, SEXP);
@@ -36,10 +56,20 @@ extern SEXP _oce_trim_ts(SEXP, SEXP, SEXP);
 
 static const R_CallMethodDef CallEntries[] = {
     {"_oce_bilinearInterp", (DL_FUNC) &_oce_bilinearInterp, 5},
+    {"_oce_do_read_cnv", (DL_FUNC) &_oce_do_read_cnv, 3},
+    {"_oce_do_read_odf", (DL_FUNC) &_oce_do_read_odf, 1},
+    {"_oce_do_odf_header_list", (DL_FUNC) &_oce_do_odf_header_list, 1},
+    {"_oce_do_read_woce_exchange", (DL_FUNC) &_oce_do_read_woce_exchange, 3},
+    {"_oce_do_read_ctd_files", (DL_FUNC) &_oce_do_read_ctd_files, 3},
     {"_oce_do_ad2cp_ahrs", (DL_FUNC) &_oce_do_ad2cp_ahrs, 2},
+    {"_oce_do_adv_vector", (DL_FUNC) &_oce_do_adv_vector, 8},
     {"_oce_do_adv_vector_time", (DL_FUNC) &_oce_do_adv_vector_time, 7},
     {"_oce_do_amsr_average", (DL_FUNC) &_oce_do_amsr_average, 2},
     {"_oce_do_amsr_composite", (DL_FUNC) &_oce_do_amsr_composite, 2},
+    {"_oce_do_amsr_composite_open", (DL_FUNC) &_oce_do_amsr_composite_open, 1},
+    {"_oce_do_amsr_composite_add", (DL_FUNC) &_oce_do_amsr_composite_add, 2},
+    {"_oce_do_amsr_composite_finish", (DL_FUNC) &_oce_do_amsr_composite_finish, 1},
+    {"_oce_do_biosonics_file", (DL_FUNC) &_oce_do_biosonics_file, 2},
     {"_oce_do_approx3d", (DL_FUNC) &_oce_do_approx3d, 7},
     {"_oce_do_biosonics_ping", (DL_FUNC) &_oce_do_biosonics_ping, 4},
     {"_oce_do_curl1", (DL_FUNC) &_oce_do_curl1, 5},
@@ -55,11 +85,21 @@ static const R_CallMethodDef CallEntries[] = {
     {"_oce_do_gradient", (DL_FUNC) &_oce_do_gradient, 3},
     {"_oce_do_landsat_transpose_flip", (DL_FUNC) &_oce_do_landsat_transpose_flip, 1},
     {"_oce_do_landsat_numeric_to_bytes", (DL_FUNC) &_oce_do_landsat_numeric_to_bytes, 2},
-    {"_oce_do_ldc_ad2cp_in_file", (DL_FUNC) &_oce_do_ldc_ad2cp_in_file, 4},
+    {"_oce_do_landsat_band", (DL_FUNC) &_oce_do_landsat_band, 6},
+    {"_oce_do_ldc_ad2cp_in_file", (DL_FUNC) &_oce_do_ldc_ad2cp_in_file, 6},
+    {"_oce_do_ldc_ad2cp_follow_open", (DL_FUNC) &_oce_do_ldc_ad2cp_follow_open, 1},
+    {"_oce_do_ldc_ad2cp_follow", (DL_FUNC) &_oce_do_ldc_ad2cp_follow, 1},
+    {"_oce_do_ad2cp_records", (DL_FUNC) &_oce_do_ad2cp_records, 5},
+    {"_oce_do_input_file_size", (DL_FUNC) &_oce_do_input_file_size, 1},
     {"_oce_do_ldc_rdi_in_file", (DL_FUNC) &_oce_do_ldc_rdi_in_file, 6},
+    {"_oce_do_ldc_rdi_index", (DL_FUNC) &_oce_do_ldc_rdi_index, 2},
+    {"_oce_do_ldc_rdi_from_index", (DL_FUNC) &_oce_do_ldc_rdi_from_index, 10},
+    {"_oce_do_ldc_rdi_follow_open", (DL_FUNC) &_oce_do_ldc_rdi_follow_open, 1},
+    {"_oce_do_ldc_rdi_follow", (DL_FUNC) &_oce_do_ldc_rdi_follow, 2},
     {"_oce_do_ldc_sontek_adp", (DL_FUNC) &_oce_do_ldc_sontek_adp, 6},
     {"_oce_do_oceApprox", (DL_FUNC) &_oce_do_oceApprox, 4},
     {"_oce_do_oce_filter", (DL_FUNC) &_oce_do_oce_filter, 3},
+    {"_oce_do_rdi_profiles", (DL_FUNC) &_oce_do_rdi_profiles, 6},
     {"_oce_do_oce_convolve", (DL_FUNC) &_oce_do_oce_convolve, 3},
     {"_oce_do_matrix_smooth", (DL_FUNC) &_oce_do_matrix_smooth, 1},
     {"_oce_do_runlm", (DL_FUNC) &_oce_do_runlm, 5},
@@ -0,0 +1,105 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+// Counters describing the health of a file, collected by the binary
+// scanners (ldc_rdi_in_file.cpp and ldc_ad2cp_in_file.cpp) instead of
+// printing a line for every problem they find. A damaged file can
+// have hundreds of thousands of problems, so only the first
+// SCAN_SAMPLE_MAX of them are recorded individually.
+//
+// The list made by as_list() is returned to R as the "diagnostics"
+// item of the scanner results, and is stored by the readers in the
+// 'scanDiagnostics' item of the metadata.
+
+#ifndef OCE_SCAN_DIAGNOSTICS_H
+#define OCE_SCAN_DIAGNOSTICS_H
+
+#include <Rcpp.h>
+#include <vector>
+#include <chrono>
+
+#define SCAN_SAMPLE_MAX 100
+
+// Types of event. Their names, as used in R, are in scan_event_name[].
+#define SCAN_CHECKSUM 0   // a record whose checksum is wrong
+#define SCAN_RESYNC 1     // a restart after a bad checksum or start
+#define SCAN_BAD_START 2  // bytes where a record should have started
+#define SCAN_BAD_ID 3     // a record with an unknown id
+#define SCAN_BAD_HEADER 4 // a header that is not of the expected type
+#define SCAN_TRUNCATED 5  // a record that runs past the end of the file
+#define SCAN_NTYPE 6
+
+static const char *scan_event_name[SCAN_NTYPE] = {
+  "checksum", "resync", "badStart", "badId", "badHeader", "truncated"
+};
+
+class ScanDiagnostics {
+public:
+  // 'first' is the byte at which scanning starts, which is not 0 for
+  // the do_ldc_*_follow() functions.
+  ScanDiagnostics(size_t first=0) : records(0), bytes_scanned(0), bytes_skipped(0), good_end(first),
+    first(first), seconds(0),
+    start(std::chrono::steady_clock::now())
+  {
+    for (int i = 0; i < SCAN_NTYPE; i++)
+      count[i] = 0;
+  }
+  // Note a problem, at byte 'offset' (counting from 0).
+  void event(int type, size_t offset)
+  {
+    count[type]++;
+    if (type_sample.size() < SCAN_SAMPLE_MAX) {
+      type_sample.push_back(type);
+      offset_sample.push_back(offset);
+    }
+  }
+  // Note a good record, occupying 'length' bytes from 'offset'. Any
+  // bytes between this and the previous good record were skipped.
+  void record(size_t offset, size_t length)
+  {
+    records++;
+    if (offset > good_end)
+      bytes_skipped += offset - good_end;
+    good_end = offset + length;
+  }
+  // Note the end of the scan, at byte 'offset'.
+  void finish(size_t offset)
+  {
+    bytes_scanned = offset > first ? offset - first : 0;
+    if (offset > good_end)
+      bytes_skipped += offset - good_end;
+    good_end = offset;
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+  Rcpp::List as_list() const
+  {
+    size_t n = type_sample.size();
+    Rcpp::CharacterVector etype(n);
+    Rcpp::NumericVector eoffset(n);
+    for (size_t i = 0; i < n; i++) {
+      etype[i] = scan_event_name[type_sample[i]];
+      eoffset[i] = 1.0 + (double)offset_sample[i]; // R index-from-1 notation
+    }
+    return Rcpp::List::create(
+        Rcpp::Named("bytesScanned")=(double)bytes_scanned,
+        Rcpp::Named("records")=(double)records,
+        Rcpp::Named("checksumFailures")=(double)count[SCAN_CHECKSUM],
+        Rcpp::Named("resyncs")=(double)count[SCAN_RESYNC],
+        Rcpp::Named("badStarts")=(double)count[SCAN_BAD_START],
+        Rcpp::Named("badIds")=(double)count[SCAN_BAD_ID],
+        Rcpp::Named("badHeaders")=(double)count[SCAN_BAD_HEADER],
+        Rcpp::Named("truncated")=(double)count[SCAN_TRUNCATED],
+        Rcpp::Named("bytesSkipped")=(double)bytes_skipped,
+        Rcpp::Named("seconds")=seconds,
+        Rcpp::Named("eventType")=etype,
+        Rcpp::Named("eventOffset")=eoffset);
+  }
+private:
+  size_t records, bytes_scanned, bytes_skipped, good_end, first;
+  size_t count[SCAN_NTYPE];
+  double seconds;
+  std::chrono::steady_clock::time_point start;
+  std::vector<int> type_sample;
+  std::vector<size_t> offset_sample;
+};
+
+#endif
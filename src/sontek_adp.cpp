@@ -1,27 +1,50 @@
 /* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
 
 #include <Rcpp.h>
+#include <vector>
+#include "checksum.h"
 using namespace Rcpp;
 
 // Cross-reference work:
 // 1. update ../src/registerDynamicSymbol.c with an item for this
 // 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
-//
+
+//#define DEBUG
+
+// Lengths of the optional blocks that follow the 80-byte profile
+// header, in the order CTD, GPS, bottom track; see ref 1 below.
+#define SONTEK_CTD_LENGTH 16
+#define SONTEK_GPS_LENGTH 40
+#define SONTEK_BT_LENGTH 18
+
+static inline int sontek_checksum_ok(const unsigned char *p, int chunk_length)
+{
+  unsigned short int check_sum = ((unsigned short)0xa5<<8) | ((unsigned short)0x96); /* manual p96 says 0xA596; assume little-endian */
+  unsigned short int desired_check_sum = ((unsigned short)p[chunk_length]) | ((unsigned short)p[chunk_length+1] << 8);
+  check_sum += oce_sum_bytes(p, chunk_length);
+  return check_sum == desired_check_sum;
+}
+
 // [[Rcpp::export]]
 IntegerVector do_ldc_sontek_adp(RawVector buf, IntegerVector have_ctd, IntegerVector have_gps, IntegerVector have_bottom_track, IntegerVector pcadp, IntegerVector max)
 {
-  /*
-   #define DEBUG
-   */
-
-  // ldc = locate data chunk; _sontek_adp = for a SonTek ADV.
+  // ldc = locate data chunk; _sontek_adp = for a SonTek ADP.
   // Arguments:
   //   buf = buffer with data
-  //   Shave_ctd = 1 if have CTD data (must be 0, for this version)
-  //   Shave_gps = 1 if have GPS data (must be 0, for this version)
-  //   Shave_bottom_track = 1 if have bottom-track data (must be 0, for this version)
-  //   Spcadp = 1 if device is a PCADP (which has longer headers)
-  //   Smax = number of profiles to get (set to <0 to get all)
+  //   have_ctd = 1 if have CTD data, 0 if not, or NA (or negative)
+  //     to infer this from the checksum of the first profile
+  //   have_gps = as have_ctd, but for GPS data
+  //   have_bottom_track = as have_ctd, but for bottom-track data
+  //   pcadp = 1 if device is a PCADP (which has longer headers)
+  //   max = number of profiles to get (set to <=0 to get all)
+  //
+  // Value:
+  //   Integer vector of profile starting points, in R (index-from-1)
+  //   notation, or NA if no profiles are found. Attributes give the
+  //   layout that was used: "haveCTD", "haveGPS" and "haveBottomTrack"
+  //   are 0 or 1, "chunkLength" is the number of bytes in a profile
+  //   (not counting the 2-byte checksum) and "dataOffset" is the
+  //   offset from the start of a profile to the velocity data.
   //
   // Method:
   //   The code checks for bytes as follows, and does a checksum on
@@ -31,6 +54,15 @@ IntegerVector do_ldc_sontek_adp(RawVector buf, IntegerVector have_ctd, IntegerVe
   //       2    0x10 (flag 2)
   //       3    0x50 (decimal 80, number of bytes in header)
   //       4+   See ADPManual_710.pdf, logical page 84 et seq.
+  //   The header is followed by the optional CTD, GPS and
+  //   bottom-track blocks (in that order) and then by the
+  //   velocity, standard-deviation and amplitude data. If any of
+  //   the have_* arguments are NA, the layouts that they permit
+  //   are tried on the first profiles, shortest first, and the
+  //   first one with a valid checksum is used for the rest of the
+  //   file.  Each candidate is checksummed once, and after a valid
+  //   profile is found, the scan resumes at the byte after its
+  //   checksum.
   //
   // REFERENCES
   //   1. see ADPManual_710.pdf, logical pages 82-86.
@@ -41,29 +73,18 @@ IntegerVector do_ldc_sontek_adp(RawVector buf, IntegerVector have_ctd, IntegerVe
 #ifdef DEBUG
   Rprintf("have_ctd=%d, have_bottom_track=%d, have_gps=%d, max=%d\n",have_ctd[0],have_bottom_track[0],have_gps[0],max[0]);
 #endif
-  if (have_ctd[0] != 0)
-    ::Rf_error("cannot read SonTek ADP files with CTD data");
-  if (have_bottom_track[0] != 0)
-    ::Rf_error("cannot read SonTek ADP files with bottom-track data");
-  if (have_gps[0] != 0)
-    ::Rf_error("cannot read SonTek ADP files with GPS data");
   int nbuf = buf.size();
 #ifdef DEBUG
   Rprintf("nbuf=%d\n", nbuf);
 #endif
-  /* Count matches, so we can allocate the right length */
-  unsigned int matches = 0;
-  unsigned short int check_sum_start = ((unsigned short)0xa5<<8)  | ((unsigned short)0x96); /* manual p96 says 0xA596; assume little-endian */
-  if (max[0] < 0)
-    max[0] = 0;
+  int nmax = max[0] > 0 ? max[0] : 0;
   /* scan first profile to determine ncell and nbeam */
   int first_look = 1000;
   if (first_look > nbuf)
     ::Rf_error("cannot read Sontek ADP from a buffer with fewer than 1000 bytes");
-  int i;
+  int first = -1;
   int ncell = -1, nbeam = -1;
-  for (i = 0; i < first_look - 3; i++) { /* note that we don't look to the very end */
-    //Rprintf(" %d: %x %x %x (%x %x %x)\n", i, buf[i], buf[i+1], buf[i+2], byte1, byte2, byte3);
+  for (int i = 0; i < first_look - 3; i++) { /* note that we don't look to the very end */
     if (buf[i] == byte1 && buf[i+1] == byte2 && buf[i+2] == byte3) {
       nbeam = (int)buf[i + 26];
       ncell = ((unsigned short)buf[i+30]) | ((unsigned short)buf[i+31] << 8);
@@ -75,71 +96,104 @@ IntegerVector do_ldc_sontek_adp(RawVector buf, IntegerVector have_ctd, IntegerVe
         ::Rf_error("number of beams must be 2 or 3, but it is %d", nbeam);
       if (ncell < 1)
         ::Rf_error("number of cells cannot be less than 1, but it is %d", ncell);
+      first = i;
       break;
     }
   }
   if (nbeam < 0 || ncell < 0)
     ::Rf_error("cannot determine #beams or #cells, based on first 1000 bytes in buffer");
-  // The next line envisions more data streams, e.g. ctd.
-  int chunk_length = 80 + (have_ctd[0]?16:0) + (have_gps[0]?40:0) + (have_bottom_track[0]?18:0) + 4 * ncell * nbeam;
   // Next 2 lines acount for extra header in each PCADP profile; see ref 2.
   int max_beams = 4;
   int pcadp_extra_header_length = 2*(8+max_beams) + 2*max_beams + max_beams;
-  if (pcadp[0])
-    chunk_length += pcadp_extra_header_length;
-  int bad = 0, maxbad = 100;
+  int header_length = 80 + (pcadp[0] ? pcadp_extra_header_length : 0);
+  int profile_length = 4 * ncell * nbeam;
+  // Work out which optional blocks are present. Bit 0 is for CTD,
+  // bit 1 for GPS and bit 2 for bottom track. Of the layouts allowed
+  // by the arguments, the first (shortest) to pass the checksum on
+  // one of the first few profiles is chosen; if none does, missing
+  // flags are taken to be 0.
+  int want[3] = {have_ctd[0], have_gps[0], have_bottom_track[0]};
+  int block_length[3] = {SONTEK_CTD_LENGTH, SONTEK_GPS_LENGTH, SONTEK_BT_LENGTH};
+  int layout = -1, layout_default = 0;
+  for (int b = 0; b < 3; b++)
+    if (want[b] > 0)
+      layout_default |= 1 << b;
+  int order[8] = {0, 1, 4, 5, 2, 3, 6, 7}; // by increasing length
+  int tries = 0, max_tries = 10;
+  for (int i = first; i < nbuf - 3 && tries < max_tries && layout < 0; i++) {
+    if (buf[i] != byte1 || buf[i+1] != byte2 || buf[i+2] != byte3)
+      continue;
+    tries++;
+    for (int k = 0; k < 8 && layout < 0; k++) {
+      int trial = order[k];
+      int chunk_length = header_length + profile_length, ok = 1;
+      for (int b = 0; b < 3; b++) {
+        int bit = (trial >> b) & 1;
+        if ((want[b] == 0 && bit) || (want[b] > 0 && !bit))
+          ok = 0;
+        if (bit)
+          chunk_length += block_length[b];
+      }
+      if (ok && i + chunk_length + 2 <= nbuf && sontek_checksum_ok(&buf[i], chunk_length))
+        layout = trial;
+    }
+  }
+  if (layout < 0)
+    layout = layout_default;
+  int data_offset = header_length;
+  for (int b = 0; b < 3; b++)
+    if ((layout >> b) & 1)
+      data_offset += block_length[b];
+  int chunk_length = data_offset + profile_length;
+  int bad = 0, maxbad = 100, too_bad = 0;
 #ifdef DEBUG
   Rprintf("pcadp=%d pcadp_extra_header_length=%d max_beams=%d\n", pcadp[0], pcadp_extra_header_length, max_beams);
   Rprintf("bytes: 0x%x 0x%x 0x%x\n", byte1, byte2, byte3);
-  Rprintf("chunk_length: %d\n", chunk_length);
+  Rprintf("layout: %d, chunk_length: %d\n", layout, chunk_length);
 #endif
+  // Interrupts are checked with Rcpp::checkUserInterrupt(), which
+  // throws an exception, so that 'starts' is released, and every
+  // 'check_interval' bytes; a test on 'i' would be skipped, since 'i'
+  // jumps by whole profiles.
+  std::vector<int> starts;
+  int check_interval = 10000000, next_check = check_interval;
   for (int i = 0; i < nbuf - 3 - chunk_length; i++) { // FIXME is 3 right, or needed?
     if (buf[i] == byte1 && buf[i+1] == byte2 && buf[i+2] == byte3) {
-      unsigned short int check_sum = check_sum_start; // RHS is fixed
-      unsigned short int desired_check_sum = ((unsigned short)buf[i+chunk_length]) | ((unsigned short)buf[i+chunk_length+1] << 8);
-      for (int c = 0; c < chunk_length; c++)
-        check_sum += (unsigned short int)buf[i + c];
-      if (check_sum == desired_check_sum) {
-        matches++;
+      if (sontek_checksum_ok(&buf[i], chunk_length)) {
 #ifdef DEBUG
-        Rprintf("OK  at buf[%d]: check_sum=%d (should be %d); check_sum_start=%d\n",
-            i, check_sum, desired_check_sum, check_sum_start);
+        Rprintf("OK  at buf[%d]\n", i);
 #endif
-        if (max[0] != 0 && matches >= (unsigned int)max[0])
+        starts.push_back(i + 1); /* the +1 is to get R pointers */
+        if (nmax != 0 && starts.size() >= (size_t)nmax)
           break;
+        i += chunk_length + 1; // skip profile and checksum (loop adds 1)
       } else {
 #ifdef DEBUG
-        Rprintf("BAD at buf[%d]: check_sum=%d (should be %d); check_sum_start=%d\n",
-            i, check_sum, desired_check_sum, check_sum_start);
+        Rprintf("BAD at buf[%d]\n", i);
 #endif
-        if (bad++ > maxbad)
-          ::Rf_error("bad=%d exceeds maxbad=%d\n", bad, maxbad);
-      }
-    }
-  }
-  /* allocate space, then run through whole buffer again, noting the matches */
-  unsigned int nres = matches;
-  IntegerVector res(nres>0?nres:1, 1);
-  if (nres > 0) {
-#ifdef DEBUG
-    Rprintf("getting space for %d matches\n", nres);
-#endif
-    unsigned int ires = 0;
-    for (int i=0; i<(nbuf-3-chunk_length); i++) { // FIXME is 3 right, or needed?
-      if (buf[i] == byte1 && buf[i+1] == byte2 && buf[i+2] == byte3) {
-        unsigned short int check_sum = check_sum_start; // RHS is fixed
-        unsigned short int desired_check_sum = ((unsigned short)buf[i+chunk_length]) | ((unsigned short)buf[i+chunk_length+1] << 8);
-        for (int c = 0; c < chunk_length; c++)
-          check_sum += (unsigned short int)buf[i + c];
-        if (check_sum == desired_check_sum)
-          res[ires++] = i + 1; /* the +1 is to get R pointers */
-        if (ires > nres)        /* FIXME: or +1? */
+        if (bad++ > maxbad) {
+          too_bad = 1;
           break;
+        }
       }
     }
-    return(res);
-  } else {
-    res[0] = NA_INTEGER;
+    if (i >= next_check) {
+      Rcpp::checkUserInterrupt();
+      next_check = i + check_interval;
+    }
+  }
+  if (too_bad) {
+    // release the storage first, since ::Rf_error() does not return
+    std::vector<int>().swap(starts);
+    ::Rf_error("bad=%d exceeds maxbad=%d\n", bad, maxbad);
   }
+  IntegerVector res(starts.size() > 0 ? starts.size() : 1, NA_INTEGER);
+  for (size_t k = 0; k < starts.size(); k++)
+    res[k] = starts[k];
+  res.attr("haveCTD") = layout & 1;
+  res.attr("haveGPS") = (layout >> 1) & 1;
+  res.attr("haveBottomTrack") = (layout >> 2) & 1;
+  res.attr("chunkLength") = chunk_length;
+  res.attr("dataOffset") = data_offset;
   return(res);
 }
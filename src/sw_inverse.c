@@ -0,0 +1,242 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/* See sw_inverse.h for the purpose of these functions. Like
+ * sw_unesco.c, this file does not use R, so that it can be compiled
+ * into the test program in ../sandbox/sw_inverse.
+ *
+ * The OpenMP loops here and in sw.c are C, but the package is linked
+ * with the C++ OpenMP flag. The configure script therefore compiles
+ * them with OpenMP only if the C and C++ flags are the same; otherwise
+ * _OPENMP is undefined, and the loops run serially. */
+
+#include <math.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "sw_unesco.h"
+#include "sw_inverse.h"
+
+/* R's NA_real_; see sw_unesco.c */
+static double na_real(void)
+{
+  unsigned long long bits = 0x7FF00000000007A2ULL;
+  double x;
+  memcpy(&x, &bits, sizeof x);
+  return x;
+}
+
+/* A function whose root is sought, returning f(x) and setting *dfdx.
+ * The context holds the other arguments. */
+typedef double (*root_function)(double x, const void *context, double *dfdx);
+
+/* Find a root of f in [x1,x2], which must bracket it, by Newton
+ * iteration, taking a bisection step instead whenever the Newton step
+ * would leave the current bracket, or would not halve the step before
+ * last, or the derivative is not finite (as in Numerical Recipes'
+ * rtsafe()). The iteration starts at the secant point, and ends when a
+ * step is smaller than xtol. Returns NA if the interval does not
+ * bracket a root, if maxit iterations are not enough, or if |f| then
+ * exceeds ftol, as it does if the search closes in on a pole of f
+ * rather than a root. */
+static double newton_root(root_function f, const void *context,
+    double x1, double x2, double xtol, double ftol, int maxit)
+{
+  double f1, f2, df, lo, hi, x, fx, dx, dxold;
+  f1 = f(x1, context, &df);
+  f2 = f(x2, context, &df);
+  if (isnan(f1) || isnan(f2) || f1 * f2 > 0.0)
+    return na_real();
+  if (f1 == 0.0)
+    return x1;
+  if (f2 == 0.0)
+    return x2;
+  /* keep f(lo) < 0 < f(hi) */
+  if (f1 < 0.0) {
+    lo = x1;
+    hi = x2;
+  } else {
+    lo = x2;
+    hi = x1;
+  }
+  x = x1 - f1 * (x2 - x1) / (f2 - f1);
+  dxold = dx = fabs(x2 - x1);
+  fx = f(x, context, &df);
+  for (int iter = 0; iter < maxit; iter++) {
+    if (fx == 0.0)
+      return x;
+    if (isnan(fx))
+      return na_real();
+    if (fx < 0.0)
+      lo = x;
+    else
+      hi = x;
+    double xnew = x - fx / df;
+    if (!isfinite(xnew) || (xnew - lo) * (xnew - hi) >= 0.0 || fabs(2.0 * fx) > fabs(dxold * df)) {
+      dxold = dx;
+      dx = 0.5 * (hi - lo);
+      x = lo + dx;
+    } else {
+      dxold = dx;
+      dx = x - xnew;
+      x = xnew;
+    }
+    if (fabs(dx) < xtol)
+      return fabs(fx) <= ftol ? x : na_real();
+    fx = f(x, context, &df);
+  }
+  return na_real();
+}
+
+/* Context for a conductivity ratio, at salinity S */
+typedef struct {
+  double S, T, p;
+} CSTp_context;
+
+static double CSTp_f(double C, const void *context, double *dfdx)
+{
+  const CSTp_context *c = (const CSTp_context *) context;
+  return oce_unesco_salinity(C, c->T, c->p, dfdx) - c->S;
+}
+
+void oce_unesco_CSTp(int n, const double *S, const double *T, const double *p,
+    int nthreads, double *value)
+{
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads < 1 ? 1 : nthreads)
+#endif
+  for (int i = 0; i < n; i++) {
+    if (isnan(S[i]) || isnan(T[i]) || isnan(p[i])) {
+      value[i] = na_real();
+    } else {
+      CSTp_context c = {S[i], T[i], p[i]};
+      value[i] = newton_root(CSTp_f, &c, 0.0, 5.0, 1e-12, 1e-10, 100);
+    }
+  }
+}
+
+// 2014-12-20 copy the gsw code (moved from sw.c, with the derivative
+// with respect to sa added).
+static double gsw_rho(double sa, double ct, double p, double *drho_dsa)
+{
+  double v01 =  9.998420897506056e+2, v02 =  2.839940833161907e0,
+         v03 = -3.147759265588511e-2, v04 =  1.181805545074306e-3,
+         v05 = -6.698001071123802e0,  v06 = -2.986498947203215e-2,
+         v07 =  2.327859407479162e-4, v08 = -3.988822378968490e-2,
+         v09 =  5.095422573880500e-4, v10 = -1.426984671633621e-5,
+         v11 =  1.645039373682922e-7, v12 = -2.233269627352527e-2,
+         v13 = -3.436090079851880e-4, v14 =  3.726050720345733e-6,
+         v15 = -1.806789763745328e-4, v16 =  6.876837219536232e-7,
+         v17 = -3.087032500374211e-7, v18 = -1.988366587925593e-8,
+         v19 = -1.061519070296458e-11,v20 =  1.550932729220080e-10,
+         v21 =  1.0e0,
+         v22 =  2.775927747785646e-3, v23 = -2.349607444135925e-5,
+         v24 =  1.119513357486743e-6, v25 =  6.743689325042773e-10,
+         v26 = -7.521448093615448e-3, v27 = -2.764306979894411e-5,
+         v28 =  1.262937315098546e-7, v29 =  9.527875081696435e-10,
+         v30 = -1.811147201949891e-11, v31 = -3.303308871386421e-5,
+         v32 =  3.801564588876298e-7, v33 = -7.672876869259043e-9,
+         v34 = -4.634182341116144e-11, v35 =  2.681097235569143e-12,
+         v36 =  5.419326551148740e-6, v37 = -2.742185394906099e-5,
+         v38 = -3.212746477974189e-7, v39 =  3.191413910561627e-9,
+         v40 = -1.931012931541776e-12, v41 = -1.105097577149576e-7,
+         v42 =  6.211426728363857e-10, v43 = -1.119011592875110e-10,
+         v44 = -1.941660213148725e-11, v45 = -1.864826425365600e-14,
+         v46 =  1.119522344879478e-14, v47 = -1.200507748551599e-15,
+         v48 =  6.057902487546866e-17;
+  double sqrtsa, v_hat_denominator, v_hat_numerator, d_denominator, d_numerator;
+
+  sqrtsa = sqrt(sa);
+
+  v_hat_denominator =
+    v01 + ct*(v02 + ct*(v03 + v04*ct))
+    + sa*(v05 + ct*(v06 + v07*ct)
+        + sqrtsa*(v08 + ct*(v09 + ct*(v10 + v11*ct))))
+    + p*(v12 + ct*(v13 + v14*ct) + sa*(v15 + v16*ct)
+        + p*(v17 + ct*(v18 + v19*ct) + v20*sa));
+
+  v_hat_numerator =
+    v21 + ct*(v22 + ct*(v23 + ct*(v24 + v25*ct)))
+    + sa*(v26 + ct*(v27 + ct*(v28 + ct*(v29 + v30*ct)))
+        + v36*sa
+        + sqrtsa*(v31 + ct*(v32 + ct*(v33 + ct*(v34+v35*ct)))))
+    + p*(v37 + ct*(v38 + ct*(v39 + v40*ct))
+        + sa*(v41 + v42*ct)
+        + p*(v43 + ct*(v44 + v45*ct + v46*sa)
+          + p*(v47 + v48*ct)));
+
+  d_denominator =
+    v05 + ct*(v06 + v07*ct)
+    + 1.5*sqrtsa*(v08 + ct*(v09 + ct*(v10 + v11*ct)))
+    + p*(v15 + v16*ct + p*v20);
+
+  d_numerator =
+    v26 + ct*(v27 + ct*(v28 + ct*(v29 + v30*ct)))
+    + 2.0*v36*sa
+    + 1.5*sqrtsa*(v31 + ct*(v32 + ct*(v33 + ct*(v34+v35*ct))))
+    + p*(v41 + v42*ct + p*v46*ct);
+
+  *drho_dsa = (d_denominator*v_hat_numerator - v_hat_denominator*d_numerator) /
+    (v_hat_numerator*v_hat_numerator);
+  return (v_hat_denominator/v_hat_numerator);
+}
+
+/* Context for a density, 1000+sigma, at salinity S or temperature T */
+typedef struct {
+  double S, T, p, sigma;
+  int teos;
+} rho_context;
+
+static double strho_f(double S, const void *context, double *dfdx)
+{
+  const rho_context *c = (const rho_context *) context;
+  double rho, drhodT;
+  if (c->teos)
+    rho = gsw_rho(S, c->T, c->p, dfdx);
+  else
+    rho = oce_unesco_rho_derivs(S, c->T, c->p, dfdx, &drhodT);
+  return rho - 1000.0 - c->sigma;
+}
+
+static double tsrho_f(double T, const void *context, double *dfdx)
+{
+  const rho_context *c = (const rho_context *) context;
+  double drhodS;
+  return oce_unesco_rho_derivs(c->S, T, c->p, &drhodS, dfdx) - 1000.0 - c->sigma;
+}
+
+void oce_unesco_strho(int n, const double *T, const double *sigma, const double *p,
+    int teos, int nthreads, double *value)
+{
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads < 1 ? 1 : nthreads)
+#endif
+  for (int i = 0; i < n; i++) {
+    if (isnan(T[i]) || isnan(sigma[i]) || isnan(p[i])) {
+      value[i] = na_real();
+    } else {
+      rho_context c = {0.0, T[i], p[i], sigma[i], teos};
+      value[i] = newton_root(strho_f, &c, 0.0, 500.0, 1e-10, 1e-3, 100);
+    }
+  }
+}
+
+void oce_unesco_tsrho(int n, const double *S, const double *sigma, const double *p,
+    int nthreads, double *value)
+{
+  /* NOTE: do not use wide values for the temperature range, because
+   * the UNESCO equation of state rho() may be odd in such limits,
+   * preventing the search from working. The range below should be OK
+   * for oceanographic use. */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads < 1 ? 1 : nthreads)
+#endif
+  for (int i = 0; i < n; i++) {
+    if (isnan(S[i]) || isnan(sigma[i]) || isnan(p[i])) {
+      value[i] = na_real();
+    } else {
+      rho_context c = {S[i], 0.0, p[i], sigma[i], 0};
+      value[i] = newton_root(tsrho_f, &c, -3.0, 40.0, 1e-10, 1e-4, 100);
+    }
+  }
+}
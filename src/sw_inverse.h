@@ -0,0 +1,41 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/*
+ * Inverses of the UNESCO (EOS-80) seawater formulae, called by sw.c:
+ * conductivity ratio from salinity (for swCSTp), salinity from
+ * temperature and density (swSTrho) and temperature from salinity and
+ * density (swTSrho). Each fills value[0:n-1] from the n-element
+ * inputs, setting value[i] to NA if an input is NA at i, if no root
+ * lies in the search interval, or if the solver fails to converge.
+ *
+ * The roots are found by a Newton iteration that is safeguarded by
+ * bisection, using analytic derivatives. The state of each solution is
+ * held in a context structure, so the samples are solved
+ * independently, in 'nthreads' threads if OpenMP is available.
+ */
+
+#ifndef OCE_SW_INVERSE_H
+#define OCE_SW_INVERSE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Conductivity ratio C in [0,5], such that the practical salinity is S */
+void oce_unesco_CSTp(int n, const double *S, const double *T, const double *p,
+    int nthreads, double *value);
+
+/* Salinity in [0,500] such that the density is 1000+sigma. If teos is
+ * nonzero, gsw_rho() is used instead of the UNESCO density. */
+void oce_unesco_strho(int n, const double *T, const double *sigma, const double *p,
+    int teos, int nthreads, double *value);
+
+/* Temperature in [-3,40] such that the density is 1000+sigma */
+void oce_unesco_tsrho(int n, const double *S, const double *sigma, const double *p,
+    int nthreads, double *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
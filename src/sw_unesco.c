@@ -0,0 +1,761 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/* See sw_unesco.h for the purpose of these functions. Note that this
+ * file does not use R, so that it can be compiled into the
+ * benchmarking program in ../sandbox/sw_unesco. */
+
+#include <math.h>
+#include <string.h>
+#include "sw_unesco.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/* R's NA_real_ is a NaN whose low 32 bits hold 1954 (see R_IsNA() in
+ * R's arithmetic.c); arithmetic may set the quiet bit, so only the
+ * NaN-ness and the low word are tested. */
+static double na_real(void)
+{
+  unsigned long long bits = 0x7FF00000000007A2ULL;
+  double x;
+  memcpy(&x, &bits, sizeof x);
+  return x;
+}
+
+static int is_na(double x)
+{
+  unsigned long long bits;
+  if (!isnan(x))
+    return 0;
+  memcpy(&bits, &x, sizeof bits);
+  return (bits & 0xFFFFFFFFULL) == 1954;
+}
+
+/* Scalar formulae, as in Fofonoff and Millard (1983) */
+
+/* rho1() is ro/(1-p1/K), with p1 the pressure in bars. The fused
+ * kernel uses ro alone for density at zero pressure, since ro/(1-0/K)
+ * is ro exactly. */
+static double rho_ro(double S, double S12, double T)
+{
+  double rho_w = 999.842594 +
+    T * (6.793952e-2 +
+        T * (-9.095290e-3 +
+          T * (1.001685e-4 +
+            T * (-1.120083e-6 + T * 6.536332e-9))));
+  return rho_w +
+    S * (8.24493e-1 +
+        T * (-4.0899e-3 +
+          T * (7.6438e-5 +
+            T * (-8.2467e-7 + T * 5.3875e-9))) +
+        S12 * (-5.72466e-3 +
+          T * (1.0227e-4 -
+            T * 1.6546e-6) +
+          S12 * 4.8314e-4));
+}
+
+static double rho_K(double S, double S12, double T, double p1)
+{
+  double Kw, Aw, Bw;
+  Kw = 19652.21
+    + T * (148.4206 +
+        T * (-2.327105 +
+          T * (1.360477e-2 - T * 5.155288e-5)));
+  Aw = 3.239908 +
+    T * (1.43713e-3 +
+        T * (1.16092e-4 -
+          T * 5.77905e-7));
+  Bw = 8.50935e-5 +
+    T * (-6.12293e-6 +
+        T * 5.2787e-8);
+  return Kw +
+    S * (54.6746 +
+        T * (-0.603459 +
+          T * (1.09987e-2 -
+            T * 6.1670e-5)) +
+        S12 * (7.944e-2 +
+          T * (1.6483e-2 +
+            T * (-5.3009e-4)))) +
+    p1 * (Aw +
+        S * (2.2838e-3 +
+          T * (-1.0981e-5 +
+            T * (-1.6078e-6)) +
+          S12 * (1.91075e-4)) +
+        p1 * (Bw +
+          S * (-9.9348e-7 +
+            T * (2.0816e-8 +
+              T * (9.1697e-10)))));
+}
+
+static double rho1(double S, double T, double p)
+{
+  double p1 = 0.1 * p, S12 = sqrt(S);
+  return rho_ro(S, S12, T) / (1.0 - p1 / rho_K(S, S12, T, p1));
+}
+
+/* S12 is sqrt(S) */
+static double svel2(double S, double S12, double T, double p)
+{
+  p = p / 10.0; /* use bar to match UNESCO routines */
+  /*
+   * eqn 34 p.46
+   */
+  double c00 = 1402.388;
+  double c01 =    5.03711;
+  double c02 =   -5.80852e-2;
+  double c03 =    3.3420e-4;
+  double c04 =   -1.47800e-6;
+  double c05 =    3.1464e-9;
+  double c10 =  0.153563;
+  double c11 =  6.8982e-4;
+  double c12 = -8.1788e-6;
+  double c13 =  1.3621e-7;
+  double c14 = -6.1185e-10;
+  double c20 =  3.1260e-5;
+  double c21 = -1.7107e-6;
+  double c22 =  2.5974e-8;
+  double c23 = -2.5335e-10;
+  double c24 =  1.0405e-12;
+  double c30 = -9.7729e-9;
+  double c31 =  3.8504e-10;
+  double c32 = -2.3643e-12;
+  double Cw = c00
+    + T * (c01 + T * (c02 + T * (c03 + T * (c04 + T * c05))))
+    + p * (c10 + T * (c11 + T * (c12 + T * (c13 + T * c14)))
+        + p * (c20 + T * (c21 + T * (c22 + T * (c23 + T * c24)))
+          + p * (c30 + T * (c31 + T * c32))));
+  /*
+   * eqn 35. p.47
+   */
+  double a00 =  1.389;
+  double a01 = -1.262e-2;
+  double a02 =  7.164e-5;
+  double a03 =  2.006e-6;
+  double a04 = -3.21e-8;
+  double a10 =  9.4742e-5;
+  double a11 = -1.2580e-5;
+  double a12 = -6.4885e-8;
+  double a13 =  1.0507e-8;
+  double a14 = -2.0122e-10;
+  double a20 = -3.9064e-7;
+  double a21 =  9.1041e-9;
+  double a22 = -1.6002e-10;
+  double a23 =  7.988e-12;
+  double a30 =  1.100e-10;
+  double a31 =  6.649e-12;
+  double a32 = -3.389e-13;
+  double A = a00
+    + T * (a01 + T * (a02 + T * (a03 + T * a04)))
+    + p * (a10 + T * (a11 + T * (a12 + T * (a13 + T * a14)))
+        + p * (a20 + T * (a21 + T * (a22 + T * a23))
+          + p * (a30 + T * (a31 + T * a32))));
+  /*
+   * eqn 36 p.47
+   */
+  double b00 = -1.922e-2;
+  double b01 = -4.42e-5;
+  double b10 =  7.3637e-5;
+  double b11 =  1.7945e-7;
+  double B = b00 + T * b01 + p * (b10 + T * b11);
+  /*
+   * eqn 37 p.47
+   */
+  double d00 =  1.727e-3;
+  double d10 = -7.9836e-6;
+  double D = d00 + d10 * p;
+  /*
+   * eqn 33 p.46
+   */
+  return Cw + S * (A + B * S12 + S * D);
+}
+
+static double svel1(double S, double T, double p)
+{
+  return svel2(S, sqrt(S), T, p);
+}
+
+/* Fofonoff & Millard (1983 UNESCO) section 7, equation 31 */
+static const double lr_a[4] = {3.5803e-5, 8.5258e-6, -6.8360e-8, 6.6228e-10};
+static const double lr_b[2] = {1.8932e-6, -4.2393e-8};
+static const double lr_c[4] = {1.8741e-8, -6.7795e-10, 8.7330e-12, -5.4481e-14};
+static const double lr_d[2] = {-1.1351e-10, 2.7759e-12};
+static const double lr_e[3] = {-4.6206e-13, 1.8676e-14, -2.1687e-16};
+
+static double lapserate1(double S, double T, double p)
+{
+  const double *a = lr_a, *b = lr_b, *c = lr_c, *d = lr_d, *e = lr_e;
+  return a[0] + T * (a[1] + T * (a[2] + T * a[3]))
+    + (b[0] + b[1] * T) * (S - 35.0)
+    + (c[0] + T * (c[1] + T * (c[2] + T * c[3]))
+        + (d[0] + T * d[1]) * (S - 35.0)) * p
+    + (e[0] + T * (e[1] + T * e[2])) * p * p;
+}
+
+static double beta1(double S, double theta, double p)
+{
+  S -= 35.0;
+  return 0.785567e-3 + theta * (-0.301985e-5 + theta * (0.555579e-7 + theta *(-0.415613e-9)))
+    + S * (-0.356603e-6 + 0.788212e-8 * theta + p * (0.408195e-10 + p * (-0.602281e-15)))
+    + S * S * (0.515032e-8)
+    + p * (-0.121555e-7 + theta * (0.192867e-9 + theta * (-0.213127e-11)))
+    + p * p * (0.176621e-12 + theta * (-0.175379e-14))
+    + p * p * p * (0.121551e-17);
+}
+
+static double alpha_over_beta1(double S, double theta, double p)
+{
+  S -= 35.0;
+  return (0.665157e-1 + theta * (0.170907e-1 + theta * (-0.203814e-3 + theta * (0.298357e-5 + theta * (-0.255019e-7)))))
+    + S * ((0.378110e-2 + theta * (-0.846960e-4)) + p * (-0.164759e-6 + p * (-0.251520e-11)))
+    + S * S * (-0.678662e-5)
+    + p * (0.380374e-4 + theta * (-0.933746e-6 + theta * (0.791325e-8)))
+    + 0.512857e-12* p * p * theta *theta
+    + -0.302285e-13 * p * p * p;
+}
+
+/* Flament's spiciness; see the notes in sw.c. Pressure is ignored. */
+static const double spice_b[6][5] = {
+  { 0.,          7.7442e-1, -5.85e-3,   -9.84e-4,   -2.06e-4},
+  { 5.1655e-2,   2.034e-3,  -2.742e-4,  -8.5e-6,     1.36e-5},
+  { 6.64783e-3, -2.4681e-4, -1.428e-5,   3.337e-5,   7.894e-6},
+  {-5.4023e-5,   7.326e-6,   7.0036e-6, -3.0412e-6, -1.0853e-6},
+  { 3.949e-7,   -3.029e-8,  -3.8209e-7,  1.0012e-7,  4.7133e-8},
+  {-6.36e-10,   -1.309e-9,   6.048e-9,  -1.1409e-9, -6.676e-10}};
+
+static double spice1(double S, double T)
+{
+  double Sdev = (S - 35.0), S2, T2 = 1.0, spice = 0.0;
+  for (int ii = 0; ii < 6; ii++) {
+    S2 = 1.0;
+    for (int jj = 0; jj < 5; jj++) {
+      spice += spice_b[ii][jj] * T2 * S2;
+      S2 *= Sdev;
+    }
+    T2 *= T;
+  }
+  return spice;
+}
+
+double oce_unesco_atg(double S, double T, double p)
+{
+  /* Adiabatic temperature gradient, UNESCO 1983
+   *
+   * Check value:
+   * ATG=3.255976e-4 C/dbar for S=40, T=40degC, p=10000dbar
+   */
+  S -= 35.0;
+  return(3.5803e-5 + (8.5258e-6 + (-6.836e-8 + 6.6228e-10*T)*T)*T
+      + (1.8932e-6 - 4.2393e-8*T)*S
+      + ((1.8741e-8 + (-6.7795e-10 + (8.733e-12 - 5.4481e-14*T)*T)*T)
+        + (-1.1351e-10 + 2.7759e-12*T)*S)*p
+      + (-4.6206e-13 + (1.8676e-14 - 2.1687e-16*T)*T)*p*p);
+}
+
+static double theta1(double S, double T, double p, double pref)
+{
+  /* Source: UNESCO 1983
+   * check value from Fofonoff et al. (1983)
+   * theta = 36.89073C at S=40, T=40, p=10000, pref=0
+   */
+  double H, XK, Q;
+  H = pref - p;
+  XK = H * oce_unesco_atg(S,T,p);
+  T = T + 0.5 * XK;
+  Q = XK;
+  p = p + 0.5 * H;
+  XK = H * oce_unesco_atg(S,T,p);
+  T = T + 0.29289322 * (XK - Q);
+  Q = 0.58578644 * XK + 0.121320344 * Q;
+  XK = H * oce_unesco_atg(S,T,p);
+  T = T + 1.707106781 * (XK - Q);
+  Q = 3.414213562 * XK - 4.121320344 * Q;
+  p = p + 0.5 * H;
+  XK = H * oce_unesco_atg(S,T,p);
+  return T + (XK - 2.0 * Q) / 6.0;
+}
+
+/* c[0]+x*(c[1]+x*(...+x*c[k])), with its derivative in *dydx */
+static double poly_deriv(double x, const double *c, int k, double *dydx)
+{
+  double y = c[k], d = 0.0;
+  for (int j = k - 1; j >= 0; j--) {
+    d = d * x + y;
+    y = y * x + c[j];
+  }
+  *dydx = d;
+  return y;
+}
+
+/* The coefficients of rho_ro() and rho_K(), as polynomials in T */
+static const double rho_rw[6] = {999.842594, 6.793952e-2, -9.095290e-3, 1.001685e-4, -1.120083e-6, 6.536332e-9};
+static const double rho_kw[5] = {19652.21, 148.4206, -2.327105, 1.360477e-2, -5.155288e-5};
+static const double rho_aw[4] = {3.239908, 1.43713e-3, 1.16092e-4, -5.77905e-7};
+static const double rho_bw[3] = {8.50935e-5, -6.12293e-6, 5.2787e-8};
+static const double rho_r1[5] = {8.24493e-1, -4.0899e-3, 7.6438e-5, -8.2467e-7, 5.3875e-9};
+static const double rho_r2[3] = {-5.72466e-3, 1.0227e-4, -1.6546e-6};
+static const double rho_k1[4] = {54.6746, -0.603459, 1.09987e-2, -6.1670e-5};
+static const double rho_k2[3] = {7.944e-2, 1.6483e-2, -5.3009e-4};
+static const double rho_a1[3] = {2.2838e-3, -1.0981e-5, -1.6078e-6};
+static const double rho_b1[3] = {-9.9348e-7, 2.0816e-8, 9.1697e-10};
+
+double oce_unesco_rho_derivs(double S, double T, double p, double *drhodS, double *drhodT)
+{
+  /* rho = ro/(1-p1/K), with ro = rw + S*r1 + S^1.5*r2 + S^2*r3 and
+   * K = Kw + S*k1 + S^1.5*k2 + p1*(Aw + S*a1 + S^1.5*a2 + p1*(Bw + S*b1)),
+   * where rw, r1, ... are the polynomials in T above. */
+  const double r3 = 4.8314e-4, a2 = 1.91075e-4;
+  double rw, Kw, Aw, Bw, r1, r2, k1, k2, a1, b1;
+  double rw_T, Kw_T, Aw_T, Bw_T, r1_T, r2_T, k1_T, k2_T, a1_T, b1_T;
+  double p1 = 0.1 * p, S12 = sqrt(S), ro, K, D, ro_S, ro_T, K_S, K_T;
+  rw = poly_deriv(T, rho_rw, 5, &rw_T);
+  Kw = poly_deriv(T, rho_kw, 4, &Kw_T);
+  Aw = poly_deriv(T, rho_aw, 3, &Aw_T);
+  Bw = poly_deriv(T, rho_bw, 2, &Bw_T);
+  r1 = poly_deriv(T, rho_r1, 4, &r1_T);
+  r2 = poly_deriv(T, rho_r2, 2, &r2_T);
+  k1 = poly_deriv(T, rho_k1, 3, &k1_T);
+  k2 = poly_deriv(T, rho_k2, 2, &k2_T);
+  a1 = poly_deriv(T, rho_a1, 2, &a1_T);
+  b1 = poly_deriv(T, rho_b1, 2, &b1_T);
+  ro = rw + S * (r1 + S12 * (r2 + S12 * r3));
+  K = Kw + S * (k1 + S12 * k2) + p1 * (Aw + S * (a1 + S12 * a2) + p1 * (Bw + S * b1));
+  ro_S = r1 + S12 * (1.5 * r2 + 2.0 * S12 * r3);
+  ro_T = rw_T + S * (r1_T + S12 * r2_T);
+  K_S = k1 + 1.5 * S12 * k2 + p1 * (a1 + 1.5 * S12 * a2 + p1 * b1);
+  K_T = Kw_T + S * (k1_T + S12 * k2_T) + p1 * (Aw_T + S * a1_T + p1 * (Bw_T + S * b1_T));
+  D = 1.0 - p1 / K;
+  /* d(ro/D) = dro/D - ro*dD/D^2, with dD = p1*dK/K^2 */
+  *drhodS = (ro_S - ro * p1 * K_S / (K * K * D)) / D;
+  *drhodT = (ro_T - ro * p1 * K_T / (K * K * D)) / D;
+  return ro / D;
+}
+
+double oce_unesco_salinity(double C, double T, double p, double *dSdC)
+{
+  /* Follows the UNESCO formulae of FM83, i.e.
+   * Fofonoff, P. and R. C. Millard Jr, 1983. Algorithms for computation of
+   * fundamental properties of seawater. \emph{Unesco Technical Papers in Marine
+   * Science}, \bold{44}, 53 pp
+   *
+   * Test values, p9 of FM83:
+   * stopifnot(all.equal.numeric(S.C.T.p(1,   15,   0), 35.000000, 1e-6))
+   * stopifnot(all.equal.numeric(S.C.T.p(1.2, 20,2000), 37.245628, 1e-6))
+   * stopifnot(all.equal.numeric(S.C.T.p(0.65, 5,1500), 27.995347, 1e-6))
+   */
+  static const double c[5] = {
+    0.6766097, 2.00564e-2, 1.104259e-4, -6.9698e-7, 1.0031e-9
+  };
+  static const double d[4] = {
+    3.426e-2, 4.464e-4, 4.215e-1, -3.107e-3
+  };
+  static const double e[3] = {
+    2.070e-5, -6.370e-10, 3.989e-15
+  };
+  static const double a[6] = {
+    0.0080, -0.1692, 25.3851, 14.0941, -7.0261, 2.7081
+  };
+  static const double b[6] = {
+    0.0005, -0.0056, -0.0066, -0.0375, 0.0636, -0.0144
+  };
+  const double k = 0.0162;
+  double rt, Rp, Rt, Rtx, del_T, del_S, S;
+  /* rt = rt(T) = C(35,T,0)/C(35,15,0), eqn (3) p.7 FM83 */
+  rt = c[0] + T*(c[1] + T*(c[2] + T*(c[3] + T*c[4])));
+  /* Rp, eqn (4) p.8 FM83 */
+  Rp = 1 + ( p * (e[0] + p * (e[1] + p * e[2]))) /
+    (1 + T *(d[0] + T * d[1]) + (d[2] + T * d[3]) * C);
+  Rt = C / (Rp * rt);
+  /* Eqn (1) & (2) p6 and 7 FM83 */
+  Rtx = sqrt(Rt);
+  del_T = T - 15;
+  del_S = (del_T / (1 + k * del_T) ) *
+    (b[0] + (b[1] + (b[2]+ (b[3] + (b[4] + b[5]*Rtx)*Rtx)*Rtx)*Rtx)*Rtx);
+  S = a[0] + (a[1] + (a[2] + (a[3] + (a[4] + a[5]*Rtx)*Rtx)*Rtx)*Rtx)*Rtx;
+  S = S + del_S;
+  if (dSdC) {
+    /* Chain rule through Rp(C), Rt(C) and Rtx(C); infinite at C=0 */
+    double A = p * (e[0] + p * (e[1] + p * e[2]));
+    double g = d[2] + T * d[3];
+    double B = 1 + T *(d[0] + T * d[1]) + g * C;
+    double dRp = -A * g / (B * B);
+    double dRt = (Rp - C * dRp) / (Rp * Rp * rt);
+    double dSdRtx = (a[1] + (2*a[2] + (3*a[3] + (4*a[4] + 5*a[5]*Rtx)*Rtx)*Rtx)*Rtx)
+      + (del_T / (1 + k * del_T)) *
+      (b[1] + (2*b[2] + (3*b[3] + (4*b[4] + 5*b[5]*Rtx)*Rtx)*Rtx)*Rtx);
+    *dSdC = dSdRtx * dRt / (2.0 * Rtx);
+  }
+  return S;
+}
+
+#define SCALAR_KERNEL(name, f) \
+  void name(int n, const double *S, const double *T, const double *p, double *value) \
+  { \
+    for (int i = 0; i < n; i++) \
+      value[i] = is_na(S[i]) || is_na(T[i]) || is_na(p[i]) ? na_real() : f(S[i], T[i], p[i]); \
+  }
+
+SCALAR_KERNEL(oce_unesco_rho_scalar, rho1)
+SCALAR_KERNEL(oce_unesco_svel_scalar, svel1)
+SCALAR_KERNEL(oce_unesco_lapserate_scalar, lapserate1)
+SCALAR_KERNEL(oce_unesco_beta_scalar, beta1)
+SCALAR_KERNEL(oce_unesco_alpha_over_beta_scalar, alpha_over_beta1)
+
+void oce_unesco_spice_scalar(int n, const double *S, const double *T, const double *p, double *value)
+{
+  for (int i = 0; i < n; i++)
+    value[i] = is_na(S[i]) || is_na(T[i]) || is_na(p[i]) ? na_real() : spice1(S[i], T[i]);
+}
+
+void oce_unesco_theta_scalar(int n, const double *S, const double *T, const double *p, const double *pref, double *value)
+{
+  for (int i = 0; i < n; i++)
+    value[i] = is_na(S[i]) || is_na(T[i]) || is_na(p[i]) || is_na(pref[i]) ?
+      na_real() : theta1(S[i], T[i], p[i], pref[i]);
+}
+
+/* The properties of sample i, in column j of value, which has ld rows */
+static void properties1(int ld, int i, double S, double T, double p, int which, double *value)
+{
+  double S12 = sqrt(S), theta = 0.0;
+  int j = 0;
+  if (which & (OCE_UNESCO_SIGMA_THETA | OCE_UNESCO_ALPHA | OCE_UNESCO_BETA | OCE_UNESCO_THETA))
+    theta = theta1(S, T, p, 0.0) / 1.00024;
+  if (which & OCE_UNESCO_RHO) {
+    double p1 = 0.1 * p;
+    value[i + ld * j++] = rho_ro(S, S12, T) / (1.0 - p1 / rho_K(S, S12, T, p1));
+  }
+  if (which & OCE_UNESCO_SIGMA_THETA)
+    value[i + ld * j++] = rho_ro(S, S12, theta * 1.00024) - 1000.0;
+  if (which & OCE_UNESCO_ALPHA)
+    value[i + ld * j++] = alpha_over_beta1(S, theta, p) * beta1(S, theta, p);
+  if (which & OCE_UNESCO_BETA)
+    value[i + ld * j++] = beta1(S, theta, p);
+  if (which & OCE_UNESCO_SVEL)
+    value[i + ld * j++] = svel2(S, S12, T, p);
+  if (which & OCE_UNESCO_THETA)
+    value[i + ld * j++] = theta;
+  if (which & OCE_UNESCO_SPICE)
+    value[i + ld * j++] = spice1(S, T);
+}
+
+/* Samples i0 to n-1 */
+static void properties_scalar(int n, int i0, const double *S, const double *T, const double *p,
+    int which, int ld, double *value)
+{
+  for (int i = i0; i < n; i++) {
+    if (is_na(S[i]) || is_na(T[i]) || is_na(p[i])) {
+      for (int j = 0, bit = 1; bit <= OCE_UNESCO_SPICE; bit <<= 1)
+        if (which & bit)
+          value[i + ld * j++] = na_real();
+    } else {
+      properties1(ld, i, S[i], T[i], p[i], which, value);
+    }
+  }
+}
+
+void oce_unesco_properties_scalar(int n, const double *S, const double *T, const double *p,
+    int which, int ld, double *value)
+{
+  properties_scalar(n, 0, S, T, p, which, ld, value);
+}
+
+/* Vector versions. The operations of the scalar formulae are repeated
+ * in the same order, using poly(), which evaluates
+ * c[0]+x*(c[1]+x*(...+x*c[k])), for the nested polynomials. (A
+ * subtraction a-x*b in the scalar code is written here as a+x*(-b),
+ * which rounds identically.) */
+
+#if defined(__AVX2__)
+
+#define VLEN 4
+typedef __m256d vec;
+#define vset _mm256_set1_pd
+#define vload _mm256_loadu_pd
+#define vstore _mm256_storeu_pd
+#define vadd _mm256_add_pd
+#define vsub _mm256_sub_pd
+#define vmul _mm256_mul_pd
+#define vdiv _mm256_div_pd
+#define vsqrt _mm256_sqrt_pd
+#define vor _mm256_or_pd
+
+/* All-ones lanes where x is NA, as defined by is_na() */
+static inline vec visna(vec x)
+{
+  vec nan = _mm256_cmp_pd(x, x, _CMP_UNORD_Q);
+  __m256i low = _mm256_and_si256(_mm256_castpd_si256(x), _mm256_set1_epi64x(0xFFFFFFFFLL));
+  __m256i eq = _mm256_cmpeq_epi64(low, _mm256_set1_epi64x(1954));
+  return _mm256_and_pd(nan, _mm256_castsi256_pd(eq));
+}
+
+/* x, or NA where mask is set */
+static inline vec vmask_na(vec x, vec mask)
+{
+  return _mm256_blendv_pd(x, vset(na_real()), mask);
+}
+
+#elif defined(__SSE2__)
+
+#define VLEN 2
+typedef __m128d vec;
+#define vset _mm_set1_pd
+#define vload _mm_loadu_pd
+#define vstore _mm_storeu_pd
+#define vadd _mm_add_pd
+#define vsub _mm_sub_pd
+#define vmul _mm_mul_pd
+#define vdiv _mm_div_pd
+#define vsqrt _mm_sqrt_pd
+#define vor _mm_or_pd
+
+static inline vec visna(vec x)
+{
+  vec nan = _mm_cmpunord_pd(x, x);
+  /* SSE2 compares 32-bit lanes only, so the result for the low word
+   * of each double is copied to its high word. */
+  __m128i eq = _mm_cmpeq_epi32(_mm_castpd_si128(x), _mm_set1_epi32(1954));
+  eq = _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 2, 0, 0));
+  return _mm_and_pd(nan, _mm_castsi128_pd(eq));
+}
+
+static inline vec vmask_na(vec x, vec mask)
+{
+  return _mm_or_pd(_mm_andnot_pd(mask, x), _mm_and_pd(mask, vset(na_real())));
+}
+
+#endif
+
+#ifdef VLEN
+
+static inline vec poly(vec x, const double *c, int k)
+{
+  vec r = vset(c[k]);
+  for (int j = k - 1; j >= 0; j--)
+    r = vadd(vset(c[j]), vmul(x, r));
+  return r;
+}
+
+/* The coefficients are those of oce_unesco_rho_derivs() */
+static inline vec vrho_ro(vec S, vec S12, vec T)
+{
+  return vadd(poly(T, rho_rw, 5),
+      vmul(S, vadd(poly(T, rho_r1, 4),
+          vmul(S12, vadd(poly(T, rho_r2, 2), vmul(S12, vset(4.8314e-4)))))));
+}
+
+static inline vec vrho_K(vec S, vec S12, vec T, vec p1)
+{
+  return vadd(vadd(poly(T, rho_kw, 4),
+        vmul(S, vadd(poly(T, rho_k1, 3), vmul(S12, poly(T, rho_k2, 2))))),
+      vmul(p1, vadd(vadd(poly(T, rho_aw, 3),
+            vmul(S, vadd(poly(T, rho_a1, 2), vmul(S12, vset(1.91075e-4))))),
+          vmul(p1, vadd(poly(T, rho_bw, 2), vmul(S, poly(T, rho_b1, 2)))))));
+}
+
+static inline vec vrho(vec S, vec T, vec p)
+{
+  vec p1 = vmul(vset(0.1), p);
+  vec S12 = vsqrt(S);
+  return vdiv(vrho_ro(S, S12, T), vsub(vset(1.0), vdiv(p1, vrho_K(S, S12, T, p1))));
+}
+
+static inline vec vsvel2(vec S, vec S12, vec T, vec p)
+{
+  static const double c0[6] = {1402.388, 5.03711, -5.80852e-2, 3.3420e-4, -1.47800e-6, 3.1464e-9};
+  static const double c1[5] = {0.153563, 6.8982e-4, -8.1788e-6, 1.3621e-7, -6.1185e-10};
+  static const double c2[5] = {3.1260e-5, -1.7107e-6, 2.5974e-8, -2.5335e-10, 1.0405e-12};
+  static const double c3[3] = {-9.7729e-9, 3.8504e-10, -2.3643e-12};
+  static const double a0[5] = {1.389, -1.262e-2, 7.164e-5, 2.006e-6, -3.21e-8};
+  static const double a1[5] = {9.4742e-5, -1.2580e-5, -6.4885e-8, 1.0507e-8, -2.0122e-10};
+  static const double a2[4] = {-3.9064e-7, 9.1041e-9, -1.6002e-10, 7.988e-12};
+  static const double a3[3] = {1.100e-10, 6.649e-12, -3.389e-13};
+  static const double b0[2] = {-1.922e-2, -4.42e-5};
+  static const double b1[2] = {7.3637e-5, 1.7945e-7};
+  p = vdiv(p, vset(10.0));
+  vec Cw = vadd(poly(T, c0, 5),
+      vmul(p, vadd(poly(T, c1, 4), vmul(p, vadd(poly(T, c2, 4), vmul(p, poly(T, c3, 2)))))));
+  vec A = vadd(poly(T, a0, 4),
+      vmul(p, vadd(poly(T, a1, 4), vmul(p, vadd(poly(T, a2, 3), vmul(p, poly(T, a3, 2)))))));
+  vec B = vadd(poly(T, b0, 1), vmul(p, poly(T, b1, 1)));
+  vec D = vadd(vset(1.727e-3), vmul(vset(-7.9836e-6), p));
+  return vadd(Cw, vmul(S, vadd(vadd(A, vmul(B, S12)), vmul(S, D))));
+}
+
+static inline vec vsvel(vec S, vec T, vec p)
+{
+  return vsvel2(S, vsqrt(S), T, p);
+}
+
+static inline vec vlapserate(vec S, vec T, vec p)
+{
+  vec dS = vsub(S, vset(35.0));
+  return vadd(vadd(vadd(poly(T, lr_a, 3),
+          vmul(vadd(vset(lr_b[0]), vmul(vset(lr_b[1]), T)), dS)),
+        vmul(vadd(poly(T, lr_c, 3), vmul(poly(T, lr_d, 1), dS)), p)),
+      vmul(vmul(poly(T, lr_e, 2), p), p));
+}
+
+static inline vec vbeta(vec S, vec theta, vec p)
+{
+  static const double t0[4] = {0.785567e-3, -0.301985e-5, 0.555579e-7, -0.415613e-9};
+  static const double s1[2] = {0.408195e-10, -0.602281e-15};
+  static const double p1[3] = {-0.121555e-7, 0.192867e-9, -0.213127e-11};
+  static const double p2[2] = {0.176621e-12, -0.175379e-14};
+  S = vsub(S, vset(35.0));
+  vec pp = vmul(p, p);
+  vec r = vadd(poly(theta, t0, 3),
+      vmul(S, vadd(vadd(vset(-0.356603e-6), vmul(vset(0.788212e-8), theta)), vmul(p, poly(p, s1, 1)))));
+  r = vadd(r, vmul(vmul(S, S), vset(0.515032e-8)));
+  r = vadd(r, vmul(p, poly(theta, p1, 2)));
+  r = vadd(r, vmul(pp, poly(theta, p2, 1)));
+  return vadd(r, vmul(vmul(pp, p), vset(0.121551e-17)));
+}
+
+static inline vec valpha_over_beta(vec S, vec theta, vec p)
+{
+  static const double t0[5] = {0.665157e-1, 0.170907e-1, -0.203814e-3, 0.298357e-5, -0.255019e-7};
+  static const double s0[2] = {0.378110e-2, -0.846960e-4};
+  static const double s1[2] = {-0.164759e-6, -0.251520e-11};
+  static const double p1[3] = {0.380374e-4, -0.933746e-6, 0.791325e-8};
+  S = vsub(S, vset(35.0));
+  vec r = vadd(poly(theta, t0, 4),
+      vmul(S, vadd(poly(theta, s0, 1), vmul(p, poly(p, s1, 1)))));
+  r = vadd(r, vmul(vmul(S, S), vset(-0.678662e-5)));
+  r = vadd(r, vmul(p, poly(theta, p1, 2)));
+  r = vadd(r, vmul(vmul(vmul(vmul(vset(0.512857e-12), p), p), theta), theta));
+  return vadd(r, vmul(vmul(vmul(vset(-0.302285e-13), p), p), p));
+}
+
+static inline vec vspice(vec S, vec T)
+{
+  vec Sdev = vsub(S, vset(35.0)), S2, T2 = vset(1.0), spice = vset(0.0);
+  for (int ii = 0; ii < 6; ii++) {
+    S2 = vset(1.0);
+    for (int jj = 0; jj < 5; jj++) {
+      spice = vadd(spice, vmul(vmul(vset(spice_b[ii][jj]), T2), S2));
+      S2 = vmul(S2, Sdev);
+    }
+    T2 = vmul(T2, T);
+  }
+  return spice;
+}
+
+static inline vec vatg(vec S, vec T, vec p)
+{
+  static const double c0[4] = {3.5803e-5, 8.5258e-6, -6.836e-8, 6.6228e-10};
+  static const double c1[2] = {1.8932e-6, -4.2393e-8};
+  static const double c2[4] = {1.8741e-8, -6.7795e-10, 8.733e-12, -5.4481e-14};
+  static const double c3[2] = {-1.1351e-10, 2.7759e-12};
+  static const double c4[3] = {-4.6206e-13, 1.8676e-14, -2.1687e-16};
+  S = vsub(S, vset(35.0));
+  return vadd(vadd(vadd(poly(T, c0, 3), vmul(poly(T, c1, 1), S)),
+        vmul(vadd(poly(T, c2, 3), vmul(poly(T, c3, 1), S)), p)),
+      vmul(vmul(poly(T, c4, 2), p), p));
+}
+
+static inline vec vtheta(vec S, vec T, vec p, vec pref)
+{
+  vec H, XK, Q;
+  H = vsub(pref, p);
+  XK = vmul(H, vatg(S, T, p));
+  T = vadd(T, vmul(vset(0.5), XK));
+  Q = XK;
+  p = vadd(p, vmul(vset(0.5), H));
+  XK = vmul(H, vatg(S, T, p));
+  T = vadd(T, vmul(vset(0.29289322), vsub(XK, Q)));
+  Q = vadd(vmul(vset(0.58578644), XK), vmul(vset(0.121320344), Q));
+  XK = vmul(H, vatg(S, T, p));
+  T = vadd(T, vmul(vset(1.707106781), vsub(XK, Q)));
+  Q = vsub(vmul(vset(3.414213562), XK), vmul(vset(4.121320344), Q));
+  p = vadd(p, vmul(vset(0.5), H));
+  XK = vmul(H, vatg(S, T, p));
+  return vadd(T, vdiv(vsub(XK, vmul(vset(2.0), Q)), vset(6.0)));
+}
+
+#define VECTOR_KERNEL(name, vf, scalar) \
+  void name(int n, const double *S, const double *T, const double *p, double *value) \
+  { \
+    int i = 0; \
+    for (; i + VLEN <= n; i += VLEN) { \
+      vec s = vload(S + i), t = vload(T + i), pp = vload(p + i); \
+      vec na = vor(vor(visna(s), visna(t)), visna(pp)); \
+      vstore(value + i, vmask_na(vf, na)); \
+    } \
+    scalar(n - i, S + i, T + i, p + i, value + i); \
+  }
+
+#else
+
+#define VECTOR_KERNEL(name, vf, scalar) \
+  void name(int n, const double *S, const double *T, const double *p, double *value) \
+  { \
+    scalar(n, S, T, p, value); \
+  }
+
+#endif
+
+VECTOR_KERNEL(oce_unesco_rho, vrho(s, t, pp), oce_unesco_rho_scalar)
+VECTOR_KERNEL(oce_unesco_svel, vsvel(s, t, pp), oce_unesco_svel_scalar)
+VECTOR_KERNEL(oce_unesco_lapserate, vlapserate(s, t, pp), oce_unesco_lapserate_scalar)
+VECTOR_KERNEL(oce_unesco_beta, vbeta(s, t, pp), oce_unesco_beta_scalar)
+VECTOR_KERNEL(oce_unesco_alpha_over_beta, valpha_over_beta(s, t, pp), oce_unesco_alpha_over_beta_scalar)
+VECTOR_KERNEL(oce_unesco_spice, vspice(s, t), oce_unesco_spice_scalar)
+
+void oce_unesco_theta(int n, const double *S, const double *T, const double *p, const double *pref, double *value)
+{
+  int i = 0;
+#ifdef VLEN
+  for (; i + VLEN <= n; i += VLEN) {
+    vec s = vload(S + i), t = vload(T + i), pp = vload(p + i), pr = vload(pref + i);
+    vec na = vor(vor(visna(s), visna(t)), vor(visna(pp), visna(pr)));
+    vstore(value + i, vmask_na(vtheta(s, t, pp, pr), na));
+  }
+#endif
+  oce_unesco_theta_scalar(n - i, S + i, T + i, p + i, pref + i, value + i);
+}
+
+void oce_unesco_properties(int n, const double *S, const double *T, const double *p,
+    int which, int ld, double *value)
+{
+  int i = 0;
+#ifdef VLEN
+  int need_theta = which & (OCE_UNESCO_SIGMA_THETA | OCE_UNESCO_ALPHA | OCE_UNESCO_BETA | OCE_UNESCO_THETA);
+  for (; i + VLEN <= n; i += VLEN) {
+    vec s = vload(S + i), t = vload(T + i), pp = vload(p + i);
+    vec na = vor(vor(visna(s), visna(t)), visna(pp));
+    vec S12 = vsqrt(s), theta = vset(0.0);
+    double *v = value + i;
+    if (need_theta)
+      theta = vdiv(vtheta(s, t, pp, vset(0.0)), vset(1.00024));
+    if (which & OCE_UNESCO_RHO) {
+      vec p1 = vmul(vset(0.1), pp);
+      vstore(v, vmask_na(vdiv(vrho_ro(s, S12, t), vsub(vset(1.0), vdiv(p1, vrho_K(s, S12, t, p1)))), na));
+      v += ld;
+    }
+    if (which & OCE_UNESCO_SIGMA_THETA) {
+      vstore(v, vmask_na(vsub(vrho_ro(s, S12, vmul(theta, vset(1.00024))), vset(1000.0)), na));
+      v += ld;
+    }
+    if (which & OCE_UNESCO_ALPHA) {
+      vstore(v, vmask_na(vmul(valpha_over_beta(s, theta, pp), vbeta(s, theta, pp)), na));
+      v += ld;
+    }
+    if (which & OCE_UNESCO_BETA) {
+      vstore(v, vmask_na(vbeta(s, theta, pp), na));
+      v += ld;
+    }
+    if (which & OCE_UNESCO_SVEL) {
+      vstore(v, vmask_na(vsvel2(s, S12, t, pp), na));
+      v += ld;
+    }
+    if (which & OCE_UNESCO_THETA) {
+      vstore(v, vmask_na(theta, na));
+      v += ld;
+    }
+    if (which & OCE_UNESCO_SPICE)
+      vstore(v, vmask_na(vspice(s, t), na));
+  }
+#endif
+  properties_scalar(n, i, S, T, p, which, ld, value);
+}
@@ -0,0 +1,78 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+/*
+ * Batch kernels for the UNESCO (EOS-80) seawater formulae called by
+ * sw.c, i.e. density, sound speed, adiabatic lapse rate, haline
+ * contraction, alpha/beta, spiciness and potential temperature. Each
+ * fills value[0:n-1] from the n-element inputs, and sets value[i] to NA
+ * if any input is NA at i, as R's ISNA() defines it.
+ *
+ * The kernels process 4 samples at a time with AVX2, or 2 with SSE2,
+ * if the compiler targets those instruction sets (i.e. if __AVX2__ or
+ * __SSE2__ is defined). NA inputs are handled by masking the results,
+ * not by branching. The arithmetic is done in the same order as in the
+ * scalar versions, which are also declared here, and which handle the
+ * remaining samples, so the results agree to within rounding (and are
+ * normally identical). The benchmark in ../sandbox/sw_unesco checks
+ * this.
+ */
+
+#ifndef OCE_SW_UNESCO_H
+#define OCE_SW_UNESCO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void oce_unesco_rho(int n, const double *S, const double *T, const double *p, double *value);
+void oce_unesco_svel(int n, const double *S, const double *T, const double *p, double *value);
+void oce_unesco_lapserate(int n, const double *S, const double *T, const double *p, double *value);
+void oce_unesco_beta(int n, const double *S, const double *theta, const double *p, double *value);
+void oce_unesco_alpha_over_beta(int n, const double *S, const double *theta, const double *p, double *value);
+void oce_unesco_spice(int n, const double *S, const double *T, const double *p, double *value);
+void oce_unesco_theta(int n, const double *S, const double *T, const double *p, const double *pref, double *value);
+
+/* One sample at a time, with a test for NA on each. */
+void oce_unesco_rho_scalar(int n, const double *S, const double *T, const double *p, double *value);
+void oce_unesco_svel_scalar(int n, const double *S, const double *T, const double *p, double *value);
+void oce_unesco_lapserate_scalar(int n, const double *S, const double *T, const double *p, double *value);
+void oce_unesco_beta_scalar(int n, const double *S, const double *theta, const double *p, double *value);
+void oce_unesco_alpha_over_beta_scalar(int n, const double *S, const double *theta, const double *p, double *value);
+void oce_unesco_spice_scalar(int n, const double *S, const double *T, const double *p, double *value);
+void oce_unesco_theta_scalar(int n, const double *S, const double *T, const double *p, const double *pref, double *value);
+
+/* Several of the above at once, for the same S, T and p, in one pass
+ * that computes sqrt(S) and potential temperature (referenced to zero
+ * pressure) only once per sample. 'which' is a sum of the
+ * OCE_UNESCO_* bits below, and value holds a column for each bit that
+ * is set, in the order of the bits, with a stride of ld (at least n)
+ * between columns. T is on the IPTS-68 scale,
+ * as for the kernels above, but theta is returned on the ITS-90 scale,
+ * and alpha, beta and sigma-theta are computed from it, in the way that
+ * swTheta(), swAlpha(), swBeta() and swSigmaTheta() do; so each column
+ * is identical to what the corresponding R function returns. */
+#define OCE_UNESCO_RHO 1
+#define OCE_UNESCO_SIGMA_THETA 2
+#define OCE_UNESCO_ALPHA 4
+#define OCE_UNESCO_BETA 8
+#define OCE_UNESCO_SVEL 16
+#define OCE_UNESCO_THETA 32
+#define OCE_UNESCO_SPICE 64
+void oce_unesco_properties(int n, const double *S, const double *T, const double *p, int which, int ld, double *value);
+void oce_unesco_properties_scalar(int n, const double *S, const double *T, const double *p, int which, int ld, double *value);
+
+/* Adiabatic temperature gradient (K/dbar), used by the theta kernels. */
+double oce_unesco_atg(double S, double T, double p);
+
+/* Density, with its partial derivatives with respect to S and T, and
+ * practical salinity from conductivity ratio, with its derivative with
+ * respect to C if dSdC is not NULL. These take a single sample, which
+ * must not be NA; the solvers in sw_inverse.c use the derivatives. */
+double oce_unesco_rho_derivs(double S, double T, double p, double *drhodS, double *drhodT);
+double oce_unesco_salinity(double C, double T, double p, double *dSdC);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+// Helpers for the native readers of text data files (e.g. ctd_sbe.cpp),
+// which work on a whole file held in memory by InputFile, instead of
+// pulling it through readLines() and read.table().
+//
+// Lines end in "\n", "\r\n" or "\r", as for readLines(). Numbers are
+// parsed with a fast path for the common case of at most 19
+// significant digits and a power of ten that is exactly representable,
+// in which case a single multiplication or division gives the
+// correctly-rounded result (Clinger 1990). Anything else is handed to
+// strtod(), so the result is always the same as that of strtod().
+
+#ifndef OCE_TEXT_PARSE_H
+#define OCE_TEXT_PARSE_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string>
+
+// Find the line that starts at 'p', storing its end (just before the
+// line terminator) in *line_end, and returning the start of the next
+// line. A NUL byte ends the line text, as for readLines(), but not
+// the line itself.
+static inline const char *oce_next_line(const char *p, const char *end, const char **line_end)
+{
+  const char *q = p;
+  while (q < end && *q != '\n' && *q != '\r')
+    q++;
+  const char *nul = (const char*)memchr(p, '\0', q - p);
+  *line_end = nul ? nul : q;
+  if (q < end) {
+    if (*q == '\r' && q + 1 < end && q[1] == '\n')
+      q++;
+    q++;
+  }
+  return q;
+}
+
+static inline int oce_is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\f' || c == '\v';
+}
+
+// Skip whitespace, returning the start of the next token, or 'end'.
+static inline const char *oce_skip_space(const char *p, const char *end)
+{
+  while (p < end && oce_is_space(*p))
+    p++;
+  return p;
+}
+
+// Return the end of the token that starts at 'p', which ends at
+// whitespace or at 'end'.
+static inline const char *oce_token_end(const char *p, const char *end)
+{
+  while (p < end && !oce_is_space(*p))
+    p++;
+  return p;
+}
+
+// The line from 'p' to 'end', with leading and trailing whitespace
+// removed.
+static inline std::string oce_trim(const char *p, const char *end)
+{
+  p = oce_skip_space(p, end);
+  while (end > p && oce_is_space(end[-1]))
+    end--;
+  return std::string(p, end - p);
+}
+
+static const double oce_pow10[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parse the token from 's' to 'e' as a number, storing it in *value
+// and returning 1, or returning 0 if the token is not a number. If
+// 'is_int' is not NULL, *is_int is set to 1 if the token would be
+// read as an integer by type.convert(), i.e. if it is an optionally
+// signed string of digits whose value fits in an R integer.
+static inline int oce_parse_number(const char *s, const char *e, double *value, int *is_int)
+{
+  const char *p = s;
+  int negative = 0;
+  if (p < e && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int ndigit = 0, nsignificant = 0, exp10 = 0;
+  while (p < e && *p >= '0' && *p <= '9') {
+    if (nsignificant || *p != '0') {
+      if (nsignificant < 19)
+        mantissa = 10 * mantissa + (*p - '0');
+      else
+        exp10++;
+      nsignificant++;
+    }
+    ndigit++;
+    p++;
+  }
+  int is_plain_int = p == e && ndigit > 0;
+  if (p < e && *p == '.') {
+    p++;
+    while (p < e && *p >= '0' && *p <= '9') {
+      if (nsignificant || *p != '0') {
+        if (nsignificant < 19) {
+          mantissa = 10 * mantissa + (*p - '0');
+          exp10--;
+        }
+        nsignificant++;
+      } else {
+        exp10--;
+      }
+      ndigit++;
+      p++;
+    }
+  }
+  if (ndigit > 0 && p < e && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    int eneg = 0, ex = 0, nex = 0;
+    if (q < e && (*q == '-' || *q == '+')) {
+      eneg = *q == '-';
+      q++;
+    }
+    while (q < e && *q >= '0' && *q <= '9') {
+      if (ex < 100000)
+        ex = 10 * ex + (*q - '0');
+      nex++;
+      q++;
+    }
+    if (nex > 0) {
+      exp10 += eneg ? -ex : ex;
+      p = q;
+    }
+  }
+  if (is_int)
+    *is_int = is_plain_int && nsignificant <= 10 && mantissa <= (uint64_t)INT_MAX;
+  if (p == e && ndigit > 0 && nsignificant <= 19) {
+    if (mantissa == 0) {
+      *value = negative ? -0.0 : 0.0;
+      return 1;
+    }
+    if (mantissa <= ((uint64_t)1 << 53) && exp10 >= -22 && exp10 <= 22) {
+      double v = (double)mantissa;
+      v = exp10 < 0 ? v / oce_pow10[-exp10] : v * oce_pow10[exp10];
+      *value = negative ? -v : v;
+      return 1;
+    }
+  }
+  // Other cases (e.g. many digits, large exponents, "Inf", "NaN" or
+  // hexadecimal) are rare, and are handled by strtod().
+  char tmp[128];
+  size_t n = e - s;
+  if (n == 0 || n >= sizeof(tmp))
+    return 0;
+  memcpy(tmp, s, n);
+  tmp[n] = '\0';
+  char *stop;
+  double v = strtod(tmp, &stop);
+  if (stop != tmp + n)
+    return 0;
+  *value = v;
+  return 1;
+}
+
+#endif
@@ -0,0 +1,361 @@
+/* vim: set expandtab shiftwidth=2 softtabstop=2 tw=70: */
+
+#include <Rcpp.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <limits.h>
+#include "input_file.h"
+#include "text_parse.h"
+#include "ctd_readers.h"
+using namespace Rcpp;
+
+// Cross-reference work:
+// 1. update ../src/registerDynamicSymbol.c with an item for this
+// 2. main code should use the autogenerated wrapper in ../R/RcppExports.R
+
+// Split the line from 'p' to 'end' at commas, trimming whitespace from
+// each field. As for strsplit(), a comma at the end of the line does
+// not start a new field.
+static std::vector<std::string> woce_split(const char *p, const char *end)
+{
+  std::vector<std::string> res;
+  while (p < end) {
+    const char *comma = (const char*)memchr(p, ',', end - p);
+    const char *e = comma ? comma : end;
+    res.push_back(oce_trim(p, e));
+    p = comma ? comma + 1 : end;
+  }
+  return res;
+}
+
+// Is the line from 'p' to 'end' of the form "NUMBER_HEADERS = n"? If
+// so, store n in *n.
+static int woce_number_headers(const char *p, const char *end, int *n)
+{
+  static const char *key = "number_headers";
+  p = oce_skip_space(p, end);
+  for (const char *k = key; *k; k++, p++) {
+    if (p == end || tolower((unsigned char)*p) != *k)
+      return 0;
+  }
+  p = oce_skip_space(p, end);
+  if (p == end || *p != '=')
+    return 0;
+  std::string v = oce_trim(p + 1, end);
+  double value;
+  if (!oce_parse_number(v.data(), v.data() + v.size(), &value, NULL) || value < 1 || value > INT_MAX)
+    return 0;
+  *n = (int)value;
+  return 1;
+}
+
+// Is the named column a data-quality flag, e.g. "CTDSAL_FLAG_W"? The
+// misspelling "FLAW" occurs in some files (see read.ctd.woce()).
+static int woce_is_flag(const std::string &name)
+{
+  size_t n = name.size();
+  if (n < 7)
+    return 0;
+  std::string suffix = name.substr(n - 7);
+  return suffix == "_FLAG_W" || suffix == "_FLAG_I" || suffix == "_FLAW_W";
+}
+
+static int woce_is_comment(const char *p, const char *end)
+{
+  p = oce_skip_space(p, end);
+  return p < end && *p == '#';
+}
+
+/*
+
+Read a WOCE exchange file
+
+@description
+
+Read a CTD ("ct1") or bottle ("hy1") file in the WOCE exchange format
+used by CCHDO, in a single pass through the file, which is held in
+memory (see input_file.h). The header is returned as lines, for
+interpretation by read.ctd.woce() and read.section(), and the data
+are returned as typed columns.
+
+@details
+
+The first line is the file-type stamp (e.g. "BOTTLE,20001102WHPSIOJJW"),
+and it is followed by comment lines starting with "#". Then, in CTD
+files, comes a "NUMBER_HEADERS = n" line and n-1 lines of the form
+"NAME = VALUE", possibly followed by more comments. The next line
+holds the column names, the one after that holds the units, and the
+data lines that follow it end at a line starting with "END_DATA".
+
+Fields are separated by commas, and whitespace around them is
+ignored. An empty field, or one holding "NA", is a missing value. A
+column named in 'character' is returned as character. Other columns
+are numeric, unless one of their fields is not a number, in which case
+they are character. Flag columns (with names ending in "_FLAG_W" or
+"_FLAG_I") are integer, if all their values are integers.
+
+If 'groupBy' names a column, the rows are grouped by the values in
+that column, e.g. "STNNBR" to split a bottle file into stations. This
+is done here, during the parse, because doing it in R, with
+which(stationId == station) for each station, takes a time that
+grows with the product of the numbers of stations and rows.
+
+@param filename character string indicating the file name.
+
+@param character names of columns to be returned as character.
+
+@param groupBy character string naming the column by which to group
+rows, or a zero-length vector for no grouping.
+
+@value a list containing "header" (character, the lines up to and
+including the units line), "headers" (character, the
+"NUMBER_HEADERS" line and the lines after it, or a zero-length vector
+if there are none), "names" (character, the column names), "units"
+(character, one for each field in the units line), "dataStart"
+(integer, the line number of the first data line), "ok" (logical,
+FALSE if a data line has more fields than there are names), "data"
+(a list of columns, or NULL), "groupNames" (character, the distinct
+values of the groupBy column, in order of appearance) and "groups" (a
+list holding, for each of those values, the 1-based indices of the
+rows in which it occurs).
+
+@author
+
+Dan Kelley
+
+*/
+
+// [[Rcpp::export]]
+List do_read_woce_exchange(CharacterVector filename, CharacterVector character, CharacterVector groupBy)
+{
+  std::string fn = Rcpp::as<std::string>(filename(0));
+  std::vector<std::string> want;
+  for (long k = 0; k < character.size(); k++)
+    want.push_back(Rcpp::as<std::string>(character[k]));
+  std::string group_by = groupBy.size() > 0 ? Rcpp::as<std::string>(groupBy[0]) : std::string();
+  woce_file f;
+  std::string message;
+  if (!woce_parse(fn, want, group_by, &f, &message))
+    ::Rf_error("cannot read file '%s' (%s)\n", fn.c_str(), message.c_str());
+  return(woce_list(&f));
+}
+
+int woce_parse(const std::string &filename, const std::vector<std::string> &character,
+    const std::string &group_by, woce_file *f, std::string *message)
+{
+  InputFile mf(filename);
+  if (!mf.ok()) {
+    *message = mf.message();
+    return 0;
+  }
+  const char *p = (const char*)mf.data();
+  const char *end = p + mf.size();
+  const char *line_end, *next;
+
+  // Header: stamp, comments, NUMBER_HEADERS block, comments, names, units
+  std::vector<std::string> &header = f->header, &headers = f->headers;
+  if (p < end) {
+    next = oce_next_line(p, end, &line_end);
+    header.push_back(std::string(p, line_end - p));
+    p = next;
+  }
+  int nh = 0, in_block = 0;
+  while (p < end) {
+    next = oce_next_line(p, end, &line_end);
+    std::string line(p, line_end - p);
+    if (in_block > 0) {
+      headers.push_back(line);
+      in_block--;
+    } else if (!woce_is_comment(p, line_end)) {
+      if (headers.empty() && woce_number_headers(p, line_end, &nh)) {
+        headers.push_back(line);
+        in_block = nh - 1;
+      } else {
+        break; // the names line
+      }
+    }
+    header.push_back(line);
+    p = next;
+  }
+  std::vector<std::string> &names = f->names, &units = f->units;
+  for (int k = 0; k < 2 && p < end; k++) {
+    next = oce_next_line(p, end, &line_end);
+    header.push_back(std::string(p, line_end - p));
+    if (k == 0) {
+      names = woce_split(p, line_end);
+    } else {
+      // As for scan(), a final comma yields a final empty field.
+      units = woce_split(p, line_end);
+      if (line_end > p && line_end[-1] == ',')
+        units.push_back("");
+    }
+    p = next;
+  }
+  f->data_start = header.size() + 1;
+
+  // Data
+  size_t ncol = names.size();
+  std::vector<int> want_char(ncol, 0), is_flag(ncol, 0);
+  for (size_t j = 0; j < ncol; j++) {
+    is_flag[j] = woce_is_flag(names[j]);
+    for (size_t k = 0; k < character.size(); k++) {
+      if (names[j] == character[k])
+        want_char[j] = 1;
+    }
+  }
+  int group_col = -1;
+  for (size_t j = 0; !group_by.empty() && j < ncol; j++) {
+    if (names[j] == group_by) {
+      group_col = j;
+      break;
+    }
+  }
+  // Each column is held as numbers for as long as all of its fields
+  // are numbers. The text of character columns is taken from the
+  // lines, whose extents are kept, after the parse.
+  std::vector<std::pair<const char*, const char*> > row;
+  std::vector<std::vector<double> > &num = f->num;
+  num.resize(ncol);
+  std::vector<int> all_num(ncol, 1), all_int(ncol, 1);
+  std::map<std::string, size_t> group_index;
+  std::vector<std::string> &group_names = f->group_names;
+  std::vector<std::vector<int> > &groups = f->groups;
+  int ok = ncol > 0, nrow = 0;
+  while (ok && p < end) {
+    next = oce_next_line(p, end, &line_end);
+    const char *s = oce_skip_space(p, line_end);
+    p = next;
+    if (s == line_end)
+      continue; // blank line
+    if (line_end - s >= 3 && !strncmp(s, "END", 3))
+      break; // END_DATA
+    std::vector<std::string> field = woce_split(s, line_end);
+    // Trailing empty fields beyond the names are ignored, and missing
+    // fields are NA, as for read.csv().
+    while (field.size() > ncol && field.back().empty())
+      field.pop_back();
+    if (field.size() > ncol) {
+      ok = 0;
+      break;
+    }
+    field.resize(ncol);
+    row.push_back(std::make_pair(s, line_end));
+    for (size_t j = 0; j < ncol; j++) {
+      const std::string &fj = field[j];
+      if (want_char[j] || !all_num[j])
+        continue;
+      double v;
+      int is_int;
+      if (fj.empty() || fj == "NA") {
+        v = NA_REAL;
+      } else if (oce_parse_number(fj.data(), fj.data() + fj.size(), &v, &is_int)) {
+        if (!is_int && !(v > INT_MIN && v <= INT_MAX && v == (double)(int)v))
+          all_int[j] = 0;
+      } else {
+        all_num[j] = 0;
+        std::vector<double>().swap(num[j]);
+        continue;
+      }
+      num[j].push_back(v);
+    }
+    if (group_col >= 0) {
+      const std::string &key = field[group_col];
+      std::map<std::string, size_t>::iterator it = group_index.find(key);
+      size_t g;
+      if (it == group_index.end()) {
+        g = groups.size();
+        group_index[key] = g;
+        group_names.push_back(key);
+        groups.push_back(std::vector<int>());
+      } else {
+        g = it->second;
+      }
+      groups[g].push_back(nrow + 1);
+    }
+    nrow++;
+  }
+
+  // Character columns
+  f->is_char.assign(ncol, 0);
+  f->is_int.assign(ncol, 0);
+  f->chr.resize(ncol);
+  f->chr_na.resize(ncol);
+  std::vector<size_t> char_col;
+  for (size_t j = 0; ok && j < ncol; j++) {
+    if (want_char[j] || !all_num[j]) {
+      f->is_char[j] = 1;
+      f->chr[j].resize(nrow);
+      f->chr_na[j].resize(nrow);
+      char_col.push_back(j);
+    } else {
+      f->is_int[j] = is_flag[j] && all_int[j];
+    }
+  }
+  for (int i = 0; i < nrow && char_col.size(); i++) {
+    std::vector<std::string> field = woce_split(row[i].first, row[i].second);
+    field.resize(ncol);
+    for (size_t k = 0; k < char_col.size(); k++) {
+      size_t j = char_col[k];
+      if (!want_char[j] && (field[j].empty() || field[j] == "NA"))
+        f->chr_na[j][i] = 1;
+      else
+        f->chr[j][i].swap(field[j]);
+    }
+  }
+  mf.close();
+  f->nrow = nrow;
+  f->ok = ok;
+  return 1;
+}
+
+List woce_list(woce_file *f)
+{
+  CharacterVector h(f->header.begin(), f->header.end());
+  CharacterVector hs(f->headers.begin(), f->headers.end());
+  CharacterVector nm(f->names.begin(), f->names.end());
+  CharacterVector un(f->units.begin(), f->units.end());
+  List res;
+  if (f->ok) {
+    size_t ncol = f->names.size();
+    int nrow = f->nrow;
+    List data(ncol);
+    for (size_t j = 0; j < ncol; j++) {
+      if (f->is_char[j]) {
+        CharacterVector c(nrow);
+        for (int i = 0; i < nrow; i++) {
+          if (f->chr_na[j][i])
+            SET_STRING_ELT(c, i, NA_STRING);
+          else
+            c[i] = f->chr[j][i];
+        }
+        data[j] = c;
+        std::vector<std::string>().swap(f->chr[j]);
+      } else if (f->is_int[j]) {
+        IntegerVector c(nrow);
+        for (int i = 0; i < nrow; i++)
+          c[i] = ISNAN(f->num[j][i]) ? NA_INTEGER : (int)f->num[j][i];
+        data[j] = c;
+      } else {
+        data[j] = NumericVector(f->num[j].begin(), f->num[j].end());
+      }
+      std::vector<double>().swap(f->num[j]);
+    }
+    List g(f->groups.size());
+    for (size_t k = 0; k < f->groups.size(); k++)
+      g[k] = IntegerVector(f->groups[k].begin(), f->groups[k].end());
+    res = List::create(Named("header")=h, Named("headers")=hs,
+        Named("names")=nm, Named("units")=un, Named("dataStart")=f->data_start,
+        Named("ok")=true, Named("data")=data,
+        Named("groupNames")=CharacterVector(f->group_names.begin(), f->group_names.end()),
+        Named("groups")=g);
+  } else {
+    res = List::create(Named("header")=h, Named("headers")=hs,
+        Named("names")=nm, Named("units")=un, Named("dataStart")=f->data_start,
+        Named("ok")=false, Named("data")=R_NilValue,
+        Named("groupNames")=R_NilValue, Named("groups")=R_NilValue);
+  }
+  return(res);
+}